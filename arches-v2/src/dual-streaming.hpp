@@ -1,6 +1,8 @@
 #pragma once
 
 #include "simulator/simulator.hpp"
+#include "simulator/functional-simulator.hpp"
+#include "simulator/sweep.hpp"
 
 #include "units/unit-dram.hpp"
 #include "units/unit-blocking-cache.hpp"
@@ -10,6 +12,7 @@
 #include "units/unit-tile-scheduler.hpp"
 #include "units/unit-sfu.hpp"
 #include "units/unit-tp.hpp"
+#include "units/unit-quantum-bridge.hpp"
 
 #include "units/dual-streaming/unit-stream-scheduler.hpp"
 #include "units/dual-streaming/unit-ray-staging-buffer.hpp"
@@ -18,6 +21,8 @@
 #include "util/elf.hpp"
 #include "isa/riscv.hpp"
 
+#include <condition_variable>
+
 //#include "../../dual-streaming-benchmark/src/include.hpp"
 
 namespace Arches {
@@ -159,8 +164,49 @@ const static InstructionInfo custom0(CUSTOM_OPCODE0, META_DECL{return isa_custom
 
 }}
 
+//Functional stand-in for the stream scheduler and ray staging buffers. Work items come back in any order and
+//lwi gets segment ~0u once the queue is empty and every thread is waiting on it since nobody is left to add work
+class FunctionalWorkItemQueue
+{
+private:
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	std::deque<WorkItem> _work_items;
+	uint _num_threads;
+	uint _num_waiting{0};
+
+public:
+	FunctionalWorkItemQueue(uint num_threads) : _num_threads(num_threads) {}
+
+	void push(const WorkItem& work_item)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_work_items.push_back(work_item);
+		_condition.notify_one();
+	}
+
+	WorkItem pop()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		if(++_num_waiting == _num_threads) _condition.notify_all();
+		_condition.wait(lock, [&]() { return !_work_items.empty() || _num_waiting == _num_threads; });
+
+		WorkItem work_item;
+		if(_work_items.empty())
+		{
+			work_item.segment = ~0u;
+			return work_item;
+		}
+
+		work_item = _work_items.front();
+		_work_items.pop_front();
+		_num_waiting--;
+		return work_item;
+	}
+};
+
 template <typename RET>
-static RET* write_array(Units::UnitMainMemoryBase* main_memory, size_t alignment, RET* data, size_t size, paddr_t& heap_address)
+static RET* write_array(Units::UnitMainMemoryBase* main_memory, size_t alignment, const RET* data, size_t size, paddr_t& heap_address)
 {
 	paddr_t array_address = align_to(alignment, heap_address);
 	heap_address = array_address + size * sizeof(RET);
@@ -169,25 +215,88 @@ static RET* write_array(Units::UnitMainMemoryBase* main_memory, size_t alignment
 }
 
 template <typename RET>
-static RET* write_vector(Units::UnitMainMemoryBase* main_memory, size_t alignment, std::vector<RET> v, paddr_t& heap_address)
+static RET* write_vector(Units::UnitMainMemoryBase* main_memory, size_t alignment, const std::vector<RET>& v, paddr_t& heap_address)
 {
 	return write_array(main_memory, alignment, v.data(), v.size(), heap_address);
 }
 
-static KernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, paddr_t& heap_address)
+//Hardware and run settings for one machine. The defaults are the baseline configuration
+struct DualStreamingConfig
+{
+	uint num_tps_per_tm{64};
+	uint num_tms{64};
+
+	uint l1_size{32 * 1024};
+	uint l1_associativity{4};
+	ReplacementPolicy::Type l1_replacement_policy{ReplacementPolicy::Type::LRU};
+	uint l1_num_banks{8};
+	uint64_t l1_bank_select_mask{0b0000'0101'0100'0000ull};
+	uint l1_num_lfb{8};
+
+	uint l2_size{4 * 1024 * 1024};
+	uint l2_associativity{8};
+	ReplacementPolicy::Type l2_replacement_policy{ReplacementPolicy::Type::LRU};
+	uint l2_num_banks{32};
+	uint l2_num_mshr{0}; //per bank. 0 models a blocking L2 otherwise the L2 is non-blocking with misses merging in the MSHRs
+	uint l2_num_hit_lfb{4}; //per bank lfbs of the non-blocking L2 that only stage hits so hits keep flowing when every MSHR holds a miss
+	uint64_t l2_bank_select_mask{0b0001'1110'0000'0100'0000ull};
+	NetworkConfiguration l2_network{}; //between the L1s and the L2 banks. One router per bank for a ring or mesh
+
+	uint stream_scheduler_num_banks{16};
+	NetworkConfiguration stream_scheduler_network{}; //between the TMs and the stream scheduler banks
+
+	uint num_threads{0}; //0 runs on tbb otherwise the number of persistent simulation threads
+	uint quantum{1}; //cycles the unit groups can run ahead of each other. Above 1 groups talk through quantum bridges
+
+	std::string checkpoint_path{"dual-streaming.checkpoint"};
+	cycles_t checkpoint_cycle{0}; //saves a checkpoint once the simulation reaches this cycle. 0 disables
+	bool restore_checkpoint{false}; //skips buffer initialization and warm up by restoring the checkpoint. Needs the same configuration it was saved with
+	bool functional{false}; //runs the kernel with no timing model as a quick reference for the frame. Skips checkpoints
+
+	bool log_networks{false}; //reports occupancy, backpressure and arbitration conflicts for every interconnect at the end of the run
+	std::string trace_path{""}; //writes the lifecycle of every memory request the TPs issue to this file. Empty disables. Break it down with --trace-report <path>
+
+	std::string framebuffer_path{"./out.png"}; //empty skips writing the frame
+};
+
+struct DualStreamingResult
 {
-	rtm::Mesh mesh("../datasets/sponza.obj");
-	rtm::BVH blas;
+	cycles_t cycles{0};
+	uint64_t instructions{0};
+	double runtime{0.0}; //host seconds
+	double l1_hit_rate{0.0};
+	double l2_hit_rate{0.0};
+	float dram_power{0.0f}; //watts
+};
+
+//Everything built on the host ahead of the machine. Nothing touches it once it is built so a sweep builds it once and shares it between points
+struct DualStreamingScene
+{
+	ELF elf;
 	std::vector<rtm::Triangle> tris;
-	std::vector<rtm::BVH::BuildObject> build_objects;
-	for(uint i = 0; i < mesh.size(); ++i)
-		build_objects.push_back(mesh.get_build_object(i));
-	blas.build(build_objects);
-	mesh.reorder(build_objects);
-	mesh.get_triangles(tris);
+	std::vector<Treelet> treelets;
 
-	TreeletBVH treelet_bvh(blas, mesh);
+	//restoring a checkpoint brings the buffers back with the rest of memory so it only needs the ELF
+	DualStreamingScene(bool build_buffers = true) : elf("../dual-streaming-benchmark/riscv/kernel")
+	{
+		if(!build_buffers) return;
+
+		rtm::Mesh mesh("../datasets/sponza.obj");
+		rtm::BVH blas;
+		std::vector<rtm::BVH::BuildObject> build_objects;
+		for(uint i = 0; i < mesh.size(); ++i)
+			build_objects.push_back(mesh.get_build_object(i));
+		blas.build(build_objects);
+		mesh.reorder(build_objects);
+		mesh.get_triangles(tris);
+
+		TreeletBVH treelet_bvh(blas, mesh);
+		treelets = std::move(treelet_bvh.treelets);
+	}
+};
 
+static KernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, paddr_t& heap_address, const DualStreamingScene& scene)
+{
 	KernelArgs args;
 	args.framebuffer_width = 256;
 	args.framebuffer_height = 256;
@@ -205,16 +314,18 @@ static KernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, padd
 	//args.hit_records = reinterpret_cast<rtm::Hit*>(heap_address); heap_address += args.framebuffer_size * sizeof(rtm::Hit);
 	std::vector<rtm::Hit> hits(args.framebuffer_size, {T_MAX, 0.0f, ~0u});
 	args.hit_records = write_vector(main_memory, ROW_BUFFER_SIZE, hits, heap_address);
-	args.treelets = write_vector(main_memory, ROW_BUFFER_SIZE, treelet_bvh.treelets, heap_address);
-	args.triangles = write_vector(main_memory, CACHE_BLOCK_SIZE, tris, heap_address);
+	args.treelets = write_vector(main_memory, ROW_BUFFER_SIZE, scene.treelets, heap_address);
+	args.triangles = write_vector(main_memory, CACHE_BLOCK_SIZE, scene.tris, heap_address);
 
 	main_memory->direct_write(&args, sizeof(KernelArgs), KERNEL_ARGS_ADDRESS);
 
 	return args;
 }
 
-static void run_sim_dual_streaming(int argc, char* argv[])
+static DualStreamingResult simulate_dual_streaming(const DualStreamingConfig& config, const DualStreamingScene& scene)
 {
+	DualStreamingResult result;
+
 	ISA::RISCV::InstructionTypeNameDatabase::get_instance()[ISA::RISCV::InstrType::CUSTOM0] = "FCHTHRD";
 	ISA::RISCV::InstructionTypeNameDatabase::get_instance()[ISA::RISCV::InstrType::CUSTOM1] = "BOXISECT";
 	ISA::RISCV::InstructionTypeNameDatabase::get_instance()[ISA::RISCV::InstrType::CUSTOM2] = "TRIISECT";
@@ -223,17 +334,16 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 	ISA::RISCV::InstructionTypeNameDatabase::get_instance()[ISA::RISCV::InstrType::CUSTOM5] = "CSHIT";
 	ISA::RISCV::isa[ISA::RISCV::CUSTOM_OPCODE0] = ISA::RISCV::custom0;
 
-	uint64_t num_tps_per_tm = 64;
-	uint64_t num_tms = 64;
-
-	uint64_t num_tps = num_tps_per_tm * num_tms;
-	uint64_t num_sfus = static_cast<uint>(ISA::RISCV::InstrType::NUM_TYPES) * num_tms;
+	uint64_t num_tps_per_tm = config.num_tps_per_tm;
+	uint64_t num_tms = config.num_tms;
+	uint quantum = config.quantum;
 
 	//hardware spec
 	uint64_t mem_size = 4ull * 1024ull * 1024ull * 1024ull; //4GB
 	uint64_t stack_size = 4096; //1KB
 
 	Simulator simulator;
+	simulator.log_networks = config.log_networks;
 	std::vector<Units::UnitTP*> tps;
 	std::vector<Units::UnitSFU*> sfus;
 	std::vector<Units::DualStreaming::UnitRayStagingBuffer*> rsbs;
@@ -242,29 +352,117 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 	std::vector<std::vector<Units::UnitBase*>> unit_tables; unit_tables.reserve(num_tms);
 	std::vector<std::vector<Units::UnitSFU*>> sfu_lists; sfu_lists.reserve(num_tms);
 	std::vector<std::vector<Units::UnitMemoryBase*>> mem_lists; mem_lists.reserve(num_tms);
+	std::vector<Units::QuantumBridge*> quantum_bridges;
+
+	//clients in other groups connect through a bridge in the unit's group when running in quantum mode
+	auto connect = [&](Units::UnitMemoryBase* unit, uint num_ports) -> Units::UnitMemoryBase*
+	{
+		if(quantum <= 1) return unit;
+		Units::UnitQuantumBridge* bridge = simulator.new_unit<Units::UnitQuantumBridge>(unit, num_ports);
+		simulator.register_quantum_bridge(bridge);
+		quantum_bridges.push_back(bridge);
+		return bridge;
+	};
 
 	Units::UnitDRAM dram(64, mem_size, &simulator); dram.clear();
 	simulator.register_unit(&dram);
+	Units::UnitMemoryBase* dram_port = connect(&dram, 64);
 
 	simulator.new_unit_group();
 
-	ELF elf("../dual-streaming-benchmark/riscv/kernel");
+	const ELF& elf = scene.elf;
 	paddr_t heap_address = dram.write_elf(elf);
 
-	KernelArgs kernel_args = initilize_buffers(&dram, heap_address);
+	if(config.functional)
+	{
+		KernelArgs kernel_args = initilize_buffers(&dram, heap_address, scene);
+
+		FunctionalSimulator::Configuration functional_config;
+		functional_config.pc = elf.elf_header->e_entry.u64;
+		functional_config.sp = 0x0;
+		functional_config.gp = 0x0000000000012c34;
+		functional_config.stack_size = stack_size;
+		functional_config.main_memory = &dram;
+		FunctionalSimulator functional_simulator(functional_config);
+
+		std::atomic_uint next_index{0};
+		functional_simulator.set_handler(ISA::RISCV::InstrType::CUSTOM0, [&](const MemoryRequest& request, MemoryReturn& ret)
+		{
+			uint32_t index = next_index++;
+			ret = MemoryReturn(request, &index);
+			return true;
+		});
+
+		FunctionalWorkItemQueue work_item_queue(functional_simulator.num_threads());
+		functional_simulator.set_handler(ISA::RISCV::InstrType::CUSTOM3, [&](const MemoryRequest& request, MemoryReturn& ret)
+		{
+			WorkItem work_item = work_item_queue.pop();
+			ret = MemoryReturn(request, &work_item);
+			return true;
+		});
+
+		functional_simulator.set_handler(ISA::RISCV::InstrType::CUSTOM4, [&](const MemoryRequest& request, MemoryReturn&)
+		{
+			const WorkItem& work_item = *reinterpret_cast<const WorkItem*>(request.data);
+			work_item_queue.push(work_item);
+			return false;
+		});
+
+		//rays are split across treelets that finish in any order so only keep the closest hit
+		std::mutex hit_mutex;
+		functional_simulator.set_handler(ISA::RISCV::InstrType::CUSTOM5, [&](const MemoryRequest& request, MemoryReturn&)
+		{
+			const rtm::Hit& hit = *reinterpret_cast<const rtm::Hit*>(request.data);
+
+			std::lock_guard<std::mutex> lock(hit_mutex);
+			rtm::Hit* hit_record = reinterpret_cast<rtm::Hit*>(dram._data_u8 + request.paddr);
+			if(hit.t < hit_record->t) *hit_record = hit;
+			return false;
+		});
+
+		functional_simulator.execute();
+
+		printf("Functional Threads: %d\n", functional_simulator.num_threads());
+		printf("Runtime: %.0fms\n", functional_simulator.seconds * 1000.0);
+		printf("Instructions: %lld\n", functional_simulator.instructions);
+		printf("MIPS: %.2f\n", functional_simulator.instructions / functional_simulator.seconds / 1000000.0);
+
+		result.instructions = functional_simulator.instructions;
+		result.runtime = functional_simulator.seconds;
+
+		paddr_t paddr_frame_buffer = reinterpret_cast<paddr_t>(kernel_args.framebuffer);
+		if(!config.framebuffer_path.empty()) dram.dump_as_png_uint8(paddr_frame_buffer, kernel_args.framebuffer_width, kernel_args.framebuffer_height, config.framebuffer_path);
+		return result;
+	}
+
+	//the kernel args and heap are saved ahead of the units so we can skip building the buffers on restore
+	Checkpoint* restore = config.restore_checkpoint ? new Checkpoint(config.checkpoint_path, true) : nullptr;
+	KernelArgs kernel_args;
+	if(restore) (*restore)(kernel_args, heap_address);
+	else kernel_args = initilize_buffers(&dram, heap_address, scene);
 
 	Units::DualStreaming::UnitStreamScheduler::Configuration stream_scheduler_config;
 	stream_scheduler_config.bucket_start = *(paddr_t*)&heap_address;
 	stream_scheduler_config.num_tms = num_tms;
-	stream_scheduler_config.num_banks = 16;
+	stream_scheduler_config.num_banks = config.stream_scheduler_num_banks;
+	stream_scheduler_config.network = config.stream_scheduler_network;
 	stream_scheduler_config.cheat_treelets = (Treelet*)&dram._data_u8[(size_t)kernel_args.treelets];
-	stream_scheduler_config.main_mem = &dram;
+	stream_scheduler_config.main_mem = dram_port;
 	stream_scheduler_config.main_mem_port_offset = 1;
 	stream_scheduler_config.main_mem_port_stride = 4;
 
 	Units::DualStreaming::UnitStreamScheduler stream_scheduler(stream_scheduler_config);
 	simulator.register_unit(&stream_scheduler);
 
+	Units::DualStreaming::UnitStreamSchedulerBase* stream_scheduler_port = &stream_scheduler;
+	if(quantum > 1)
+	{
+		Units::DualStreaming::UnitStreamSchedulerBridge* bridge = simulator.new_unit<Units::DualStreaming::UnitStreamSchedulerBridge>(&stream_scheduler, num_tms);
+		simulator.register_quantum_bridge(bridge);
+		quantum_bridges.push_back(bridge);
+		stream_scheduler_port = bridge;
+	}
+
 	/*
 	Units::UnitBuffer::Configuration scene_buffer_config;
 	scene_buffer_config.size = scene_buffer_size;
@@ -278,22 +476,47 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 
 	simulator.new_unit_group();
 
-	Units::UnitBlockingCache::Configuration l2_config;
-	l2_config.size = 4 * 1024 * 1024;
-	l2_config.associativity = 8;
-	l2_config.num_ports = num_tms * 8;
-	l2_config.num_banks = 32;
-	l2_config.bank_select_mask = 0b0001'1110'0000'0100'0000ull;
-	l2_config.data_array_latency = 4;
-	l2_config.mem_higher = &dram;
-	l2_config.mem_higher_port_offset = 0;
-	l2_config.mem_higher_port_stride = 2;
-
-	Units::UnitBlockingCache l2(l2_config);
-	simulator.register_unit(&l2);
+	//both l2 models share these fields
+	auto set_l2_config = [&](auto& l2_config)
+	{
+		l2_config.size = config.l2_size;
+		l2_config.associativity = config.l2_associativity;
+		l2_config.replacement_policy = config.l2_replacement_policy;
+		l2_config.num_ports = num_tms * 8;
+		l2_config.num_banks = config.l2_num_banks;
+		l2_config.bank_select_mask = config.l2_bank_select_mask;
+		l2_config.network = config.l2_network;
+		l2_config.data_array_latency = 4;
+		l2_config.mem_higher = dram_port;
+		l2_config.mem_higher_port_offset = 0;
+		l2_config.mem_higher_port_stride = 2;
+		l2_config.level = 2;
+	};
+
+	Units::UnitBlockingCache* l2 = nullptr;
+	Units::UnitNonBlockingCache* non_blocking_l2 = nullptr;
+	Units::UnitMemoryBase* l2_port;
+	if(config.l2_num_mshr)
+	{
+		Units::UnitNonBlockingCache::Configuration l2_config;
+		set_l2_config(l2_config);
+		l2_config.num_lfb = config.l2_num_mshr + config.l2_num_hit_lfb;
+		l2_config.num_mshr = config.l2_num_mshr;
+		l2_config.check_retired_lfb = false;
+		non_blocking_l2 = simulator.new_unit<Units::UnitNonBlockingCache>(l2_config);
+		l2_port = connect(non_blocking_l2, num_tms * 8);
+	}
+	else
+	{
+		Units::UnitBlockingCache::Configuration l2_config;
+		set_l2_config(l2_config);
+		l2 = simulator.new_unit<Units::UnitBlockingCache>(l2_config);
+		l2_port = connect(l2, num_tms * 8);
+	}
 
 	Units::UnitAtomicRegfile atomic_regs(num_tms);
 	simulator.register_unit(&atomic_regs);
+	Units::UnitMemoryBase* atomic_regs_port = connect(&atomic_regs, num_tms);
 
 	for(uint tm_index = 0; tm_index < num_tms; ++tm_index)
 	{
@@ -303,33 +526,31 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 		std::vector<Units::UnitMemoryBase*> mem_list;
 
 		Units::UnitNonBlockingCache::Configuration l1_config;
-		l1_config.size = 32 * 1024;
-		l1_config.associativity = 4;
+		l1_config.size = config.l1_size;
+		l1_config.associativity = config.l1_associativity;
+		l1_config.replacement_policy = config.l1_replacement_policy;
 		l1_config.num_ports = num_tps_per_tm;
-		l1_config.num_banks = 8;
-		l1_config.bank_select_mask = 0b0000'0101'0100'0000ull;
+		l1_config.num_banks = config.l1_num_banks;
+		l1_config.bank_select_mask = config.l1_bank_select_mask;
 		l1_config.data_array_latency = 0;
-		l1_config.num_lfb = 8;
-		l1_config.mem_higher = &l2;
+		l1_config.num_lfb = config.l1_num_lfb;
+		l1_config.mem_higher = l2_port;
 		l1_config.mem_higher_port_offset = l1_config.num_banks * tm_index;
 
-		l1s.push_back(new Units::UnitNonBlockingCache(l1_config));
+		l1s.push_back(simulator.new_unit<Units::UnitNonBlockingCache>(l1_config));
 		mem_list.push_back(l1s.back());
-		simulator.register_unit(l1s.back());
 
 		unit_table[(uint)ISA::RISCV::InstrType::LOAD] = l1s.back();
 		unit_table[(uint)ISA::RISCV::InstrType::STORE] = l1s.back();
 
-		thread_schedulers.push_back(_new  Units::UnitThreadScheduler(num_tps_per_tm, tm_index, &atomic_regs, kernel_args.framebuffer_width, kernel_args.framebuffer_height));
+		thread_schedulers.push_back(simulator.new_unit<Units::UnitThreadScheduler>(num_tps_per_tm, tm_index, atomic_regs_port, kernel_args.framebuffer_width, kernel_args.framebuffer_height));
 		mem_list.push_back(thread_schedulers.back());
-		simulator.register_unit(thread_schedulers.back());
 
 		unit_table[(uint)ISA::RISCV::InstrType::ATOMIC] = thread_schedulers.back();
 		unit_table[(uint)ISA::RISCV::InstrType::CUSTOM0] = thread_schedulers.back();
 
-		rsbs.push_back(_new Units::DualStreaming::UnitRayStagingBuffer(num_tps_per_tm, tm_index, &stream_scheduler));
+		rsbs.push_back(simulator.new_unit<Units::DualStreaming::UnitRayStagingBuffer>(num_tps_per_tm, tm_index, stream_scheduler_port));
 		mem_list.push_back(rsbs.back());
-		simulator.register_unit(rsbs.back());
 
 		unit_table[(uint)ISA::RISCV::InstrType::CUSTOM3] = rsbs.back(); //LWI
 		unit_table[(uint)ISA::RISCV::InstrType::CUSTOM4] = rsbs.back(); //SWI
@@ -339,28 +560,23 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 
 		std::vector<Units::UnitSFU*> sfu_list;
 
-		sfu_list.push_back(_new Units::UnitSFU(16, 1, 2, num_tps_per_tm));
-		simulator.register_unit(sfu_list.back());
+		sfu_list.push_back(simulator.new_unit<Units::UnitSFU>(16, 1, 2, num_tps_per_tm));
 		unit_table[(uint)ISA::RISCV::InstrType::FADD] = sfu_list.back();
 		unit_table[(uint)ISA::RISCV::InstrType::FMUL] = sfu_list.back();
 		unit_table[(uint)ISA::RISCV::InstrType::FFMAD] = sfu_list.back();
 
-		sfu_list.push_back(_new Units::UnitSFU(2, 1, 1, num_tps_per_tm));
-		simulator.register_unit(sfu_list.back());
+		sfu_list.push_back(simulator.new_unit<Units::UnitSFU>(2, 1, 1, num_tps_per_tm));
 		unit_table[(uint)ISA::RISCV::InstrType::IMUL] = sfu_list.back();
 		unit_table[(uint)ISA::RISCV::InstrType::IDIV] = sfu_list.back();
 
-		sfu_list.push_back(_new Units::UnitSFU(1, 1, 16, num_tps_per_tm));
-		simulator.register_unit(sfu_list.back());
+		sfu_list.push_back(simulator.new_unit<Units::UnitSFU>(1, 1, 16, num_tps_per_tm));
 		unit_table[(uint)ISA::RISCV::InstrType::FDIV] = sfu_list.back();
 		unit_table[(uint)ISA::RISCV::InstrType::FSQRT] = sfu_list.back();
 
-		sfu_list.push_back(_new Units::UnitSFU(2, 1, 4, num_tps_per_tm));
-		simulator.register_unit(sfu_list.back());
+		sfu_list.push_back(simulator.new_unit<Units::UnitSFU>(2, 1, 4, num_tps_per_tm));
 		unit_table[(uint)ISA::RISCV::InstrType::CUSTOM1] = sfu_list.back();
 
-		sfu_list.push_back(_new Units::UnitSFU(1, 18, 31, num_tps_per_tm));
-		simulator.register_unit(sfu_list.back());
+		sfu_list.push_back(simulator.new_unit<Units::UnitSFU>(1, 18, 31, num_tps_per_tm));
 		unit_table[(uint)ISA::RISCV::InstrType::CUSTOM2] = sfu_list.back();
 
 		for(auto& sfu : sfu_list)
@@ -384,47 +600,182 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 			tp_config.unique_mems = &mem_lists.back();
 			tp_config.unique_sfus = &sfu_lists.back();
 
-			tps.push_back(new Units::DualStreaming::UnitTP(tp_config));
-			simulator.register_unit(tps.back());
+			tps.push_back(simulator.new_unit<Units::DualStreaming::UnitTP>(tp_config));
 			simulator.units_executing++;
 		}
 	}
 
+	//the treelets a frame touches aren't known up front so there is no total
+	simulator.set_progress_work("Segments Retired", [&]() -> uint64_t { return stream_scheduler.segments_retired(); });
+
+	if(restore)
+	{
+		simulator.serialize(*restore);
+		delete restore;
+		printf("Restored checkpoint at cycle %lld\n", simulator.current_cycle);
+	}
+
+	TraceWriter* trace = config.trace_path.empty() ? nullptr : new TraceWriter(config.trace_path);
+
 	auto start = std::chrono::high_resolution_clock::now();
-	simulator.execute();
+	if(config.checkpoint_cycle > 0 && !config.restore_checkpoint)
+	{
+		simulator.execute(config.num_threads, quantum, config.checkpoint_cycle);
+
+		Checkpoint checkpoint(config.checkpoint_path, false);
+		checkpoint(kernel_args, heap_address);
+		simulator.serialize(checkpoint);
+		printf("Saved checkpoint at cycle %lld\n", simulator.current_cycle);
+	}
+	simulator.execute(config.num_threads, quantum);
 	auto stop = std::chrono::high_resolution_clock::now();
+	result.runtime = std::chrono::duration<double>(stop - start).count();
+	result.cycles = simulator.current_cycle;
+
+	if(trace)
+	{
+		delete trace;
+		printf("Trace: %s\n", config.trace_path.c_str());
+	}
 
 	dram.print_usimm_stats(CACHE_BLOCK_SIZE, 4, simulator.current_cycle);
+	result.dram_power = dram.total_power_in_watts();
 
 	printf("\nL2\n");
-	l2.log.print_log();
+	if(non_blocking_l2)
+	{
+		non_blocking_l2->log.print_log();
+		if(non_blocking_l2->log.get_total() > 0) result.l2_hit_rate = (double)non_blocking_l2->log._hits / non_blocking_l2->log.get_total();
+	}
+	else
+	{
+		l2->log.print_log();
+		if(l2->log.get_total() > 0) result.l2_hit_rate = (double)l2->log._hits / l2->log.get_total();
+	}
 
 	printf("\nL1\n");
 	Units::UnitNonBlockingCache::Log l1_log;
 	for(auto& l1 : l1s)
 		l1_log.accumulate(l1->log);
 	l1_log.print_log();
+	if(l1_log.get_total() > 0) result.l1_hit_rate = (double)l1_log._hits / l1_log.get_total();
 
 	printf("\nTP\n");
 	Units::UnitTP::Log tp_log(0x10000);
+	for(auto& tp : tps)
+		tp->flush_outstanding_loads();
 	for(auto& tp : tps)
 		tp_log.accumulate(tp->log);
 	tp_log.print_log();
+	for(auto& tp : tps)
+		result.instructions += tp->instructions_issued();
+
+	printf("\nTM Loads\n");
+	for(uint tm_index = 0; tm_index < num_tms; ++tm_index)
+	{
+		Units::UnitTP::Log tm_log(0x10000);
+		for(uint tp_index = 0; tp_index < num_tps_per_tm; ++tp_index)
+			tm_log.accumulate(tps[tm_index * num_tps_per_tm + tp_index]->log);
+		printf("\tTM %d: Mean Latency: %.2f Mean Outstanding: %.2f\n", tm_index, tm_log.get_mean_load_latency(), simulator.current_cycle ? (double)tm_log.get_outstanding_load_cycles() / simulator.current_cycle : 0.0);
+	}
+
+	if(!quantum_bridges.empty())
+	{
+		printf("\nQuantum Bridges\n");
+		printf("Quantum: %d\n", quantum);
+		Units::QuantumBridge::Log bridge_log;
+		for(auto& bridge : quantum_bridges)
+			bridge_log.accumulate(bridge->log);
+		bridge_log.print_log();
+
+		//a load picks up the delay of every bridge it crosses on the way out and back. Stores add their delay too so this bounds the error from above
+		uint64_t load_latency_cycles = tp_log.get_load_latency_cycles();
+		printf("Share of Load Latency: %.2f%%\n", load_latency_cycles ? 100.0 * bridge_log.get_delay() / load_latency_cycles : 0.0);
+	}
 
 	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
 	printf("\nSummary\n");
 	printf("Runtime: %lldms\n", duration.count());
 	printf("Cycles: %lld\n", simulator.current_cycle);
+	printf("Simulation Rate: %.2f KHz\n", simulator.cycles_per_second / 1000.0);
 	printf("MRays/s: %.2f\n", (float)kernel_args.framebuffer_size / (simulator.current_cycle / (2 * 1024)));
 
+	printf("\n");
+	simulator.print_profile();
+
+	if(config.log_networks)
+	{
+		printf("\n");
+		simulator.print_network_log();
+	}
+
 	paddr_t paddr_frame_buffer = reinterpret_cast<paddr_t>(kernel_args.framebuffer);
-	dram.dump_as_png_uint8(paddr_frame_buffer, kernel_args.framebuffer_width, kernel_args.framebuffer_height, "./out.png");
+	if(!config.framebuffer_path.empty()) dram.dump_as_png_uint8(paddr_frame_buffer, kernel_args.framebuffer_width, kernel_args.framebuffer_height, config.framebuffer_path);
 
-	for(auto& tp : tps) delete tp;
-	for(auto& sfu : sfus) delete sfu;
-	for(auto& rsb : rsbs) delete rsb;
-	for(auto& ts : thread_schedulers) delete ts;
-	for(auto& l1 : l1s) delete l1;
+	return result;
+}
+
+static void run_sim_dual_streaming(int argc, char* argv[])
+{
+	DualStreamingConfig config;
+	DualStreamingScene scene(!config.restore_checkpoint || config.functional);
+	simulate_dual_streaming(config, scene);
+}
+
+//Design space exploration. Builds the scene and treelets once and simulates every point in the grid. Results go to dual-streaming-sweep.csv
+static void run_sweep_dual_streaming(int argc, char* argv[])
+{
+	std::vector<DualStreamingConfig> configs;
+	for(uint num_tms : {32, 64})
+		for(uint l2_size : {2 * 1024 * 1024, 4 * 1024 * 1024, 8 * 1024 * 1024})
+		{
+			DualStreamingConfig config;
+			config.num_tms = num_tms;
+			config.l2_size = l2_size;
+			configs.push_back(config);
+		}
+
+	Sweep::Configuration sweep_config;
+	sweep_config.csv_path = "dual-streaming-sweep.csv";
+	sweep_config.log_path = "dual-streaming-sweep";
+	Sweep sweep(sweep_config);
+
+	DualStreamingScene scene;
+	sweep.run(configs.size(), [&](uint point_index) -> Sweep::Row
+	{
+		DualStreamingConfig config = configs[point_index];
+		config.num_threads = sweep.forking() ? sweep.threads_per_point() : 0;
+		config.framebuffer_path = "";
+
+		DualStreamingResult result = simulate_dual_streaming(config, scene);
+
+		Sweep::Row row;
+		row.add("num_tps_per_tm", config.num_tps_per_tm);
+		row.add("num_tms", config.num_tms);
+		row.add("l1_size", config.l1_size);
+		row.add("l1_associativity", config.l1_associativity);
+		row.add("l1_replacement_policy", ReplacementPolicy::name(config.l1_replacement_policy));
+		row.add("l1_num_banks", config.l1_num_banks);
+		row.add("l1_num_lfb", config.l1_num_lfb);
+		row.add("l2_size", config.l2_size);
+		row.add("l2_associativity", config.l2_associativity);
+		row.add("l2_replacement_policy", ReplacementPolicy::name(config.l2_replacement_policy));
+		row.add("l2_num_banks", config.l2_num_banks);
+		row.add("l2_num_mshr", config.l2_num_mshr);
+		row.add("l2_num_hit_lfb", config.l2_num_hit_lfb);
+		row.add("l2_topology", (uint)config.l2_network.topology);
+		row.add("stream_scheduler_num_banks", config.stream_scheduler_num_banks);
+		row.add("stream_scheduler_topology", (uint)config.stream_scheduler_network.topology);
+		row.add("quantum", config.quantum);
+		row.add("cycles", result.cycles);
+		row.add("instructions", result.instructions);
+		row.add("ipc", result.cycles > 0 ? (double)result.instructions / result.cycles : 0.0);
+		row.add("l1_hit_rate", result.l1_hit_rate);
+		row.add("l2_hit_rate", result.l2_hit_rate);
+		row.add("dram_power", (double)result.dram_power);
+		row.add("runtime", result.runtime);
+		return row;
+	});
 }
 
 }
\ No newline at end of file
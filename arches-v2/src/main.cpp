@@ -8,6 +8,21 @@ int arches_verbosity = 1;
 
 int main(int argc, char* argv[])
 {
+	//breaks down a lifecycle trace written by an earlier run
+	if(argc == 3 && std::strcmp(argv[1], "--trace-report") == 0)
+	{
+		Arches::TraceReport report(argv[2]);
+		report.print();
+		return 0;
+	}
+
+	//simulates the design space grid and writes dual-streaming-sweep.csv
+	if(argc == 2 && std::strcmp(argv[1], "--sweep") == 0)
+	{
+		Arches::run_sweep_dual_streaming(argc, argv);
+		return 0;
+	}
+
 	Arches::run_sim_dual_streaming(argc, argv);
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "functional-simulator.hpp"
+
+#include "../util/bit-manipulation.hpp"
+
+#include <chrono>
+
+namespace Arches {
+
+FunctionalSimulator::FunctionalSimulator(const Configuration& config) : _config(config), _handlers((uint)ISA::RISCV::InstrType::NUM_TYPES)
+{
+	if(_config.num_threads == 0) _config.num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+	_stack_mask = generate_nbit_mask(log2i(_config.stack_size));
+}
+
+void FunctionalSimulator::_write_return(Thread& thread, const MemoryReturn& ret)
+{
+	ISA::RISCV::RegAddr reg_addr(ret.dst);
+	if(reg_addr.reg_type == ISA::RISCV::RegType::FLOAT)
+	{
+		for(uint i = 0; i < ret.size / sizeof(float); ++i)
+		{
+			write_register(&thread.int_regs, &thread.float_regs, reg_addr, 4, ret.data + i * 4);
+			reg_addr.reg++;
+		}
+	}
+	else write_register(&thread.int_regs, &thread.float_regs, reg_addr, ret.size, ret.data);
+}
+
+void FunctionalSimulator::_run(Thread& thread)
+{
+	uint8_t* memory = _config.main_memory->_data_u8;
+	while(thread.pc != 0x0ull)
+	{
+		const ISA::RISCV::Instruction instr(reinterpret_cast<uint32_t*>(memory)[thread.pc / 4]);
+		const ISA::RISCV::InstructionInfo instr_info = instr.get_info();
+		ISA::RISCV::ExecutionItem exec_item = {thread.pc, &thread.int_regs, &thread.float_regs};
+		thread.instructions++;
+
+		if(instr_info.exec_type == ISA::RISCV::ExecType::CONTROL_FLOW)
+		{
+			//jumping to address 0 is the halt condition
+			if(instr_info.execute_branch(exec_item, instr)) thread.pc = exec_item.pc;
+			else thread.pc += 4;
+		}
+		else if(instr_info.exec_type == ISA::RISCV::ExecType::EXECUTABLE)
+		{
+			instr_info.execute(exec_item, instr);
+			thread.pc += 4;
+		}
+		else if(instr_info.exec_type == ISA::RISCV::ExecType::MEMORY)
+		{
+			MemoryRequest req = instr_info.generate_request(exec_item, instr);
+			thread.pc += 4;
+
+			MemoryReturn ret;
+			if(req.vaddr >= (~0x0ull << 20))
+			{
+				if((req.vaddr | _stack_mask) != ~0ull)
+				{
+					printf("STACK OVERFLOW!!!\n");
+					assert(false);
+				}
+
+				paddr_t buffer_addr = req.vaddr & _stack_mask;
+				if(instr_info.instr_type == ISA::RISCV::InstrType::LOAD)
+					write_register(&thread.int_regs, &thread.float_regs, req.dst, req.size, &thread.stack_mem[buffer_addr]);
+				else
+					std::memcpy(&thread.stack_mem[buffer_addr], req.data, req.size);
+			}
+			else if(const Handler& handler = _handlers[(uint)instr_info.instr_type])
+			{
+				if(handler(req, ret)) _write_return(thread, ret);
+			}
+			else if(_config.main_memory->functional_request(req, ret)) _write_return(thread, ret);
+		}
+		else assert(false);
+
+		thread.int_regs.zero.u64 = 0x0ull;
+	}
+}
+
+void FunctionalSimulator::execute()
+{
+	std::vector<Thread> threads(_config.num_threads);
+	for(Thread& thread : threads)
+	{
+		thread.int_regs.sp.u64 = _config.sp;
+		thread.int_regs.gp.u64 = _config.gp;
+		thread.pc = _config.pc;
+		thread.stack_mem.resize(_config.stack_size);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::thread> host_threads;
+	for(Thread& thread : threads)
+		host_threads.emplace_back(&FunctionalSimulator::_run, this, std::ref(thread));
+
+	for(std::thread& host_thread : host_threads)
+		host_thread.join();
+
+	auto stop = std::chrono::high_resolution_clock::now();
+	seconds = std::chrono::duration<double>(stop - start).count();
+
+	instructions = 0;
+	for(Thread& thread : threads)
+		instructions += thread.instructions;
+}
+
+}
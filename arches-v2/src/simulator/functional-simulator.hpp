@@ -0,0 +1,62 @@
+#pragma once
+#include "../stdafx.hpp"
+
+#include "../units/unit-main-memory-base.hpp"
+#include "../isa/riscv.hpp"
+
+#include <functional>
+
+namespace Arches {
+
+//Runs a kernel with no timing model as a fast golden reference. There are no units, interconnects or dram model.
+//Each hardware thread is a register file and a stack that runs to completion on its own host thread.
+//Loads and stores go straight to main memory and any other memory instruction needs a handler standing in for its unit.
+class FunctionalSimulator
+{
+public:
+	//Services a request in place of the unit the instruction would go to. Called from every host thread so it has to be thread safe. Returns true if there is a return
+	typedef std::function<bool(const MemoryRequest& request, MemoryReturn& ret)> Handler;
+
+	struct Configuration
+	{
+		vaddr_t pc{0x0};
+		vaddr_t sp{0x0};
+		vaddr_t gp{0x0};
+
+		uint stack_size{512};
+		uint num_threads{0}; //0 runs one thread per host core
+
+		Units::UnitMainMemoryBase* main_memory{nullptr};
+	};
+
+private:
+	struct Thread
+	{
+		ISA::RISCV::IntegerRegisterFile       int_regs{};
+		ISA::RISCV::FloatingPointRegisterFile float_regs{};
+		vaddr_t                               pc{};
+
+		std::vector<uint8_t> stack_mem;
+		uint64_t instructions{0};
+	};
+
+	Configuration _config;
+	uint64_t _stack_mask;
+	std::vector<Handler> _handlers;
+
+	void _write_return(Thread& thread, const MemoryReturn& ret);
+	void _run(Thread& thread);
+
+public:
+	uint64_t instructions{0};
+	double seconds{0.0};
+
+	FunctionalSimulator(const Configuration& config);
+
+	uint num_threads() { return _config.num_threads; }
+	void set_handler(ISA::RISCV::InstrType type, Handler handler) { _handlers[(uint)type] = handler; }
+
+	void execute();
+};
+
+}
@@ -2,29 +2,44 @@
 #include "../stdafx.hpp"
 
 #include "../util/arbitration.hpp"
+#include "../util/ring-buffer.hpp"
+#include "../units/unit-base.hpp"
 
 namespace Arches {
 
+//Each entry is stamped with the clock it reaches the end of the pipeline so clocking, reading and writing are O(1) regardless of depth.
+//An entry is readable latency - 1 clocks after it is written and a new entry can be written every cpi clocks. The pipeline holds (latency - 1) / cpi + 1 entries.
+//Reads gate the entry behind them the way a stalled last stage would: it can only move up on the next clock and then needs the last stage's clocks.
+//That matches a stage by stage pipeline exactly for cpi 1 and for two stages. Deeper pipelines with cpi > 1 only approximate how a stall drains.
 template <typename T>
 class Pipline
 {
 private:
-	std::queue<T> _queue;
-	std::vector<uint> _pipline_counters;
+	struct Entry
+	{
+		T entry;
+		cycles_t ready_clock;
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(entry, ready_clock); }
+	};
+
+	RingBuffer<Entry> _queue;
 
 	uint _latency;
 	uint _cpi;
+	uint _stages;
 	uint _last_stage_cpi;
 
+	cycles_t _clock{0};
+	cycles_t _next_write_clock{0};
+	cycles_t _last_read_clock{-1};
+
 public:
-	Pipline(uint latency, uint cpi = 1)
+	Pipline(uint latency, uint cpi = 1) : _queue(std::max((latency - 1) / cpi + 1, 1u))
 	{
-		uint pipline_stages = std::max((latency - 1) / cpi + 1, 1u);
-		_pipline_counters.resize(pipline_stages, ~0u);
-
 		_latency = latency;
 		_cpi = cpi;
-
+		_stages = std::max((latency - 1) / cpi + 1, 1u);
 		_last_stage_cpi = (_latency - 1) % _cpi;
 	}
 
@@ -40,65 +55,61 @@ public:
 
 	void clock()
 	{
-		for(uint i = 0; i < (_pipline_counters.size() - 1); ++i)
-			if(_pipline_counters[i] < _cpi)
-				_pipline_counters[i]++;
-
-		if(_pipline_counters.back() < _last_stage_cpi)
-			_pipline_counters.back()++;
-
-		for(uint i = (_pipline_counters.size() - 1); i != 0; --i)
-		{
-			if(_pipline_counters[i] == ~0u && _pipline_counters[i - 1] == _cpi)
-			{
-				_pipline_counters[i] = 0;
-				_pipline_counters[i - 1] = ~0u;
-			}
-		}
+		_clock++;
 	}
 
 	bool is_write_valid()
 	{
-		return _pipline_counters.front() == ~0u;
+		//a single stage pipeline is written straight into the last stage
+		if(_stages == 1) return _queue.empty();
+
+		//a slot freed by a read only reaches the first stage on the next clock
+		return _clock >= _next_write_clock && _queue.size() + (_last_read_clock == _clock) < _stages;
 	}
 
 	void write(const T& entry)
 	{
 		assert(is_write_valid());
-		_queue.push(entry);
-		_pipline_counters.front() = 0;
+		_queue.push({entry, _clock + std::max(_latency, 1u) - 1});
+		_next_write_clock = _clock + _cpi;
 	}
 
 	bool is_read_valid()
 	{
-		return _pipline_counters.back() == _last_stage_cpi;
+		if(_queue.empty() || _queue.front().ready_clock > _clock) return false;
+		return _stages == 1 || _clock > _last_read_clock + _last_stage_cpi;
 	}
 
 	T& peek()
 	{
 		assert(is_read_valid());
-		return _queue.front();
+		return _queue.front().entry;
 	}
 
 	T read()
 	{
 		assert(is_read_valid());
-		T ret = _queue.front();
+		T ret = _queue.front().entry;
 		_queue.pop();
-		_pipline_counters.back() = ~0u;
+		_last_read_clock = _clock;
 		return ret;
 	}
+
+	void serialize(Checkpoint& checkpoint)
+	{
+		checkpoint(_queue, _clock, _next_write_clock, _last_read_clock);
+	}
 };
 
 template <typename T>
 class FIFO
 {
 private:
-	std::queue<T> _queue;
+	RingBuffer<T> _queue;
 	size_t        _max_size;
 
 public:
-	FIFO(size_t max_size)
+	FIFO(size_t max_size) : _queue(max_size)
 	{
 		_max_size = max_size;
 	}
@@ -110,6 +121,7 @@ public:
 
 	void write(const T& entry)
 	{
+		assert(is_write_valid());
 		_queue.push(entry);
 	}
 
@@ -129,12 +141,205 @@ public:
 		_queue.pop();
 		return ret;
 	}
+
+	void serialize(Checkpoint& checkpoint)
+	{
+		checkpoint(_queue);
+	}
 };
 
 
 
+//Optional statistics for finding where transactions queue up. Source port counters are only touched by that port's producer and the rest only by the
+//owner in clock() so nothing here needs to be atomic. Occupancy is sampled when the owner clocks the network. Owners only sleep once their networks
+//are empty so the clocks a port was empty are whatever is left of the run and are filled in when printing.
+class NetworkLog
+{
+public:
+	struct Port
+	{
+		std::vector<uint64_t> occupancy; //occupancy[n] is the number of clocks the port held n transactions
+		uint64_t writes{0};
+		uint64_t write_blocked{0}; //cycles a producer found the port full. Only the first failed is_write_valid call each cycle counts
+		cycles_t last_blocked_cycle{-1};
+	};
+
+	struct Link
+	{
+		uint64_t transactions{0};
+		uint64_t flits{0}; //clocks the link was busy
+		uint64_t bytes{0};
+	};
+
+	std::vector<Port> _ports;
+	std::vector<Link> _links; //crossbar lanes or router ports. Left empty by networks that don't model their links
+	uint64_t _networks; //networks accumulated into this log
+	uint64_t _conflicts; //transactions that lost arbitration, once per clock they lost
+	uint64_t _sink_blocked; //transactions that were ready to leave but found their sink full, once per clock
+
+	NetworkLog(uint num_ports = 0, uint depth = 0) : _ports(num_ports)
+	{
+		for(Port& port : _ports) port.occupancy.resize(depth + 1, 0);
+		reset();
+		_networks = num_ports ? 1 : 0;
+	}
+
+	void reset()
+	{
+		for(Port& port : _ports)
+		{
+			std::fill(port.occupancy.begin(), port.occupancy.end(), 0);
+			port.writes = 0;
+			port.write_blocked = 0;
+			port.last_blocked_cycle = -1;
+		}
+		for(Link& link : _links) link = Link();
+		_conflicts = 0;
+		_sink_blocked = 0;
+	}
+
+	//Port i of other is added to port i here so only networks of the same shape should be accumulated together
+	void accumulate(const NetworkLog& other)
+	{
+		if(_ports.size() < other._ports.size()) _ports.resize(other._ports.size());
+		for(uint port_index = 0; port_index < other._ports.size(); ++port_index)
+		{
+			Port& port = _ports[port_index];
+			const Port& other_port = other._ports[port_index];
+			if(port.occupancy.size() < other_port.occupancy.size()) port.occupancy.resize(other_port.occupancy.size(), 0);
+			for(uint size = 0; size < other_port.occupancy.size(); ++size)
+				port.occupancy[size] += other_port.occupancy[size];
+			port.writes += other_port.writes;
+			port.write_blocked += other_port.write_blocked;
+		}
+		if(_links.size() < other._links.size()) _links.resize(other._links.size());
+		for(uint link_index = 0; link_index < other._links.size(); ++link_index)
+		{
+			_links[link_index].transactions += other._links[link_index].transactions;
+			_links[link_index].flits += other._links[link_index].flits;
+			_links[link_index].bytes += other._links[link_index].bytes;
+		}
+		_networks += other._networks;
+		_conflicts += other._conflicts;
+		_sink_blocked += other._sink_blocked;
+	}
+
+	void log_occupancy(uint port_index, uint size) { _ports[port_index].occupancy[size]++; }
+	void log_write(uint port_index) { _ports[port_index].writes++; }
+	void log_write_blocked(uint port_index)
+	{
+		//producers can retry a full port several times in a cycle. Outside a phase every call counts
+		Port& port = _ports[port_index];
+		cycles_t cycle = Simulator::clock_context().cycle;
+		if(cycle >= 0 && cycle == port.last_blocked_cycle) return;
+		port.last_blocked_cycle = cycle;
+		port.write_blocked++;
+	}
+	void log_conflicts(uint n) { _conflicts += n; }
+	void log_sink_blocked() { _sink_blocked++; }
+	void log_link(uint link_index, uint flits, uint bytes)
+	{
+		Link& link = _links[link_index];
+		link.transactions++;
+		link.flits += flits;
+		link.bytes += bytes;
+	}
+
+	//Rates are per network over the given number of cycles
+	void print_log(cycles_t cycles, FILE* stream = stdout)
+	{
+		if(_ports.empty() || cycles <= 0) return;
+
+		double network_cycles = (double)cycles * _networks;
+		double port_cycles = network_cycles * _ports.size();
+
+		uint64_t writes = 0, write_blocked = 0;
+		std::vector<uint64_t> occupancy;
+		double busiest_occupancy = -1.0;
+		uint busiest_port = 0;
+		for(uint port_index = 0; port_index < _ports.size(); ++port_index)
+		{
+			const Port& port = _ports[port_index];
+			writes += port.writes;
+			write_blocked += port.write_blocked;
+			if(occupancy.size() < port.occupancy.size()) occupancy.resize(port.occupancy.size(), 0);
+
+			uint64_t occupied_cycles = 0, occupancy_sum = 0;
+			for(uint size = 1; size < port.occupancy.size(); ++size)
+			{
+				occupancy[size] += port.occupancy[size];
+				occupied_cycles += port.occupancy[size];
+				occupancy_sum += size * port.occupancy[size];
+			}
+			occupancy[0] += std::max<int64_t>((int64_t)network_cycles - (int64_t)occupied_cycles, 0);
+
+			double mean_occupancy = occupancy_sum / network_cycles;
+			if(mean_occupancy > busiest_occupancy)
+			{
+				busiest_occupancy = mean_occupancy;
+				busiest_port = port_index;
+			}
+		}
+
+		double occupancy_sum = 0.0;
+		for(uint size = 1; size < occupancy.size(); ++size)
+			occupancy_sum += (double)size * occupancy[size];
+		while(occupancy.size() > 2 && occupancy.back() == 0) occupancy.pop_back();
+
+		fprintf(stream, "Transactions: %lld(%.3f per cycle)\n", writes, writes / network_cycles);
+		fprintf(stream, "Mean Port Occupancy: %.3f\n", occupancy_sum / port_cycles);
+		fprintf(stream, "Occupancy:");
+		for(uint size = 0; size < occupancy.size(); ++size)
+			fprintf(stream, " %d:%.2f%%", size, 100.0 * occupancy[size] / port_cycles);
+		fprintf(stream, "\n");
+		fprintf(stream, "Busiest Port: %d(%.3f mean occupancy, %lld write blocked)\n", busiest_port, busiest_occupancy, _ports[busiest_port].write_blocked);
+		fprintf(stream, "Write Blocked: %lld(%.2f%% of port cycles)\n", write_blocked, 100.0 * write_blocked / port_cycles);
+		fprintf(stream, "Arbitration Conflicts: %lld(%.3f per cycle)\n", _conflicts, _conflicts / network_cycles);
+		fprintf(stream, "Sink Blocked: %lld(%.3f per cycle)\n", _sink_blocked, _sink_blocked / network_cycles);
+
+		if(_links.empty()) return;
+
+		uint64_t flits = 0;
+		uint busiest_link = 0;
+		for(uint link_index = 0; link_index < _links.size(); ++link_index)
+		{
+			flits += _links[link_index].flits;
+			if(_links[link_index].flits > _links[busiest_link].flits) busiest_link = link_index;
+		}
+
+		fprintf(stream, "Link Utilization: %.2f%%(busiest %d at %.2f%%)\n", 100.0 * flits / (network_cycles * _links.size()), busiest_link, 100.0 * _links[busiest_link].flits / network_cycles);
+		fprintf(stream, "Link Bytes Per Cycle:");
+		for(uint link_index = 0; link_index < _links.size(); ++link_index)
+			fprintf(stream, " %d:%.2f", link_index, _links[link_index].bytes / network_cycles);
+		fprintf(stream, "\n");
+	}
+};
+
+//Bytes of data a transaction carries over a link. Transaction types that carry data overload this next to their definition. Anything else is only a header
+template<typename T>
+uint payload_bytes(const T& transaction) { return 0; }
+
+//Clocks a transaction keeps a link that moves link_bytes per clock busy. Links with 0 bytes move any transaction in one clock
+template<typename T>
+uint link_flits(const T& transaction, uint link_bytes)
+{
+	if(link_bytes == 0) return 1;
+	return std::max((payload_bytes(transaction) + link_bytes - 1) / link_bytes, 1u);
+}
+
+//Type independent interface so the simulator can reach every network a unit owns
+class NetworkBase
+{
+public:
+	virtual ~NetworkBase() = default;
+
+	//Statistics are off until enable_log() is called. log() is nullptr until then
+	virtual void enable_log() = 0;
+	virtual NetworkLog* log() = 0;
+};
+
 template<typename T>
-class InterconnectionNetwork
+class InterconnectionNetwork : public NetworkBase
 {
 public:
 	InterconnectionNetwork() {}
@@ -144,14 +349,38 @@ public:
 	virtual uint num_sources() = 0;
 	virtual uint num_sinks() = 0;
 
+	//True if clock() has nothing to move. Only looks at source side state so owners can check it on clock rise.
+	virtual bool is_idle() = 0;
+
+	//Saves or restores the transactions in flight. Sink units are wiring and aren't part of the state
+	virtual void serialize(Checkpoint& checkpoint) = 0;
+
+	//True if the network is idle and nothing is waiting at a sink. Only valid for the owner of the sinks on clock rise.
+	bool empty()
+	{
+		if(!is_idle()) return false;
+
+		for(uint sink_index = 0; sink_index < num_sinks(); ++sink_index)
+			if(is_read_valid(sink_index)) return false;
+
+		return true;
+	}
+
+	//Unit to wake when a transaction arrives at the sink so the reader can sleep while it waits.
+	virtual void set_sink_unit(uint sink_index, Units::UnitBase* unit) = 0;
+
 	//Sink Interface. Clock rise only. 
 	virtual bool is_read_valid(uint sink_index) = 0;
 	virtual const T& peek(uint sink_index) = 0;
 	virtual const T read(uint sink_index) = 0;
+	//Drops the transaction at the sink without copying it out. Use it after peek when the copy isn't needed.
+	virtual void pop(uint sink_index) = 0;
 
 	//Source Interface. Clock fall only.
 	virtual bool is_write_valid(uint source_index) = 0;
 	virtual void write(const T& transaction, uint source_index) = 0;
+	//Moves the transaction in. Networks move it hop to hop from there so a transaction that owns its payload is never copied
+	virtual void write(T&& transaction, uint source_index) = 0;
 };
 
 
@@ -164,26 +393,55 @@ private:
 	//reads to the data only happen if pending flag is set and ack is done by clearing the pending bit
 	std::vector<bool> _pending;
 	std::vector<T>    _transactions;
+	std::vector<Units::UnitBase*> _sink_units;
+	NetworkLog* _log{nullptr};
 
 public:
-	RegisterArray(uint size) : _pending(size, false), _transactions(size) {}
-	~RegisterArray() {}
+	RegisterArray(uint size) : _pending(size, false), _transactions(size), _sink_units(size, nullptr) {}
+	~RegisterArray() { delete _log; }
 
 
 
 	void clock()
 	{
+		if(!_log) return;
+		for(uint port_index = 0; port_index < _pending.size(); ++port_index)
+			if(_pending[port_index]) _log->log_occupancy(port_index, 1);
+	}
+
+	void enable_log() override
+	{
+		if(!_log) _log = new NetworkLog(_pending.size(), 1);
+	}
+
+	NetworkLog* log() override
+	{
+		return _log;
+	}
 
+	bool is_idle()
+	{
+		return true;
 	}
 
 	uint num_sources()
 	{
-		_pending.size();
+		return _pending.size();
 	}
 
 	uint num_sinks()
 	{
-		_pending.size();
+		return _pending.size();
+	}
+
+	void set_sink_unit(uint sink_index, Units::UnitBase* unit)
+	{
+		_sink_units[sink_index] = unit;
+	}
+
+	void serialize(Checkpoint& checkpoint)
+	{
+		checkpoint(_pending, _transactions);
 	}
 
 
@@ -204,91 +462,329 @@ public:
 		return _transactions[sink_index];
 	}
 
+	void pop(uint sink_index)
+	{
+		_pending[sink_index] = false;
+	}
+
 
 
 	bool is_write_valid(uint source_index)
 	{
+		if(_pending[source_index] && _log) _log->log_write_blocked(source_index);
 		return !_pending[source_index];
 	}
 
 	void write(const T& transaction, uint source_index)
 	{
+		if(_log) _log->log_write(source_index);
 		_pending[source_index] = true;
 		_transactions[source_index] = transaction;
+		if(_sink_units[source_index]) _sink_units[source_index]->wake();
+	}
+
+	void write(T&& transaction, uint source_index)
+	{
+		if(_log) _log->log_write(source_index);
+		_pending[source_index] = true;
+		_transactions[source_index] = std::move(transaction);
+		if(_sink_units[source_index]) _sink_units[source_index]->wake();
 	}
 };
 
+//Checks that every FIFOArray port is a single producer single consumer channel that follows the clock contract. On by default in debug builds.
+//Each end of a port may only be used by one unit group. If the ends are in different groups they have to use the port in different phases so the
+//barrier between rise and fall orders them. Otherwise the result depends on which thread gets there first and parallel runs stop matching serial ones.
+//Quantum mode has no barrier between groups so both ends have to be in the same group there.
+#ifndef ENABLE_CHANNEL_CHECKS
+	#ifdef BUILD_DEBUG
+		#define ENABLE_CHANNEL_CHECKS 1
+	#else
+		#define ENABLE_CHANNEL_CHECKS 0
+	#endif
+#endif
+
+class ChannelChecker
+{
+private:
+	//ends can be touched from different threads so the checker itself sticks to atomics
+	struct End
+	{
+		std::atomic_uint group_index{~0u};
+		std::atomic_uint8_t phases{0};
+	};
+
+	struct Channel
+	{
+		End producer;
+		End consumer;
+	};
+
+	std::vector<Channel> _channels;
+
+	static void _violation(const char* message, uint port_index, uint group_index, uint other_group_index)
+	{
+		printf("Channel violation on port %d between groups %d and %d: %s\n", port_index, group_index, other_group_index, message);
+		fflush(stdout);
+		assert(false);
+	}
+
+	static void _use(End& end, End& other, uint port_index)
+	{
+		const Simulator::ClockContext& context = Simulator::clock_context();
+		if(context.phase == Simulator::Phase::NONE) return;
+
+		uint group_index = ~0u;
+		if(!end.group_index.compare_exchange_strong(group_index, context.group_index, std::memory_order_relaxed) && group_index != context.group_index)
+			_violation("more than one group uses the same end", port_index, context.group_index, group_index);
+
+		uint8_t phase = 0x1 << static_cast<uint>(context.phase);
+		end.phases.fetch_or(phase, std::memory_order_relaxed);
+
+		uint other_group_index = other.group_index.load(std::memory_order_relaxed);
+		if(other_group_index == ~0u || other_group_index == context.group_index) return;
+
+		if(!context.lockstep)
+			_violation("the ends are in different groups in quantum mode", port_index, context.group_index, other_group_index);
+		else if(other.phases.load(std::memory_order_relaxed) & phase)
+			_violation("the ends are in different groups and use the port in the same phase", port_index, context.group_index, other_group_index);
+	}
+
+public:
+	ChannelChecker(uint size) : _channels(size) {}
+
+	void producer(uint port_index) { _use(_channels[port_index].producer, _channels[port_index].consumer, port_index); }
+	void consumer(uint port_index) { _use(_channels[port_index].consumer, _channels[port_index].producer, port_index); }
+};
+
 template<typename T>
 class FIFOArray : public InterconnectionNetwork<T>
 {
 private:
-	std::vector<uint8_t>       _sizes;
-	std::vector<std::queue<T>> _fifos;
+	//Each port is a ring in one slab indexed by port * capacity. Producers only move the tail and consumers only move the head so the two ends
+	//never write the same state. Producers write on clock fall and consumers read on clock rise so a write is visible from the next phase on.
+	//Heads and tails run freely and wrap at 256 so the size is just their difference
+	std::vector<uint8_t>       _tails;
+	std::vector<uint8_t>       _heads;
+	std::vector<T>             _entries;
+	std::vector<Units::UnitBase*> _sink_units;
+
+	//One bit per non empty port so owners can visit only the ports that have something in them. Ports that share a word can be used from
+	//different threads so the words are atomic, but they only change when a port goes from empty to non empty or back.
+	std::vector<std::atomic_uint64_t> _occupied;
+	NetworkLog* _log{nullptr};
 	uint8_t _max_size;
+	uint8_t _mask;
+
+#if ENABLE_CHANNEL_CHECKS
+	ChannelChecker _checker;
+#endif
+
+	uint8_t _size(uint port_index)
+	{
+		return _tails[port_index] - _heads[port_index];
+	}
+
+	T& _entry(uint port_index, uint8_t position)
+	{
+		return _entries[port_index * (_mask + 1u) + (position & _mask)];
+	}
+
+	void _set_occupied(uint port_index)
+	{
+		_occupied[port_index / 64].fetch_or(0x1ull << (port_index % 64), std::memory_order_relaxed);
+	}
+
+	void _clear_occupied(uint port_index)
+	{
+		_occupied[port_index / 64].fetch_and(~(0x1ull << (port_index % 64)), std::memory_order_relaxed);
+	}
+
+	void _check_producer([[maybe_unused]] uint port_index)
+	{
+	#if ENABLE_CHANNEL_CHECKS
+		_checker.producer(port_index);
+	#endif
+	}
+
+	void _check_consumer([[maybe_unused]] uint port_index)
+	{
+	#if ENABLE_CHANNEL_CHECKS
+		_checker.consumer(port_index);
+	#endif
+	}
 
 public:
-	FIFOArray(uint size, uint depth = 8) : _sizes(size), _fifos(size), _max_size(depth) {}
+	FIFOArray(uint size, uint depth = 8) : _tails(size), _heads(size), _entries(size * ring_buffer_capacity(depth)), _sink_units(size, nullptr), _occupied((size + 63) / 64), _max_size(depth), _mask(ring_buffer_capacity(depth) - 1)
+	#if ENABLE_CHANNEL_CHECKS
+		, _checker(size)
+	#endif
+	{
+		assert(depth <= 128);
+	}
+
+	~FIFOArray() { delete _log; }
 
 
 
+	//Only samples occupancy for the log. Networks built on FIFOArray clock their source ports from their own clock
 	void clock() override
 	{
+		if(!_log) return;
+		for_each_occupied([&](uint port_index) { _log->log_occupancy(port_index, _size(port_index)); });
+	}
+
+	void enable_log() override
+	{
+		if(!_log) _log = new NetworkLog(_tails.size(), _max_size);
+	}
+
+	NetworkLog* log() override
+	{
+		return _log;
+	}
 
+	bool is_idle() override
+	{
+		return true;
 	}
 
 	uint num_sources() override
 	{
-		return _sizes.size();
+		return _tails.size();
 	}
 
 	uint num_sinks() override
 	{
-		return _sizes.size();
+		return _tails.size();
+	}
+
+	void set_sink_unit(uint sink_index, Units::UnitBase* unit) override
+	{
+		_sink_units[sink_index] = unit;
+	}
+
+	//True if any port holds a transaction. Costs one load per 64 ports.
+	bool is_occupied()
+	{
+		for(const std::atomic_uint64_t& word : _occupied)
+			if(word.load(std::memory_order_relaxed)) return true;
+		return false;
+	}
+
+	//Calls visit(port_index) for every port that holds a transaction, in port order. Consumer side only. The visitor may read from the port.
+	template<typename VISITOR>
+	void for_each_occupied(VISITOR&& visit)
+	{
+		for(uint word_index = 0; word_index < _occupied.size(); ++word_index)
+		{
+			uint64_t word = _occupied[word_index].load(std::memory_order_relaxed);
+			while(word)
+			{
+				visit(word_index * 64 + std::countr_zero(word));
+				word &= word - 1;
+			}
+		}
+	}
+
+	void serialize(Checkpoint& checkpoint) override
+	{
+		for(uint port_index = 0; port_index < _tails.size(); ++port_index)
+		{
+			uint8_t size = _size(port_index);
+			checkpoint(size);
+			if(checkpoint.restoring())
+			{
+				if(size > _max_size) throw std::runtime_error("Invalid checkpoint: it was saved from a different configuration!");
+				_heads[port_index] = 0;
+				_tails[port_index] = size;
+				if(size) _set_occupied(port_index);
+				else     _clear_occupied(port_index);
+			}
+
+			for(uint8_t i = 0; i < size; ++i)
+				checkpoint(_entry(port_index, _heads[port_index] + i));
+		}
 	}
 
 
 
 	bool is_read_valid(uint sink_index) override
 	{
-		return _sizes[sink_index] > 0;
+		_check_consumer(sink_index);
+		return _tails[sink_index] != _heads[sink_index];
 	}
 
 	const T& peek(uint sink_index) override
 	{
 		assert(is_read_valid(sink_index));
-		return _fifos[sink_index].front();
+		_check_consumer(sink_index);
+		return _entry(sink_index, _heads[sink_index]);
 	}
 
 	const T read(uint sink_index) override
 	{
 		const T t = peek(sink_index);
-		_sizes[sink_index]--;
-		_fifos[sink_index].pop();
+		pop(sink_index);
 		return t;
 	}
 
+	//Like peek but the transaction can be moved out before it is popped. Networks built on FIFOArray use it to move transactions between their stages
+	T& front(uint sink_index)
+	{
+		assert(is_read_valid(sink_index));
+		_check_consumer(sink_index);
+		return _entry(sink_index, _heads[sink_index]);
+	}
+
+	void pop(uint sink_index) override
+	{
+		assert(is_read_valid(sink_index));
+		_check_consumer(sink_index);
+		if(++_heads[sink_index] == _tails[sink_index]) _clear_occupied(sink_index);
+	}
+
 
 
 	bool is_write_valid(uint source_index) override
 	{
-		return _sizes[source_index] < _max_size;
+		_check_producer(source_index);
+		if(_size(source_index) < _max_size) return true;
+		if(_log) _log->log_write_blocked(source_index);
+		return false;
 	}
 
 	void write(const T& transaction, uint source_index) override
 	{
 		assert(is_write_valid(source_index));
-		_sizes[source_index]++;
-		_fifos[source_index].push(transaction);
+		_check_producer(source_index);
+		if(_log) _log->log_write(source_index);
+		if(_tails[source_index] == _heads[source_index]) _set_occupied(source_index);
+		_entry(source_index, _tails[source_index]++) = transaction;
+		if(_sink_units[source_index]) _sink_units[source_index]->wake();
+	}
+
+	void write(T&& transaction, uint source_index) override
+	{
+		assert(is_write_valid(source_index));
+		_check_producer(source_index);
+		if(_log) _log->log_write(source_index);
+		if(_tails[source_index] == _heads[source_index]) _set_occupied(source_index);
+		_entry(source_index, _tails[source_index]++) = std::move(transaction);
+		if(_sink_units[source_index]) _sink_units[source_index]->wake();
 	}
 };
 
 
-template<typename T>
+//Arbiters are RoundRobinArbiter by default which handles up to 64 clients. Use HierarchicalRoundRobinArbiter for wider stages.
+//Networks that route take a ROUTER policy with a uint get_sink(const T&) member. It's a template parameter rather than a virtual so it inlines
+//into the clock loop. Clocking only visits occupied sources so its cost follows the traffic rather than the port count.
+template<typename T, typename ARBITER = RoundRobinArbiter>
 class Casscade : public InterconnectionNetwork<T>
 {
 private:
 	FIFOArray<T> _source_fifos;
-	std::vector<RoundRobinArbiter> _arbiters;
+	std::vector<ARBITER> _arbiters;
 	size_t                         _cascade_ratio;
 	FIFOArray<T> _sink_fifos;
 
@@ -297,161 +793,241 @@ public:
 
 	void clock()
 	{
-		for(uint source_index = 0; source_index < _source_fifos.num_sinks(); ++source_index)
+		_source_fifos.clock();
+		_source_fifos.for_each_occupied([&](uint source_index)
 		{
-			if(!_source_fifos.is_read_valid(source_index)) continue;
-
 			uint cascade_index = source_index / _cascade_ratio;
 			uint cascade_source_index = source_index % _cascade_ratio;
 
 			_arbiters[cascade_index].add(cascade_source_index);
-		}
+		});
 
+		NetworkLog* log = _source_fifos.log();
 		for(uint sink_index = 0; sink_index < _sink_fifos.num_sinks(); ++sink_index)
 		{
-			if(!_sink_fifos.is_write_valid(sink_index) || !_arbiters[sink_index].num_pending()) continue;
+			if(!_arbiters[sink_index].num_pending()) continue;
+			if(!_sink_fifos.is_write_valid(sink_index))
+			{
+				if(log) log->log_sink_blocked();
+				continue;
+			}
 
+			if(log) log->log_conflicts(_arbiters[sink_index].num_pending() - 1);
 			uint cascade_source_index = _arbiters[sink_index].get_index();
 			uint source_index = sink_index * _cascade_ratio + cascade_source_index;
 
-			_sink_fifos.write(_source_fifos.read(source_index), sink_index);
+			_sink_fifos.write(std::move(_source_fifos.front(source_index)), sink_index);
+			_source_fifos.pop(source_index);
 			_arbiters[sink_index].remove(cascade_source_index);
 		}
 	}
 
+	bool is_idle() override { return !_source_fifos.is_occupied(); }
+	void enable_log() override { _source_fifos.enable_log(); }
+	NetworkLog* log() override { return _source_fifos.log(); }
+	void serialize(Checkpoint& checkpoint) override { checkpoint(_source_fifos, _arbiters, _sink_fifos); }
+
 	uint num_sources() override { return _source_fifos.num_sources(); }
 	uint num_sinks() override { return _sink_fifos.num_sinks(); }
+	void set_sink_unit(uint sink_index, Units::UnitBase* unit) override { _sink_fifos.set_sink_unit(sink_index, unit); }
 
 	bool is_read_valid(uint sink_index) override { return _sink_fifos.is_read_valid(sink_index); }
 	const T& peek(uint sink_index) override { return _sink_fifos.peek(sink_index); }
 	const T read(uint sink_index) override { return _sink_fifos.read(sink_index); }
+	void pop(uint sink_index) override { _sink_fifos.pop(sink_index); }
 
 	bool is_write_valid(uint source_index) override { return _source_fifos.is_write_valid(source_index); }
 	void write(const T& transaction, uint source_index) override { _source_fifos.write(transaction, source_index); }
+	void write(T&& transaction, uint source_index) override { _source_fifos.write(std::move(transaction), source_index); }
 };
 
-template<typename T>
+template<typename T, typename ROUTER>
 class Decasscade : public InterconnectionNetwork<T>
 {
 private:
 	FIFOArray<T> _source_fifos;
+	ROUTER _router;
 	FIFOArray<T> _sink_fifos;
 
 public:
-	Decasscade(uint sources, uint sinks) : _source_fifos(sources), _sink_fifos(sinks) {}
-
-	virtual uint get_sink(const T& transaction) = 0;
+	Decasscade(uint sources, uint sinks, const ROUTER& router = ROUTER()) : _source_fifos(sources), _router(router), _sink_fifos(sinks) {}
 
 	void clock()
 	{
-		for(uint source_index = 0; source_index < _source_fifos.num_sinks(); ++source_index)
+		_source_fifos.clock();
+		NetworkLog* log = _source_fifos.log();
+		_source_fifos.for_each_occupied([&](uint source_index)
 		{
-			if(!_source_fifos.is_read_valid(source_index)) continue;
-
-			uint sink_index = get_sink(_source_fifos.peek(source_index), source_index);
-			if(!_sink_fifos.is_write_valid(sink_index)) continue;
+			uint sink_index = _router.get_sink(_source_fifos.peek(source_index));
+			assert(sink_index < _sink_fifos.num_sinks());
+			if(!_sink_fifos.is_write_valid(sink_index))
+			{
+				if(log) log->log_sink_blocked();
+				return;
+			}
 
-			_sink_fifos.write(_source_fifos.read(source_index), sink_index);
-		}
+			_sink_fifos.write(std::move(_source_fifos.front(source_index)), sink_index);
+			_source_fifos.pop(source_index);
+		});
 	}
 
+	bool is_idle() override { return !_source_fifos.is_occupied(); }
+	void enable_log() override { _source_fifos.enable_log(); }
+	NetworkLog* log() override { return _source_fifos.log(); }
+	void serialize(Checkpoint& checkpoint) override { checkpoint(_source_fifos, _sink_fifos); }
+
 	uint num_sources() override { return _source_fifos.num_sources(); }
 	uint num_sinks() override { return _sink_fifos.num_sinks(); }
+	void set_sink_unit(uint sink_index, Units::UnitBase* unit) override { _sink_fifos.set_sink_unit(sink_index, unit); }
 
 	bool is_read_valid(uint sink_index) override { return _sink_fifos.is_read_valid(sink_index); }
 	const T& peek(uint sink_index) override { return _sink_fifos.peek(sink_index); }
 	const T read(uint sink_index) override { return _sink_fifos.read(sink_index); }
+	void pop(uint sink_index) override { _sink_fifos.pop(sink_index); }
 
 	bool is_write_valid(uint source_index) override { return _source_fifos.is_write_valid(source_index); }
 	void write(const T& transaction, uint source_index) override { _source_fifos.write(transaction, source_index); }
+	void write(T&& transaction, uint source_index) override { _source_fifos.write(std::move(transaction), source_index); }
 };
 
-template<typename T>
+template<typename T, typename ROUTER, typename ARBITER = RoundRobinArbiter>
 class CrossBar : public InterconnectionNetwork<T>
 {
 private:
 	FIFOArray<T> _source_fifos;
-	std::vector<RoundRobinArbiter> _arbiters;
+	ROUTER _router;
+	std::vector<ARBITER> _arbiters;
 	FIFOArray<T> _sink_fifos;
 
 public:
-	CrossBar(uint sources, uint sinks) : _source_fifos(sources), _arbiters(sinks, sources), _sink_fifos(sinks) {}
-	
-	virtual uint get_sink(const T& transaction) = 0;
+	CrossBar(uint sources, uint sinks, const ROUTER& router = ROUTER()) : _source_fifos(sources), _router(router), _arbiters(sinks, sources), _sink_fifos(sinks) {}
 
 	void clock()
 	{
-		for(uint source_index = 0; source_index < _source_fifos.num_sinks(); ++source_index)
+		_source_fifos.clock();
+		_source_fifos.for_each_occupied([&](uint source_index)
 		{
-			if(!_source_fifos.is_read_valid(source_index)) continue;
-
-			uint sink_index = get_sink(_source_fifos.peek(source_index), source_index);
+			uint sink_index = _router.get_sink(_source_fifos.peek(source_index));
+			assert(sink_index < _sink_fifos.num_sinks());
 			_arbiters[sink_index].add(source_index);
-		}
+		});
 
+		NetworkLog* log = _source_fifos.log();
 		for(uint sink_index = 0; sink_index < _sink_fifos.num_sinks(); ++sink_index)
 		{
-			if(!_sink_fifos.is_write_valid(sink_index) || _arbiters[sink_index].num_pending() == 0) continue;
+			if(_arbiters[sink_index].num_pending() == 0) continue;
+			if(!_sink_fifos.is_write_valid(sink_index))
+			{
+				if(log) log->log_sink_blocked();
+				continue;
+			}
+
+			if(log) log->log_conflicts(_arbiters[sink_index].num_pending() - 1);
 
 			uint source_index = _arbiters[sink_index].get_index();
-			_sink_fifos.write(_source_fifos.read(source_index), sink_index);
-			_arbiters.remove(source_index);
+			_sink_fifos.write(std::move(_source_fifos.front(source_index)), sink_index);
+			_source_fifos.pop(source_index);
+			_arbiters[sink_index].remove(source_index);
 		}
 	}
 
+	bool is_idle() override { return !_source_fifos.is_occupied(); }
+	void enable_log() override { _source_fifos.enable_log(); }
+	NetworkLog* log() override { return _source_fifos.log(); }
+	void serialize(Checkpoint& checkpoint) override { checkpoint(_source_fifos, _arbiters, _sink_fifos); }
+
 	uint num_sources() override { return _source_fifos.num_sources(); }
 	uint num_sinks() override { return _sink_fifos.num_sinks(); }
+	void set_sink_unit(uint sink_index, Units::UnitBase* unit) override { _sink_fifos.set_sink_unit(sink_index, unit); }
 
 	bool is_read_valid(uint sink_index) override { return _sink_fifos.is_read_valid(sink_index); }
 	const T& peek(uint sink_index) override { return _sink_fifos.peek(sink_index); }
 	const T read(uint sink_index) override { return _sink_fifos.read(sink_index); }
+	void pop(uint sink_index) override { _sink_fifos.pop(sink_index); }
 
 	bool is_write_valid(uint source_index) override { return _source_fifos.is_write_valid(source_index); }
 	void write(const T& transaction, uint source_index) override { _source_fifos.write(transaction, source_index); }
+	void write(T&& transaction, uint source_index) override { _source_fifos.write(std::move(transaction), source_index); }
 };
 
-template<typename T>
+template<typename T, typename ROUTER, typename ARBITER = RoundRobinArbiter>
 class CasscadedCrossBar : public InterconnectionNetwork<T>
 {
 private:
 	FIFOArray<T> _source_fifos;
+	ROUTER _router;
 	size_t                         _input_cascade_ratio;
-	std::vector<RoundRobinArbiter> _cascade_arbiters;
-	std::vector<RoundRobinArbiter> _crossbar_arbiters;
+	std::vector<ARBITER> _cascade_arbiters;
+	std::vector<ARBITER> _crossbar_arbiters;
 	size_t                         _output_cascade_ratio;
 	FIFOArray<T> _sink_fifos;
 
+	//A lane that takes more than one clock to move a transaction holds it until its last flit is through
+	struct Lane
+	{
+		T transaction;
+		uint sink_index;
+		uint flits{0}; //clocks left on the lane. 0 if the lane is free
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(transaction, sink_index, flits); }
+	};
+
+	uint _link_bytes;
+	std::vector<Lane> _lanes;
+	uint _busy_lanes{0};
+
+	void _clock_lanes(NetworkLog* log)
+	{
+		for(Lane& lane : _lanes)
+		{
+			if(lane.flits == 0 || --lane.flits > 0) continue;
+			if(!_sink_fifos.is_write_valid(lane.sink_index))
+			{
+				if(log) log->log_sink_blocked();
+				lane.flits = 1;
+				continue;
+			}
+
+			_sink_fifos.write(std::move(lane.transaction), lane.sink_index);
+			_busy_lanes--;
+		}
+	}
+
 public:
-	CasscadedCrossBar(uint sources, uint sinks, uint crossbar_width) :
+	//Each lane moves link_bytes per clock. 0 moves any transaction in one clock
+	CasscadedCrossBar(uint sources, uint sinks, uint crossbar_width, const ROUTER& router = ROUTER(), uint link_bytes = 0) :
 		_source_fifos(sources), 
+		_router(router),
 		_input_cascade_ratio(std::max(sources / crossbar_width, 1u)),
 		_cascade_arbiters(crossbar_width, _input_cascade_ratio),
 		_crossbar_arbiters(crossbar_width, crossbar_width),
 		_output_cascade_ratio(std::max(sinks / crossbar_width, 1u)),
-		_sink_fifos(sinks) 
+		_sink_fifos(sinks),
+		_link_bytes(link_bytes),
+		_lanes(crossbar_width)
 	{}
 
-	virtual uint get_sink(const T& transaction) = 0;
-
 	void clock()
 	{
-		for(uint source_index = 0; source_index < _source_fifos.num_sinks(); ++source_index)
+		_source_fifos.clock();
+		_source_fifos.for_each_occupied([&](uint source_index)
 		{
-			if(!_source_fifos.is_read_valid(source_index)) continue;
-
 			uint cascade_index = source_index / _input_cascade_ratio;
 			uint cascade_source_index = source_index % _input_cascade_ratio;
 
 			_cascade_arbiters[cascade_index].add(cascade_source_index);
-		}
+		});
 
+		NetworkLog* log = _source_fifos.log();
 		for(uint cascade_index = 0; cascade_index < _cascade_arbiters.size(); ++cascade_index)
 		{
 			if(!_cascade_arbiters[cascade_index].num_pending()) continue;
+			if(log) log->log_conflicts(_cascade_arbiters[cascade_index].num_pending() - 1);
 
 			uint cascade_source_index = _cascade_arbiters[cascade_index].get_index();
 			uint source_index = cascade_index * _input_cascade_ratio + cascade_source_index;
-			uint sink_index = get_sink(_source_fifos.peek(source_index));
+			uint sink_index = _router.get_sink(_source_fifos.peek(source_index));
+			assert(sink_index < _sink_fifos.num_sinks());
 			uint crossbar_index = sink_index / _output_cascade_ratio;
 
 			_crossbar_arbiters[crossbar_index].add(cascade_index);
@@ -459,31 +1035,71 @@ public:
 
 		for(uint crossbar_index = 0; crossbar_index < _crossbar_arbiters.size(); ++crossbar_index)
 		{
-			if(!_crossbar_arbiters[crossbar_index].num_pending()) continue;
+			if(!_crossbar_arbiters[crossbar_index].num_pending() || _lanes[crossbar_index].flits) continue;
 
 			uint cascade_index = _crossbar_arbiters[crossbar_index].get_index();
 			uint cascade_source_index = _cascade_arbiters[cascade_index].get_index();
 			uint source_index = cascade_index * _input_cascade_ratio + cascade_source_index;
 
-			if(!_sink_fifos.is_write_valid(crossbar_index)) continue;
+			T& transaction = _source_fifos.front(source_index);
+			uint sink_index = _router.get_sink(transaction);
+			uint flits = link_flits(transaction, _link_bytes);
+			if(flits == 1 && !_sink_fifos.is_write_valid(sink_index))
+			{
+				if(log) log->log_sink_blocked();
+				continue;
+			}
 
-			uint sink_index = get_sink(_source_fifos.peek(source_index));
+			if(log)
+			{
+				log->log_conflicts(_crossbar_arbiters[crossbar_index].num_pending() - 1);
+				log->log_link(crossbar_index, flits, payload_bytes(transaction));
+			}
 
 			_crossbar_arbiters[crossbar_index].remove(cascade_index);
 			_cascade_arbiters[cascade_index].remove(cascade_source_index);
-			_sink_fifos.write(_source_fifos.read(source_index), sink_index);
+			if(flits == 1)
+			{
+				_sink_fifos.write(std::move(transaction), sink_index);
+			}
+			else
+			{
+				//the lane is busy for this clock and the next flits - 1 and the transaction arrives with its last flit
+				Lane& lane = _lanes[crossbar_index];
+				lane.transaction = std::move(transaction);
+				lane.sink_index = sink_index;
+				lane.flits = flits;
+				_busy_lanes++;
+			}
+			_source_fifos.pop(source_index);
 		}
+
+		if(_busy_lanes) _clock_lanes(log);
 	}
 
+	bool is_idle() override { return !_source_fifos.is_occupied() && _busy_lanes == 0; }
+	void serialize(Checkpoint& checkpoint) override { checkpoint(_source_fifos, _cascade_arbiters, _crossbar_arbiters, _lanes, _busy_lanes, _sink_fifos); }
+
+	void enable_log() override
+	{
+		_source_fifos.enable_log();
+		_source_fifos.log()->_links.resize(_lanes.size());
+	}
+
+	NetworkLog* log() override { return _source_fifos.log(); }
+
 	uint num_sources() override { return _source_fifos.num_sources(); }
 	uint num_sinks() override { return _sink_fifos.num_sinks(); }
+	void set_sink_unit(uint sink_index, Units::UnitBase* unit) override { _sink_fifos.set_sink_unit(sink_index, unit); }
 
 	bool is_read_valid(uint sink_index) override { return _sink_fifos.is_read_valid(sink_index); }
 	const T& peek(uint sink_index) override { return _sink_fifos.peek(sink_index); }
 	const T read(uint sink_index) override { return _sink_fifos.read(sink_index); }
+	void pop(uint sink_index) override { _sink_fifos.pop(sink_index); }
 
 	bool is_write_valid(uint source_index) override { return _source_fifos.is_write_valid(source_index); }
 	void write(const T& transaction, uint source_index) override { _source_fifos.write(transaction, source_index); }
+	void write(T&& transaction, uint source_index) override { _source_fifos.write(std::move(transaction), source_index); }
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,313 @@
+#pragma once
+#include "../stdafx.hpp"
+
+#include "interconnects.hpp"
+
+namespace Arches {
+
+struct NetworkConfiguration
+{
+	enum class Topology : uint8_t
+	{
+		CROSSBAR,
+		RING,
+		MESH,
+	};
+
+	Topology topology{Topology::CROSSBAR};
+	uint hop_latency{1}; //cycles a transaction spends on each link between routers. At least 1
+	uint link_bytes{0}; //bytes a link moves per clock so a transaction keeps it busy for ceil(payload / link_bytes) clocks. 0 moves any transaction in one clock
+	uint buffer_depth{4}; //transactions a router buffers per incoming link. Includes the ones still on the link so it is also the number of credits
+};
+
+//Routers on a bidirectional ring. Link 0 goes to the next router and link 1 to the previous one. Transactions take the shorter way round.
+//Each direction is its own ring so injecting needs room for two, which always leaves a bubble for the transactions already on the ring and keeps it from deadlocking
+struct RingTopology
+{
+	static constexpr uint NUM_LINKS = 2;
+	static constexpr uint INJECTION_CREDITS = 2;
+
+	uint num_routers;
+
+	RingTopology(uint num_routers) : num_routers(num_routers) {}
+
+	uint neighbor(uint router, uint link) const
+	{
+		return link == 0 ? (router + 1) % num_routers : (router + num_routers - 1) % num_routers;
+	}
+
+	//NUM_LINKS means the transaction has arrived
+	uint route(uint router, uint destination) const
+	{
+		uint distance = (destination + num_routers - router) % num_routers;
+		if(distance == 0) return NUM_LINKS;
+		return distance <= num_routers / 2 ? 0 : 1;
+	}
+};
+
+//Routers on a 2D mesh as close to square as the router count divides into. Links 0 to 3 go +x, -x, +y and -y.
+//Dimension order routing (x then y) can't form a cycle of waiting links so the mesh needs no bubble
+struct MeshTopology
+{
+	static constexpr uint NUM_LINKS = 4;
+	static constexpr uint INJECTION_CREDITS = 1;
+
+	uint width;
+	uint height;
+
+	MeshTopology(uint num_routers)
+	{
+		height = 1;
+		for(uint h = 1; h * h <= num_routers; ++h)
+			if(num_routers % h == 0) height = h;
+		width = num_routers / height;
+	}
+
+	uint neighbor(uint router, uint link) const
+	{
+		switch(link)
+		{
+		case 0: return router + 1;
+		case 1: return router - 1;
+		case 2: return router + width;
+		default: return router - width;
+		}
+	}
+
+	uint route(uint router, uint destination) const
+	{
+		uint x = router % width, y = router / width;
+		uint destination_x = destination % width, destination_y = destination / width;
+		if(x < destination_x) return 0;
+		if(x > destination_x) return 1;
+		if(y < destination_y) return 2;
+		if(y > destination_y) return 3;
+		return NUM_LINKS;
+	}
+};
+
+//Router based network on chip. Sources and sinks are spread evenly over the routers in index order so port p of a request network and port p of the matching
+//return network sit on the same router. Each router forwards the transactions waiting on its incoming links before injecting new ones, rotating which link goes first.
+//Transactions only move between routers when the next router has buffer space for them. Every output port of a router, links and ejection, sends one transaction at
+//a time and stays busy for as many clocks as the transaction has flits. The transaction is ready at the next router once its last flit has crossed the link.
+template<typename T, typename ROUTER, typename TOPOLOGY>
+class PacketNetwork : public InterconnectionNetwork<T>
+{
+private:
+	static constexpr uint NUM_LINKS = TOPOLOGY::NUM_LINKS;
+	static constexpr uint EJECT = TOPOLOGY::NUM_LINKS;
+
+	struct Packet
+	{
+		T transaction;
+		cycles_t ready_clock; //clock it reaches the end of the link
+		uint sink_index;
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(transaction, ready_clock, sink_index); }
+	};
+
+	FIFOArray<T> _source_fifos;
+	ROUTER _router;
+	TOPOLOGY _topology;
+	uint _num_routers;
+	uint _hop_latency;
+	uint _link_bytes;
+	uint _buffer_depth;
+
+	std::vector<uint> _source_begin; //sources [_source_begin[r], _source_begin[r + 1]) inject at router r
+	std::vector<RingBuffer<Packet>> _buffers; //router * NUM_LINKS + link. Transactions that came in over that link
+	std::vector<cycles_t> _port_free_clock; //router * (NUM_LINKS + 1) + output port. First clock the port can send again
+	std::vector<uint> _next_source;
+	std::vector<uint8_t> _next_link;
+	cycles_t _clock{0};
+	uint64_t _in_flight{0};
+
+	FIFOArray<T> _sink_fifos;
+
+	uint _sink_router(uint sink_index)
+	{
+		return (uint64_t)sink_index * _num_routers / _sink_fifos.num_sinks();
+	}
+
+	//Moves the transaction on if it can go. It is left alone otherwise
+	bool _forward(uint router, T& transaction, uint sink_index, bool injecting, NetworkLog* log)
+	{
+		uint link = _topology.route(router, _sink_router(sink_index));
+		uint port_index = router * (NUM_LINKS + 1) + link;
+		if(_port_free_clock[port_index] > _clock)
+		{
+			if(log) log->log_conflicts(1);
+			return false;
+		}
+
+		uint flits = link_flits(transaction, _link_bytes);
+		uint bytes = payload_bytes(transaction);
+
+		if(link == EJECT)
+		{
+			if(!_sink_fifos.is_write_valid(sink_index))
+			{
+				if(log) log->log_sink_blocked();
+				return false;
+			}
+
+			_sink_fifos.write(std::move(transaction), sink_index);
+			if(!injecting) _in_flight--;
+		}
+		else
+		{
+			RingBuffer<Packet>& next = _buffers[_topology.neighbor(router, link) * NUM_LINKS + link];
+			if(next.size() + (injecting ? TOPOLOGY::INJECTION_CREDITS : 1) > _buffer_depth)
+			{
+				if(log) log->log_sink_blocked();
+				return false;
+			}
+
+			Packet& packet = next.push();
+			packet.transaction = std::move(transaction);
+			packet.ready_clock = _clock + _hop_latency + flits - 1;
+			packet.sink_index = sink_index;
+			if(injecting) _in_flight++;
+		}
+
+		_port_free_clock[port_index] = _clock + flits;
+		if(log) log->log_link(port_index, flits, bytes);
+		return true;
+	}
+
+	//One transaction per router per clock from the sources on it
+	void _inject(uint router, NetworkLog* log)
+	{
+		uint begin = _source_begin[router];
+		uint count = _source_begin[router + 1] - begin;
+		for(uint i = 0; i < count; ++i)
+		{
+			uint source_index = begin + (_next_source[router] + i) % count;
+			if(!_source_fifos.is_read_valid(source_index)) continue;
+
+			T& transaction = _source_fifos.front(source_index);
+			uint sink_index = _router.get_sink(transaction);
+			assert(sink_index < _sink_fifos.num_sinks());
+			if(!_forward(router, transaction, sink_index, true, log)) continue;
+
+			_source_fifos.pop(source_index);
+			_next_source[router] = (source_index - begin + 1) % count;
+			return;
+		}
+	}
+
+public:
+	PacketNetwork(uint sources, uint sinks, uint num_routers, const NetworkConfiguration& config, const ROUTER& router = ROUTER()) :
+		_source_fifos(sources),
+		_router(router),
+		_topology(num_routers),
+		_num_routers(num_routers),
+		_hop_latency(std::max(config.hop_latency, 1u)),
+		_link_bytes(config.link_bytes),
+		_buffer_depth(std::max(config.buffer_depth, TOPOLOGY::INJECTION_CREDITS)),
+		_source_begin(num_routers + 1),
+		_buffers(num_routers * NUM_LINKS, RingBuffer<Packet>(_buffer_depth)),
+		_port_free_clock(num_routers * (NUM_LINKS + 1), 0),
+		_next_source(num_routers, 0),
+		_next_link(num_routers, 0),
+		_sink_fifos(sinks)
+	{
+		//source s is on router s * num_routers / sources so router r starts at the first source that maps to it
+		for(uint router = 0; router <= num_routers; ++router)
+			_source_begin[router] = ((uint64_t)router * sources + num_routers - 1) / num_routers;
+	}
+
+	void clock()
+	{
+		_source_fifos.clock();
+		_clock++;
+		if(_in_flight == 0 && !_source_fifos.is_occupied()) return;
+
+		NetworkLog* log = _source_fifos.log();
+		for(uint router = 0; router < _num_routers; ++router)
+		{
+			for(uint i = 0; i < NUM_LINKS; ++i)
+			{
+				RingBuffer<Packet>& buffer = _buffers[router * NUM_LINKS + (_next_link[router] + i) % NUM_LINKS];
+				if(buffer.empty() || buffer.front().ready_clock > _clock) continue;
+				if(_forward(router, buffer.front().transaction, buffer.front().sink_index, false, log)) buffer.pop();
+			}
+			_next_link[router] = (_next_link[router] + 1) % NUM_LINKS;
+
+			_inject(router, log);
+		}
+	}
+
+	bool is_idle() override { return _in_flight == 0 && !_source_fifos.is_occupied(); }
+	void serialize(Checkpoint& checkpoint) override { checkpoint(_source_fifos, _buffers, _port_free_clock, _next_source, _next_link, _clock, _in_flight, _sink_fifos); }
+
+	void enable_log() override
+	{
+		_source_fifos.enable_log();
+		_source_fifos.log()->_links.resize(_port_free_clock.size());
+	}
+
+	NetworkLog* log() override { return _source_fifos.log(); }
+
+	uint num_sources() override { return _source_fifos.num_sources(); }
+	uint num_sinks() override { return _sink_fifos.num_sinks(); }
+	void set_sink_unit(uint sink_index, Units::UnitBase* unit) override { _sink_fifos.set_sink_unit(sink_index, unit); }
+
+	bool is_read_valid(uint sink_index) override { return _sink_fifos.is_read_valid(sink_index); }
+	const T& peek(uint sink_index) override { return _sink_fifos.peek(sink_index); }
+	const T read(uint sink_index) override { return _sink_fifos.read(sink_index); }
+	void pop(uint sink_index) override { _sink_fifos.pop(sink_index); }
+
+	bool is_write_valid(uint source_index) override { return _source_fifos.is_write_valid(source_index); }
+	void write(const T& transaction, uint source_index) override { _source_fifos.write(transaction, source_index); }
+	void write(T&& transaction, uint source_index) override { _source_fifos.write(std::move(transaction), source_index); }
+};
+
+template<typename T, typename ROUTER>
+using RingNetwork = PacketNetwork<T, ROUTER, RingTopology>;
+
+template<typename T, typename ROUTER>
+using MeshNetwork = PacketNetwork<T, ROUTER, MeshTopology>;
+
+//Picks the topology from a configuration at construction so units can switch between them without changing type. The crossbar is a member called
+//directly so the default keeps its inlined fast path. The routers of a network on chip stand where the crossbar lanes would be.
+template<typename T, typename ROUTER>
+class TopologyNetwork : public InterconnectionNetwork<T>
+{
+private:
+	CasscadedCrossBar<T, ROUTER> _crossbar;
+	InterconnectionNetwork<T>* _noc{nullptr};
+
+	static bool _is_crossbar(const NetworkConfiguration& config) { return config.topology == NetworkConfiguration::Topology::CROSSBAR; }
+
+public:
+	TopologyNetwork(uint sources, uint sinks, uint crossbar_width, const NetworkConfiguration& config, const ROUTER& router = ROUTER()) :
+		_crossbar(_is_crossbar(config) ? sources : 0, _is_crossbar(config) ? sinks : 0, crossbar_width, router, config.link_bytes)
+	{
+		if(config.topology == NetworkConfiguration::Topology::RING) _noc = new RingNetwork<T, ROUTER>(sources, sinks, crossbar_width, config, router);
+		if(config.topology == NetworkConfiguration::Topology::MESH) _noc = new MeshNetwork<T, ROUTER>(sources, sinks, crossbar_width, config, router);
+	}
+
+	~TopologyNetwork() { delete _noc; }
+
+	void clock() override { if(_noc) _noc->clock(); else _crossbar.clock(); }
+	bool is_idle() override { return _noc ? _noc->is_idle() : _crossbar.is_idle(); }
+	void enable_log() override { if(_noc) _noc->enable_log(); else _crossbar.enable_log(); }
+	NetworkLog* log() override { return _noc ? _noc->log() : _crossbar.log(); }
+	void serialize(Checkpoint& checkpoint) override { if(_noc) _noc->serialize(checkpoint); else _crossbar.serialize(checkpoint); }
+
+	uint num_sources() override { return _noc ? _noc->num_sources() : _crossbar.num_sources(); }
+	uint num_sinks() override { return _noc ? _noc->num_sinks() : _crossbar.num_sinks(); }
+	void set_sink_unit(uint sink_index, Units::UnitBase* unit) override { if(_noc) _noc->set_sink_unit(sink_index, unit); else _crossbar.set_sink_unit(sink_index, unit); }
+
+	bool is_read_valid(uint sink_index) override { return _noc ? _noc->is_read_valid(sink_index) : _crossbar.is_read_valid(sink_index); }
+	const T& peek(uint sink_index) override { return _noc ? _noc->peek(sink_index) : _crossbar.peek(sink_index); }
+	const T read(uint sink_index) override { return _noc ? _noc->read(sink_index) : _crossbar.read(sink_index); }
+	void pop(uint sink_index) override { if(_noc) _noc->pop(sink_index); else _crossbar.pop(sink_index); }
+
+	bool is_write_valid(uint source_index) override { return _noc ? _noc->is_write_valid(source_index) : _crossbar.is_write_valid(source_index); }
+	void write(const T& transaction, uint source_index) override { if(_noc) _noc->write(transaction, source_index); else _crossbar.write(transaction, source_index); }
+	void write(T&& transaction, uint source_index) override { if(_noc) _noc->write(std::move(transaction), source_index); else _crossbar.write(std::move(transaction), source_index); }
+};
+
+}
@@ -1,15 +1,52 @@
 #include "simulator.hpp"
 
+#include "interconnects.hpp"
 #include "../units/unit-base.hpp"
+#include "../units/unit-quantum-bridge.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#ifdef BUILD_PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <cxxabi.h>
+#endif
+
+#include <typeinfo>
 
 namespace Arches {
 
-void Simulator::register_unit(Units::UnitBase * unit)
+thread_local Simulator::ClockContext Simulator::_clock_context;
+
+void Simulator::_register_unit(Units::UnitBase* unit, std::type_index type, decltype(Batch::clock_rise) clock_rise, decltype(Batch::clock_fall) clock_fall)
 {
-	unit->unit_id = _units.size();
-	_units.push_back(unit);
-	_unit_groups.back().end++;
+	UnitGroup& group = _unit_groups.back();
+
+	uint batch_index = 0;
+	while(batch_index < group.batches.size() && group.batches[batch_index].type != type) batch_index++;
+	if(batch_index == group.batches.size()) group.batches.push_back({type, group.end, group.end, clock_rise, clock_fall});
+
+	//the unit goes on the end of its batch so the batches after it in the group shift down by one
+	uint index = group.batches[batch_index].end;
+	_units.insert(_units.begin() + index, unit);
+	_clock_fall_pending.insert(_clock_fall_pending.begin() + index, false);
+	_unit_profiles.insert(_unit_profiles.begin() + index, UnitProfile());
+
+	group.batches[batch_index].end++;
+	for(uint i = batch_index + 1; i < group.batches.size(); ++i)
+	{
+		group.batches[i].start++;
+		group.batches[i].end++;
+	}
+	group.end++;
+
+	for(uint i = index; i < _units.size(); ++i)
+		_units[i]->unit_id = i;
+
 	unit->simulator = this;
+	unit->group_index = static_cast<uint>(_unit_groups.size() - 1);
 }
 
 void Simulator::new_unit_group()
@@ -17,6 +54,11 @@ void Simulator::new_unit_group()
 	_unit_groups.emplace_back(static_cast<uint>(_units.size()), static_cast<uint>(_units.size()));
 }
 
+void Simulator::register_quantum_bridge(Units::QuantumBridge* bridge)
+{
+	_quantum_bridges.push_back(bridge);
+}
+
 #ifndef _DEBUG
 #define USE_TBB
 #endif
@@ -27,35 +69,608 @@ void Simulator::new_unit_group()
 //#define UNIT_LOOP_END }});
 
 //custom block ranges
-#define UNIT_LOOP tbb::parallel_for(tbb::blocked_range<uint>(0, _unit_groups.size(), 1), [&](tbb::blocked_range<uint> r) { for(uint i = _unit_groups[r.begin()].start; i < _unit_groups[r.begin()].end; ++i) {
-#define UNIT_LOOP_END }});
+#define PARTITION_LOOP tbb::parallel_for(tbb::blocked_range<uint>(0, _partitions.size(), 1), [&](tbb::blocked_range<uint> r) { for(uint i = r.begin(); i < r.end(); ++i) {
+#define PARTITION_LOOP_END }});
 #else
-#define UNIT_LOOP for(uint i = 0; i < _units.size(); ++i) {
-#define UNIT_LOOP_END }
+#define PARTITION_LOOP for(uint i = 0; i < _partitions.size(); ++i) {
+#define PARTITION_LOOP_END }
 #endif
 
+void Simulator::_clock_rise(UnitGroup& group, cycles_t cycle)
+{
+	uint64_t start = _measuring_cost ? __rdtsc() : 0;
+	group.current_cycle = cycle;
+	group.profiling = profile_interval && group.clocks++ % profile_interval == 0;
+
+	_clock_context = {static_cast<uint>(&group - _unit_groups.data()), Phase::RISE, _quantum <= 1, cycle};
+	for(const Batch& batch : group.batches)
+		batch.clock_rise(*this, group, batch, cycle);
+	_clock_context = {};
+
+	if(_measuring_cost) group.cost += __rdtsc() - start;
+}
+
+void Simulator::_clock_fall(UnitGroup& group)
+{
+	uint64_t start = _measuring_cost ? __rdtsc() : 0;
+
+	bool active = false;
+	_clock_context = {static_cast<uint>(&group - _unit_groups.data()), Phase::FALL, _quantum <= 1, group.current_cycle};
+	for(const Batch& batch : group.batches)
+		if(batch.clock_fall(*this, group, batch)) active = true;
+	_clock_context = {};
+	group.active = active;
+
+	if(_measuring_cost) group.cost += __rdtsc() - start;
+}
+
+void Simulator::_clock_rise(const std::vector<uint>& partition, cycles_t cycle)
+{
+	for(uint group_index : partition)
+		_clock_rise(_unit_groups[group_index], cycle);
+}
+
+void Simulator::_clock_fall(const std::vector<uint>& partition)
+{
+	for(uint group_index : partition)
+		_clock_fall(_unit_groups[group_index]);
+}
+
 void Simulator::_clock_rise()
 {
-	UNIT_LOOP
-		_units[i]->clock_rise();
-	UNIT_LOOP_END
+	PARTITION_LOOP
+		_clock_rise(_partitions[i], current_cycle);
+	PARTITION_LOOP_END
 }
 
 void Simulator::_clock_fall()
 {
-	UNIT_LOOP
-		_units[i]->clock_fall();
-	UNIT_LOOP_END
+	PARTITION_LOOP
+		_clock_fall(_partitions[i]);
+	PARTITION_LOOP_END
 }
 
-void Simulator::execute()
+void Simulator::_partition_by_cost(uint num_partitions)
 {
-	while(units_executing > 0)
+	//longest processing time first. Each group goes to the partition with the lowest cost so far
+	std::vector<uint> group_indices(_unit_groups.size());
+	for(uint i = 0; i < group_indices.size(); ++i) group_indices[i] = i;
+	std::stable_sort(group_indices.begin(), group_indices.end(), [&](uint a, uint b) { return _unit_groups[a].cost > _unit_groups[b].cost; });
+
+	std::vector<uint64_t> partition_costs(num_partitions, 0);
+	_partitions.assign(num_partitions, {});
+	for(uint group_index : group_indices)
+	{
+		uint partition_index = std::min_element(partition_costs.begin(), partition_costs.end()) - partition_costs.begin();
+		_partitions[partition_index].push_back(group_index);
+		partition_costs[partition_index] += std::max<uint64_t>(_unit_groups[group_index].cost, 1); //so groups we didn't see are still spread out
+	}
+
+	//keep groups in registration order within a partition
+	for(std::vector<uint>& partition : _partitions)
+		std::sort(partition.begin(), partition.end());
+}
+
+void Simulator::_balance(uint num_partitions)
+{
+	//measure the clock cost of each group over a window then repartition
+	if(!_measuring_cost)
+	{
+		if(current_cycle < _balance_cycle) return;
+
+		for(UnitGroup& group : _unit_groups) group.cost = 0;
+		_measuring_cost = true;
+		_balance_cycle = current_cycle + BALANCE_WINDOW;
+	}
+	else if(current_cycle >= _balance_cycle)
+	{
+		_measuring_cost = false;
+		_partition_by_cost(num_partitions);
+		_balance_cycle = current_cycle + BALANCE_INTERVAL;
+	}
+}
+
+cycles_t Simulator::_next_wake_cycle()
+{
+	for(UnitGroup& group : _unit_groups)
+		if(group.active) return current_cycle;
+
+	//every unit is asleep so nothing can happen until the earliest wake cycle
+	cycles_t next_wake_cycle = INT64_MAX;
+	for(Units::UnitBase* unit : _units)
+		next_wake_cycle = std::min(next_wake_cycle, unit->wake_cycle());
+
+	if(next_wake_cycle == INT64_MAX) return current_cycle;
+	return std::max(next_wake_cycle, current_cycle);
+}
+
+cycles_t Simulator::_next_wake_cycle(const std::vector<uint>& partition, cycles_t cycle)
+{
+	for(uint group_index : partition)
+		if(_unit_groups[group_index].active) return cycle;
+
+	//only a bridge exchange can wake units from outside the partition so we can skip to the earliest wake cycle in the partition
+	cycles_t next_wake_cycle = INT64_MAX;
+	for(uint group_index : partition)
+		for(uint i = _unit_groups[group_index].start; i < _unit_groups[group_index].end; ++i)
+			next_wake_cycle = std::min(next_wake_cycle, _units[i]->wake_cycle());
+
+	return std::max(next_wake_cycle, cycle);
+}
+
+void Simulator::_run_quantum(const std::vector<uint>& partition, cycles_t end_cycle)
+{
+	cycles_t cycle = current_cycle;
+	while(cycle < end_cycle)
+	{
+		_clock_rise(partition, cycle);
+		_clock_fall(partition);
+		cycle = _next_wake_cycle(partition, cycle + 1);
+	}
+}
+
+bool Simulator::_end_quantum()
+{
+	current_cycle += _quantum;
+	_publish_progress();
+
+	bool quiet = true;
+	for(Units::QuantumBridge* bridge : _quantum_bridges)
+		if(bridge->exchange()) quiet = false;
+
+	//units behind a bridge can still be working on what it delivered last quantum so only stop after two quiet exchanges
+	_quiet_quanta = quiet ? _quiet_quanta + 1 : 0;
+	return (units_executing == 0 && _quiet_quanta >= 2) || current_cycle >= _end_cycle || (draining && _is_drained());
+}
+
+//Lockstep runs end once every program has halted, at the end cycle or, while draining, once everything in flight has landed
+bool Simulator::_is_done()
+{
+	return units_executing == 0 || current_cycle >= _end_cycle || (draining && _is_drained());
+}
+
+static void pin_thread(uint thread_id)
+{
+	uint core = thread_id % std::max(std::thread::hardware_concurrency(), 1u);
+#ifdef BUILD_PLATFORM_WINDOWS
+	SetThreadAffinityMask(GetCurrentThread(), 0x1ull << core);
+#else
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(core, &cpu_set);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#endif
+}
+
+void Simulator::_thread_work(uint thread_id)
+{
+	pin_thread(thread_id);
+
+	uint64_t iterations = 0;
+	while(!_done)
+	{
+		//the last thread to arrive runs the completion so its time is counted as waiting too
+		bool profiling = profile_interval && iterations++ % profile_interval == 0;
+		uint64_t barrier_start = 0;
+
+		if(_quantum > 1)
+		{
+			_run_quantum(_partitions[thread_id], current_cycle + _quantum);
+
+			if(profiling) barrier_start = __rdtsc();
+			_barrier->arrive_and_wait([&]()
+			{
+				_done = _end_quantum();
+				_balance(static_cast<uint>(_partitions.size()));
+			});
+			if(profiling) _barrier_ticks[thread_id] += __rdtsc() - barrier_start;
+			continue;
+		}
+
+		_clock_rise(_partitions[thread_id], current_cycle);
+
+		if(profiling) barrier_start = __rdtsc();
+		_barrier->arrive_and_wait();
+		if(profiling) _barrier_ticks[thread_id] += __rdtsc() - barrier_start;
+
+		_clock_fall(_partitions[thread_id]);
+
+		if(profiling) barrier_start = __rdtsc();
+		_barrier->arrive_and_wait([&]()
+		{
+			current_cycle++;
+			current_cycle = std::min(_next_wake_cycle(), _end_cycle);
+			_publish_progress();
+			_balance(static_cast<uint>(_partitions.size()));
+			_done = _is_done();
+		});
+		if(profiling) _barrier_ticks[thread_id] += __rdtsc() - barrier_start;
+	}
+}
+
+void Simulator::_execute_thread_pool(uint num_threads)
+{
+	//each thread clocks one partition. Start with contiguous blocks of groups until we have measured their cost
+	_partitions.assign(num_threads, {});
+	for(uint group_index = 0; group_index < _unit_groups.size(); ++group_index)
+		_partitions[group_index * num_threads / _unit_groups.size()].push_back(group_index);
+
+	//spinning only helps if every thread has a core to itself
+	SpinBarrier barrier(num_threads, num_threads <= std::thread::hardware_concurrency() ? 4096 : 0);
+	_barrier = &barrier;
+	if(_barrier_ticks.size() < num_threads) _barrier_ticks.resize(num_threads, 0);
+	_done = _is_done();
+
+	//the calling thread works as thread 0
+	std::vector<std::thread> thread_pool;
+	for(uint thread_id = 1; thread_id < num_threads; ++thread_id)
+		thread_pool.emplace_back(&Simulator::_thread_work, this, thread_id);
+
+	_thread_work(0);
+
+	for(std::thread& thread : thread_pool)
+		thread.join();
+
+	_barrier = nullptr;
+}
+
+void Simulator::_execute_parallel_for()
+{
+#ifdef USE_TBB
+	uint num_partitions = tbb::this_task_arena::max_concurrency();
+#else
+	uint num_partitions = 1;
+#endif
+
+	//one task per group until we have measured their cost
+	_partitions.assign(_unit_groups.size(), {});
+	for(uint group_index = 0; group_index < _unit_groups.size(); ++group_index)
+		_partitions[group_index].push_back(group_index);
+
+	_done = _is_done();
+	while(!_done)
 	{
+		if(_quantum > 1)
+		{
+			cycles_t end_cycle = current_cycle + _quantum;
+			PARTITION_LOOP
+				_run_quantum(_partitions[i], end_cycle);
+			PARTITION_LOOP_END
+			_done = _end_quantum();
+			_balance(num_partitions);
+			continue;
+		}
+
 		_clock_rise();
 		_clock_fall();
 		current_cycle++;
-		//if(current_cycle % 1024 == 0) printf("Cycle: %lld\r", current_cycle);
+		current_cycle = std::min(_next_wake_cycle(), _end_cycle);
+		_publish_progress();
+		_balance(num_partitions);
+		_done = _is_done();
+	}
+}
+
+static std::string format_duration(double seconds)
+{
+	uint64_t total = static_cast<uint64_t>(seconds);
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "%lldh%02lldm%02llds", total / 3600, total / 60 % 60, total % 60);
+	return buffer;
+}
+
+void Simulator::_publish_progress()
+{
+	if(current_cycle < _progress_publish_cycle) return;
+
+	_progress_publish_cycle = current_cycle + PROGRESS_PUBLISH_INTERVAL;
+	_progress_cycle.store(current_cycle, std::memory_order_relaxed);
+	_progress_instructions.store(_instructions_issued(), std::memory_order_relaxed);
+	if(_progress_work_completed) _progress_work.store(_progress_work_completed(), std::memory_order_relaxed);
+}
+
+void Simulator::_report_progress()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	auto last = start;
+	cycles_t last_cycle = _progress_cycle.load(std::memory_order_relaxed);
+	uint64_t last_instructions = _progress_instructions.load(std::memory_order_relaxed);
+	uint64_t start_work = _progress_work.load(std::memory_order_relaxed);
+
+	std::unique_lock<std::mutex> lock(_progress_mutex);
+	while(!_progress_condition.wait_for(lock, std::chrono::duration<double>(progress_interval), [&]() { return _progress_done; }))
+	{
+		//the snapshot can be up to PROGRESS_PUBLISH_INTERVAL cycles behind. It is only displayed so that is fine
+		auto now = std::chrono::high_resolution_clock::now();
+		double seconds = std::chrono::duration<double>(now - last).count();
+		cycles_t cycle = _progress_cycle.load(std::memory_order_relaxed);
+		uint64_t instructions = _progress_instructions.load(std::memory_order_relaxed);
+
+		printf("Progress: Cycle %lld | %.2f KHz | %.2f MIPS", cycle, (cycle - last_cycle) / seconds / 1000.0, (instructions - last_instructions) / seconds / 1000000.0);
+
+		if(_progress_work_completed)
+		{
+			uint64_t work = _progress_work.load(std::memory_order_relaxed);
+			if(_progress_work_total == 0) printf(" | %s: %lld", _progress_work_name.c_str(), work);
+			else
+			{
+				printf(" | %s: %lld/%lld(%.2f%%)", _progress_work_name.c_str(), work, _progress_work_total, 100.0 * work / _progress_work_total);
+
+				//extrapolate from the rate the work got done at since we started
+				double elapsed = std::chrono::duration<double>(now - start).count();
+				if(work > start_work) printf(" | ETA: %s", format_duration(elapsed * (_progress_work_total - std::min(work, _progress_work_total)) / (work - start_work)).c_str());
+			}
+		}
+
+		printf("\n");
+		fflush(stdout);
+
+		last = now;
+		last_cycle = cycle;
+		last_instructions = instructions;
+	}
+}
+
+void Simulator::_start_progress()
+{
+	if(progress_interval <= 0.0) return;
+
+	//the first snapshot is taken here so the reporter starts from where we are
+	_progress_publish_cycle = current_cycle;
+	_publish_progress();
+
+	_progress_done = false;
+	_progress_thread = std::thread(&Simulator::_report_progress, this);
+}
+
+void Simulator::_stop_progress()
+{
+	if(!_progress_thread.joinable()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(_progress_mutex);
+		_progress_done = true;
+	}
+	_progress_condition.notify_all();
+	_progress_thread.join();
+	_progress_publish_cycle = INT64_MAX;
+}
+
+void Simulator::execute(uint num_threads, cycles_t quantum, cycles_t end_cycle)
+{
+	_start_progress();
+	_execute(num_threads, quantum, end_cycle);
+	_stop_progress();
+}
+
+void Simulator::_execute(uint num_threads, cycles_t quantum, cycles_t end_cycle)
+{
+	_quantum = std::max<cycles_t>(quantum, 1);
+	_end_cycle = end_cycle;
+	_measuring_cost = false;
+	_balance_cycle = current_cycle;
+
+	if(log_networks) _enable_network_logs();
+
+	cycles_t start_cycle = current_cycle;
+	auto start = std::chrono::high_resolution_clock::now();
+	uint64_t start_ticks = __rdtsc();
+
+	if(num_threads == 0) _execute_parallel_for();
+	else                 _execute_thread_pool(num_threads);
+
+	auto stop = std::chrono::high_resolution_clock::now();
+	_execute_ticks += __rdtsc() - start_ticks;
+	_execute_seconds += std::chrono::duration<double>(stop - start).count();
+
+	//units that look at their group cycle after the run should see the final cycle
+	for(UnitGroup& group : _unit_groups)
+		group.current_cycle = current_cycle;
+	if(log_networks) _network_log_cycles += current_cycle - start_cycle;
+	double seconds = std::chrono::duration<double>(stop - start).count();
+	cycles_per_second = seconds > 0.0 ? (current_cycle - start_cycle) / seconds : 0.0;
+}
+
+uint64_t Simulator::_instructions_issued()
+{
+	uint64_t instructions = 0;
+	for(Units::UnitBase* unit : _units)
+		instructions += unit->instructions_issued();
+	return instructions;
+}
+
+uint64_t Simulator::_fast_forward(uint64_t num_instructions)
+{
+	std::vector<Units::UnitBase*> units = _units;
+	uint64_t executed = 0;
+	while(executed < num_instructions && !units.empty())
+	{
+		//one instruction per unit per round so threads progress at roughly the rate they would in detail
+		uint remaining = 0;
+		for(Units::UnitBase* unit : units)
+		{
+			if(!unit->step_functional()) continue;
+			units[remaining++] = unit;
+			executed++;
+		}
+		units.resize(remaining);
+	}
+
+	//everything has to be clocked again since units went to sleep while we drained
+	for(UnitGroup& group : _unit_groups) group.active = true;
+	for(Units::UnitBase* unit : _units) unit->wake();
+	_quiet_quanta = 0;
+
+	return executed;
+}
+
+bool Simulator::_is_drained()
+{
+	//no group clocked a fall so every unit went to sleep and nothing woke them. Bridges wake themselves on exchange so they only count once they are quiet
+	for(UnitGroup& group : _unit_groups)
+		if(group.active) return false;
+
+	for(Units::UnitBase* unit : _units)
+		if(unit->wake_cycle() != INT64_MAX) return false;
+
+	return _quantum_bridges.empty() || _quiet_quanta >= 2;
+}
+
+void Simulator::_drain(uint num_threads)
+{
+	//one run that stops itself once the machine is empty so the threads are only started once
+	draining = true;
+	_execute(num_threads, _quantum, INT64_MAX);
+	draining = false;
+}
+
+void Simulator::execute_sampled(uint num_threads, cycles_t quantum, uint64_t fast_forward_instructions, cycles_t warmup_cycles, cycles_t window_cycles)
+{
+	sampling_log.reset();
+	_quantum = std::max<cycles_t>(quantum, 1);
+	_start_progress();
+
+	uint64_t start_instructions = _instructions_issued();
+	while(units_executing > 0)
+	{
+		sampling_log._functional_instructions += _fast_forward(fast_forward_instructions);
+
+		_execute(num_threads, quantum, current_cycle + warmup_cycles);
+
+		cycles_t window_start_cycle = current_cycle;
+		uint64_t window_start_instructions = _instructions_issued();
+		_execute(num_threads, quantum, current_cycle + window_cycles);
+		sampling_log.log_sample(current_cycle - window_start_cycle, _instructions_issued() - window_start_instructions);
+
+		_drain(num_threads);
+	}
+	sampling_log._total_instructions = _instructions_issued() - start_instructions;
+	_stop_progress();
+}
+
+static std::string unit_type_name(Units::UnitBase* unit)
+{
+	const char* name = typeid(*unit).name();
+#ifdef BUILD_PLATFORM_WINDOWS
+	std::string type_name = name;
+#else
+	int status;
+	char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+	std::string type_name = status == 0 ? demangled : name;
+	free(demangled);
+#endif
+
+	//drop the class keyword and namespaces msvc puts in the name
+	size_t space = type_name.find(' ');
+	if(space != std::string::npos) type_name = type_name.substr(space + 1);
+	for(const char* prefix : {"Arches::Units::", "Arches::"})
+		if(type_name.rfind(prefix, 0) == 0) type_name = type_name.substr(strlen(prefix));
+	return type_name;
+}
+
+void Simulator::print_profile(FILE* stream)
+{
+	if(profile_interval == 0 || _execute_seconds <= 0.0) return;
+
+	struct Row
+	{
+		uint64_t num_units{0};
+		UnitProfile profile;
+	};
+
+	std::map<std::string, Row> rows;
+	for(uint i = 0; i < _units.size(); ++i)
+	{
+		Row& row = rows[unit_type_name(_units[i])];
+		row.num_units++;
+		row.profile.rise_ticks += _unit_profiles[i].rise_ticks;
+		row.profile.fall_ticks += _unit_profiles[i].fall_ticks;
+		row.profile.rises += _unit_profiles[i].rises;
+		row.profile.falls += _unit_profiles[i].falls;
+	}
+
+	std::vector<std::pair<std::string, Row>> ranked(rows.begin(), rows.end());
+	std::sort(ranked.begin(), ranked.end(), [](const std::pair<std::string, Row>& a, const std::pair<std::string, Row>& b)
+	{
+		return a.second.profile.rise_ticks + a.second.profile.fall_ticks > b.second.profile.rise_ticks + b.second.profile.fall_ticks;
+	});
+
+	uint64_t total_ticks = 0;
+	for(auto& row : ranked) total_ticks += row.second.profile.rise_ticks + row.second.profile.fall_ticks;
+
+	//sampled ticks are scaled by the interval to estimate the whole run
+	double ms_per_tick = 1000.0 * _execute_seconds / _execute_ticks * profile_interval;
+
+	fprintf(stream, "Profile (1 in %d clocks timed)\n", profile_interval);
+	fprintf(stream, "\t%-28s %8s %12s %12s %12s %12s %8s\n", "Unit", "Units", "Rise ms", "Fall ms", "Rise ns", "Fall ns", "Share");
+	for(auto& [name, row] : ranked)
+	{
+		const UnitProfile& profile = row.profile;
+		if(profile.rises == 0) continue;
+
+		fprintf(stream, "\t%-28s %8lld %12.1f %12.1f %12.1f %12.1f %7.2f%%\n", name.c_str(), row.num_units,
+			profile.rise_ticks * ms_per_tick, profile.fall_ticks * ms_per_tick,
+			1000000.0 * profile.rise_ticks * ms_per_tick / profile_interval / profile.rises,
+			profile.falls ? 1000000.0 * profile.fall_ticks * ms_per_tick / profile_interval / profile.falls : 0.0,
+			100.0 * (profile.rise_ticks + profile.fall_ticks) / total_ticks);
+	}
+
+	if(_barrier_ticks.empty()) return;
+
+	fprintf(stream, "\tBarrier Wait\n");
+	for(uint thread_id = 0; thread_id < _barrier_ticks.size(); ++thread_id)
+		fprintf(stream, "\t\tThread %d: %.1f ms(%.2f%%)\n", thread_id, _barrier_ticks[thread_id] * ms_per_tick, 100.0 * _barrier_ticks[thread_id] * ms_per_tick / (1000.0 * _execute_seconds));
+}
+
+void Simulator::_enable_network_logs()
+{
+	std::vector<std::pair<const char*, NetworkBase*>> networks;
+	for(Units::UnitBase* unit : _units)
+	{
+		networks.clear();
+		unit->get_networks(networks);
+		for(auto& [name, network] : networks)
+			network->enable_log();
+	}
+}
+
+void Simulator::print_network_log(FILE* stream)
+{
+	if(!log_networks || _network_log_cycles <= 0) return;
+
+	//units of the same type have the same networks so they are summed port by port
+	std::map<std::string, NetworkLog> rows;
+	std::vector<std::pair<const char*, NetworkBase*>> networks;
+	for(Units::UnitBase* unit : _units)
+	{
+		networks.clear();
+		unit->get_networks(networks);
+		for(auto& [name, network] : networks)
+			if(network->log()) rows[unit_type_name(unit) + " " + name].accumulate(*network->log());
+	}
+
+	fprintf(stream, "Networks (%lld cycles)\n", _network_log_cycles);
+	for(auto& [name, log] : rows)
+	{
+		fprintf(stream, "\n%s x%lld, %lld ports\n", name.c_str(), log._networks, (uint64_t)log._ports.size());
+		log.print_log(_network_log_cycles, stream);
+	}
+}
+
+void Simulator::serialize(Checkpoint& checkpoint)
+{
+	checkpoint.check(_units.size());
+	checkpoint.check(_unit_groups.size());
+	checkpoint(current_cycle, units_executing, _quiet_quanta);
+
+	for(UnitGroup& group : _unit_groups)
+		checkpoint(group.active, group.current_cycle);
+
+	for(Units::UnitBase* unit : _units)
+	{
+		checkpoint.check(unit->unit_id);
+		checkpoint(unit->_awake, unit->_wake_cycle);
+		unit->serialize(checkpoint);
 	}
 }
 
@@ -1,96 +1,368 @@
 #pragma once
 #include "../stdafx.hpp"
 
-#if 1
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <typeindex>
+
+#include "../util/arena.hpp"
+#include "../util/spin-barrier.hpp"
+#include "../util/checkpoint.hpp"
+
 namespace Arches {
 
 namespace Units
 {
 	class UnitBase;
+	class QuantumBridge;
 }
 
+//Units that expose their clock functions can be clocked with direct calls. Units that keep them private are only reachable through the vtable
+template<typename UNIT>
+concept DirectlyClocked = requires(UNIT* unit)
+{
+	unit->UNIT::clock_rise();
+	unit->UNIT::clock_fall();
+};
+
 class Simulator
 {
+public:
+	enum class Phase : uint8_t
+	{
+		NONE,
+		RISE,
+		FALL,
+	};
+
+	//What the calling thread is clocking. Interconnects use it to check that both ends of a channel follow the clock contract
+	struct ClockContext
+	{
+		uint group_index{~0u};
+		Phase phase{Phase::NONE};
+		bool lockstep{true}; //every group finishes a phase before any starts the next. False in quantum mode
+		cycles_t cycle{-1}; //cycle the group is on. -1 outside a phase
+	};
+
+	static const ClockContext& clock_context() { return _clock_context; }
+
 private:
+	static thread_local ClockContext _clock_context;
+
+	struct UnitGroup;
+
+	//Units of one type in a group are kept in a contiguous run and clocked by a loop compiled for that type.
+	//A group clocks its batches in the order their types were first registered so only the order between units within a phase changes
+	struct Batch
+	{
+		std::type_index type;
+		uint start;
+		uint end;
+		void (*clock_rise)(Simulator& simulator, UnitGroup& group, const Batch& batch, cycles_t cycle);
+		bool (*clock_fall)(Simulator& simulator, UnitGroup& group, const Batch& batch);
+	};
+
 	struct UnitGroup
 	{
 		uint start;
 		uint end;
+		std::vector<Batch> batches;
+		Arena arena; //units made with new_unit live here and die with the simulator
+		bool active{true}; //some unit in the group was clocked on the last clock fall
+		uint64_t cost{0};  //time stamp counter ticks spent clocking the group in the current balance window
+		cycles_t current_cycle{0}; //groups run ahead of each other in quantum mode
+		uint64_t clocks{0}; //clock rises so far. Used to pick which ones to profile
+		bool profiling{false}; //the current rise and fall are being profiled
 
-		UnitGroup() = default;
 		UnitGroup(uint start, uint end) : start(start), end(end) {}
 	};
 
 	std::vector<UnitGroup> _unit_groups;
 	std::vector<Units::UnitBase*> _units;
+	std::vector<uint8_t> _clock_fall_pending;
+
+	//groups are clocked in partitions. One per thread for the thread pool or one per task for tbb
+	std::vector<std::vector<uint>> _partitions;
+
+	//partitions are rebalanced by measured cost every BALANCE_INTERVAL cycles
+	static constexpr cycles_t BALANCE_WINDOW = 1024;
+	static constexpr cycles_t BALANCE_INTERVAL = 64 * 1024;
+	bool _measuring_cost{false};
+	cycles_t _balance_cycle{0};
+
+	//thread pool engine
+	SpinBarrier* _barrier{nullptr};
+	bool _done{false};
+
+	cycles_t _end_cycle{INT64_MAX};
+
+	//quantum mode. Partitions run independently for _quantum cycles then bridges exchange transactions between groups
+	cycles_t _quantum{1};
+	uint _quiet_quanta{0};
+	std::vector<Units::QuantumBridge*> _quantum_bridges;
+
+	//profiling. Host time is only measured on every profile_interval'th clock of a group and scaled back up when printed
+	struct UnitProfile
+	{
+		uint64_t rise_ticks{0};
+		uint64_t fall_ticks{0};
+		uint64_t rises{0};
+		uint64_t falls{0};
+	};
+	std::vector<UnitProfile> _unit_profiles;
+	std::vector<uint64_t> _barrier_ticks; //time each thread pool thread spent waiting on profiled barriers
+	uint64_t _execute_ticks{0};
+	double _execute_seconds{0.0};
+
+	//network logs. Cycles are only counted while log_networks is set so the empty share of each port's occupancy can be filled in
+	cycles_t _network_log_cycles{0};
+	void _enable_network_logs();
+
+	//progress reporting. A background thread prints a status line every progress_interval seconds while we execute
+	std::thread _progress_thread;
+	std::mutex _progress_mutex;
+	std::condition_variable _progress_condition;
+	bool _progress_done{false};
+	std::string _progress_work_name;
+	std::function<uint64_t()> _progress_work_completed;
+	uint64_t _progress_work_total{0};
+
+	//The reporter only reads this snapshot. It is published between phases, while no unit is being clocked, every PROGRESS_PUBLISH_INTERVAL cycles
+	static constexpr cycles_t PROGRESS_PUBLISH_INTERVAL = 4096;
+	std::atomic<cycles_t> _progress_cycle{0};
+	std::atomic_uint64_t _progress_instructions{0};
+	std::atomic_uint64_t _progress_work{0};
+	cycles_t _progress_publish_cycle{INT64_MAX}; //INT64_MAX while no reporter runs
+
+	//UNIT is the unit's whole type so the calls are direct and can be inlined. UnitBase is the fallback that goes through the vtable
+	template<typename UNIT>
+	static void _clock_rise_batch(Simulator& simulator, UnitGroup& group, const Batch& batch, cycles_t cycle)
+	{
+		for(uint i = batch.start; i < batch.end; ++i)
+		{
+			UNIT* unit = static_cast<UNIT*>(simulator._units[i]);
+			if(!unit->is_awake())
+			{
+				simulator._clock_fall_pending[i] = false;
+				if(unit->wake_cycle() > cycle) continue;
+				unit->wake();
+			}
+
+			if(group.profiling)
+			{
+				uint64_t unit_start = __rdtsc();
+				_clock_rise_unit(unit);
+				simulator._unit_profiles[i].rise_ticks += __rdtsc() - unit_start;
+				simulator._unit_profiles[i].rises++;
+			}
+			else _clock_rise_unit(unit);
+
+			//units woken by port writes during clock fall are only clocked from the next clock rise
+			simulator._clock_fall_pending[i] = unit->is_awake();
+		}
+	}
+
+	template<typename UNIT>
+	static bool _clock_fall_batch(Simulator& simulator, UnitGroup& group, const Batch& batch)
+	{
+		bool active = false;
+		for(uint i = batch.start; i < batch.end; ++i)
+		{
+			if(!simulator._clock_fall_pending[i]) continue;
+
+			UNIT* unit = static_cast<UNIT*>(simulator._units[i]);
+			if(group.profiling)
+			{
+				uint64_t unit_start = __rdtsc();
+				_clock_fall_unit(unit);
+				simulator._unit_profiles[i].fall_ticks += __rdtsc() - unit_start;
+				simulator._unit_profiles[i].falls++;
+			}
+			else _clock_fall_unit(unit);
+			active = true;
+		}
+		return active;
+	}
+
+	template<typename UNIT>
+	static void _clock_rise_unit(UNIT* unit)
+	{
+		if constexpr(std::is_same_v<UNIT, Units::UnitBase>) unit->clock_rise();
+		else unit->UNIT::clock_rise();
+	}
+
+	template<typename UNIT>
+	static void _clock_fall_unit(UNIT* unit)
+	{
+		if constexpr(std::is_same_v<UNIT, Units::UnitBase>) unit->clock_fall();
+		else unit->UNIT::clock_fall();
+	}
+
+	void _register_unit(Units::UnitBase* unit, std::type_index type, decltype(Batch::clock_rise) clock_rise, decltype(Batch::clock_fall) clock_fall);
 
 public:
 	std::atomic_uint units_executing{0};
 	cycles_t current_cycle{0};
+	double cycles_per_second{0.0}; //simulated cycles per second of wall time during the last execute
+	uint profile_interval{64}; //0 disables profiling
+	bool log_networks{false}; //counts occupancy, backpressure and arbitration statistics for every network units list. See print_network_log
+	double progress_interval{10.0}; //seconds between progress reports. 0 disables them
+	bool draining{false}; //units that run programs stop issuing so the machine empties out before a fast forward
 
-	Simulator() { _unit_groups.emplace_back(0u, 0u); }
+	class SamplingLog
+	{
+	public:
+		uint64_t _samples;
+		uint64_t _total_instructions;
+		uint64_t _functional_instructions;
+		uint64_t _measured_instructions;
+		cycles_t _measured_cycles;
+		double _cpi_sum;
+		double _cpi_sum_squares;
 
-	void register_unit(Units::UnitBase* unit);
-	void new_unit_group();
+		SamplingLog() { reset(); }
 
-	void _clock_rise();
-	void _clock_fall();
+		void reset()
+		{
+			_samples = 0;
+			_total_instructions = 0;
+			_functional_instructions = 0;
+			_measured_instructions = 0;
+			_measured_cycles = 0;
+			_cpi_sum = 0.0;
+			_cpi_sum_squares = 0.0;
+		}
 
-	void execute();
-};
+		void log_sample(cycles_t cycles, uint64_t instructions)
+		{
+			if(instructions == 0) return;
 
-}
-#else
+			double cpi = (double)cycles / instructions;
+			_samples++;
+			_measured_cycles += cycles;
+			_measured_instructions += instructions;
+			_cpi_sum += cpi;
+			_cpi_sum_squares += cpi * cpi;
+		}
 
-#include <thread>
-#include <barrier>
+		double get_mean_cpi() { return _samples ? _cpi_sum / _samples : 0.0; }
 
-namespace Arches
-{
+		//half width of the 95% confidence interval on the mean cpi
+		double get_cpi_confidence()
+		{
+			if(_samples < 2) return 0.0;
+			double mean = get_mean_cpi();
+			double variance = std::max((_cpi_sum_squares - _samples * mean * mean) / (_samples - 1), 0.0);
+			return 1.96 * std::sqrt(variance / _samples);
+		}
 
-	namespace Units
+		cycles_t get_estimated_cycles() { return static_cast<cycles_t>(get_mean_cpi() * _total_instructions); }
+		cycles_t get_estimated_cycles_confidence() { return static_cast<cycles_t>(get_cpi_confidence() * _total_instructions); }
+
+		void print_log(FILE* stream = stdout)
+		{
+			double mean = get_mean_cpi();
+			fprintf(stream, "Samples: %lld\n", _samples);
+			fprintf(stream, "Total Instructions: %lld\n", _total_instructions);
+			fprintf(stream, "Functional Instructions: %lld(%.2f%%)\n", _functional_instructions, _total_instructions ? 100.0 * _functional_instructions / _total_instructions : 0.0);
+			fprintf(stream, "Measured Instructions: %lld\n", _measured_instructions);
+			fprintf(stream, "Measured Cycles: %lld\n", _measured_cycles);
+			fprintf(stream, "CPI: %.4f +/- %.4f\n", mean, get_cpi_confidence());
+			fprintf(stream, "Estimated Cycles: %lld +/- %lld(%.2f%%)\n", get_estimated_cycles(), get_estimated_cycles_confidence(), mean > 0.0 ? 100.0 * get_cpi_confidence() / mean : 0.0);
+			fprintf(stream, "Unit logs only cover the detailed part of the run\n");
+		}
+	}sampling_log;
+
+	Simulator() { _unit_groups.emplace_back(0u, 0u); }
+
+	//Adds the unit to the current group. Units are batched by their dynamic type and only get direct calls when that is also the type they are registered as
+	template<typename UNIT>
+	void register_unit(UNIT* unit)
 	{
-		class UnitBase;
+		if constexpr(DirectlyClocked<UNIT>)
+		{
+			if(typeid(*unit) == typeid(UNIT))
+			{
+				_register_unit(unit, typeid(UNIT), &_clock_rise_batch<UNIT>, &_clock_fall_batch<UNIT>);
+				return;
+			}
+		}
+		_register_unit(unit, typeid(*unit), &_clock_rise_batch<Units::UnitBase>, &_clock_fall_batch<Units::UnitBase>);
 	}
 
-	class Simulator
+	//Constructs the unit in the current group's arena and registers it. The simulator owns the unit and destroys it with the group
+	template<typename UNIT, typename... ARGS>
+	UNIT* new_unit(ARGS&&... args)
 	{
-	private:
-		struct UnitGroup
-		{
-			uint start;
-			uint size;
+		UNIT* unit = _unit_groups.back().arena.create<UNIT>(std::forward<ARGS>(args)...);
+		register_unit(unit);
+		return unit;
+	}
+
+	void new_unit_group();
 
-			UnitGroup() = default;
-			UnitGroup(uint start, uint size) : start(start), size(size) {}
-		};
+	//Marks a registered unit as a quantum bridge. Bridges must be in the same group as the unit they connect to
+	void register_quantum_bridge(Units::QuantumBridge* bridge);
 
-		std::vector<UnitGroup> _unit_groups;
-		std::vector<Units::UnitBase*> _units;
-		std::atomic_bool              _done{false};
+	cycles_t get_group_cycle(uint group_index) { return _unit_groups[group_index].current_cycle; }
 
-		std::atomic_uint _rise_index{0};
-		std::atomic_uint _fall_index{0};
+	void _clock_rise(UnitGroup& group, cycles_t cycle);
+	void _clock_fall(UnitGroup& group);
+	void _clock_rise(const std::vector<uint>& partition, cycles_t cycle);
+	void _clock_fall(const std::vector<uint>& partition);
+	void _clock_rise();
+	void _clock_fall();
+	cycles_t _next_wake_cycle();
+	cycles_t _next_wake_cycle(const std::vector<uint>& partition, cycles_t cycle);
 
-		std::vector<std::thread*> _thread_pool;
-		std::barrier<std::_No_completion_function> _barrier;
+	void _run_quantum(const std::vector<uint>& partition, cycles_t end_cycle);
+	bool _end_quantum();
+	bool _is_done();
 
-	public:
-		cycles_t current_cycle{~0ull};
+	void _partition_by_cost(uint num_partitions);
+	void _balance(uint num_partitions);
+
+	uint64_t _instructions_issued();
+	uint64_t _fast_forward(uint64_t num_instructions);
+	bool _is_drained();
+	void _drain(uint num_threads);
+
+	void _publish_progress();
+	void _report_progress();
+	void _start_progress();
+	void _stop_progress();
+	void _execute(uint num_threads, cycles_t quantum, cycles_t end_cycle);
 
-		Simulator(uint num_threads);
+	void _thread_work(uint thread_id);
+	void _execute_thread_pool(uint num_threads);
+	void _execute_parallel_for();
 
-		void register_unit(Units::UnitBase* unit);
-		void new_unit_group();
+	//Work shown in progress reports. completed is polled between phases along with the other progress counters. With a total the reports include an ETA
+	void set_progress_work(const std::string& name, std::function<uint64_t()> completed, uint64_t total = 0)
+	{
+		_progress_work_name = name;
+		_progress_work_completed = completed;
+		_progress_work_total = total;
+	}
 
-		void _clock_rise();
-		void _clock_fall();
+	//Runs until no units are executing or the simulator reaches end_cycle. With 0 threads each clock phase is a tbb::parallel_for over the unit groups.
+	//Otherwise the groups are split between a pool of pinned persistent threads that sync on a barrier after each phase.
+	//A quantum above 1 only syncs every quantum cycles. Groups must then only talk through quantum bridges and the final cycle is rounded up to a whole quantum.
+	void execute(uint num_threads = 0, cycles_t quantum = 1, cycles_t end_cycle = INT64_MAX);
 
-		void _thread_work(uint thread_id);
+	//SMARTS style sampling. Fast forwards fast_forward_instructions functionally, runs warmup_cycles in detail to refill the queues and pipelines,
+	//measures the cpi over window_cycles in detail then drains the machine and repeats. Total cycles are extrapolated into sampling_log
+	void execute_sampled(uint num_threads, cycles_t quantum, uint64_t fast_forward_instructions, cycles_t warmup_cycles, cycles_t window_cycles);
 
-		void execute();
+	//Ranked host time spent clocking each type of unit and waiting on barriers over every execute so far
+	void print_profile(FILE* stream = stdout);
 
-	};
+	//Interconnect statistics since log_networks was first seen set, summed over all units of a type for each network they own
+	void print_network_log(FILE* stream = stdout);
+
+	//Saves or restores the state of every registered unit. Restoring needs a machine built with the same configuration
+	void serialize(Checkpoint& checkpoint);
+};
 
 }
-#endif
\ No newline at end of file
@@ -0,0 +1,286 @@
+#include "sweep.hpp"
+
+#include <chrono>
+
+#ifndef BUILD_PLATFORM_WINDOWS
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <sys/wait.h>
+	#include <unistd.h>
+#endif
+
+namespace Arches {
+
+#ifndef BUILD_PLATFORM_WINDOWS
+static bool write_bytes(int fd, const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	while(size > 0)
+	{
+		ssize_t bytes_written = write(fd, bytes, size);
+		if(bytes_written < 0 && errno == EINTR) continue;
+		if(bytes_written <= 0) return false;
+		bytes += bytes_written;
+		size -= bytes_written;
+	}
+	return true;
+}
+
+//Rows go back to the parent as length prefixed strings so names and values can hold anything
+static bool write_string(int fd, const std::string& string)
+{
+	uint32_t size = static_cast<uint32_t>(string.size());
+	return write_bytes(fd, &size, sizeof(size)) && write_bytes(fd, string.data(), size);
+}
+
+//The parent collects everything a child wrote before parsing it
+static bool read_string(const std::string& buffer, size_t& offset, std::string& string)
+{
+	uint32_t size;
+	if(buffer.size() - offset < sizeof(size)) return false;
+	std::memcpy(&size, buffer.data() + offset, sizeof(size));
+	offset += sizeof(size);
+
+	if(buffer.size() - offset < size) return false;
+	string.assign(buffer, offset, size);
+	offset += size;
+	return true;
+}
+#endif
+
+static std::string csv_field(const std::string& field)
+{
+	if(field.find_first_of(",\"\n") == std::string::npos) return field;
+
+	std::string quoted = "\"";
+	for(char c : field)
+	{
+		if(c == '"') quoted += '"';
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+Sweep::Sweep(const Configuration& config) : _config(config)
+{
+#ifdef BUILD_PLATFORM_WINDOWS
+	_config.fork = false;
+#endif
+	if(_config.max_jobs == 0) _config.max_jobs = std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void Sweep::_finish_point(uint point_index, bool finished)
+{
+	_finished[point_index] = finished;
+	printf("Sweep: Point %d %s\n", point_index, finished ? "finished" : "FAILED");
+	fflush(stdout);
+}
+
+void Sweep::_run_in_process(uint num_points, const Point& point)
+{
+	for(uint point_index = 0; point_index < num_points; ++point_index)
+	{
+		try
+		{
+			_rows[point_index] = point(point_index);
+			_finish_point(point_index, true);
+		}
+		catch(const std::exception& e)
+		{
+			printf("%s\n", e.what());
+			_finish_point(point_index, false);
+		}
+	}
+}
+
+void Sweep::_run_forked(uint num_points, const Point& point)
+{
+#ifndef BUILD_PLATFORM_WINDOWS
+	struct Child
+	{
+		uint point_index;
+		int fd;
+		std::string output;
+	};
+
+	std::map<pid_t, Child> children;
+	uint next_point = 0;
+	while(next_point < num_points || !children.empty())
+	{
+		while(next_point < num_points && children.size() < _config.max_jobs)
+		{
+			uint point_index = next_point++;
+
+			int fds[2];
+			if(pipe(fds) != 0)
+			{
+				_finish_point(point_index, false);
+				continue;
+			}
+
+			//anything buffered would be printed again by the child
+			fflush(stdout);
+			fflush(stderr);
+
+			pid_t pid = fork();
+			if(pid == 0)
+			{
+				close(fds[0]);
+
+				std::string log_path = _config.log_path + "." + std::to_string(point_index) + ".log";
+				int log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+				if(log_fd >= 0)
+				{
+					dup2(log_fd, STDOUT_FILENO);
+					dup2(log_fd, STDERR_FILENO);
+					close(log_fd);
+				}
+
+				int status = 0;
+				try
+				{
+					Row row = point(point_index);
+					bool sent = true;
+					for(uint i = 0; i < row.names.size() && sent; ++i)
+						sent = write_string(fds[1], row.names[i]) && write_string(fds[1], row.values[i]);
+
+					if(!sent)
+					{
+						printf("Sweep: Failed to send the row to the parent\n");
+						status = 1;
+					}
+				}
+				catch(const std::exception& e)
+				{
+					printf("%s\n", e.what());
+					status = 1;
+				}
+
+				//skip the parent's atexit handlers and static destructors
+				fflush(stdout);
+				close(fds[1]);
+				_exit(status);
+			}
+
+			close(fds[1]);
+			if(pid < 0)
+			{
+				close(fds[0]);
+				_finish_point(point_index, false);
+				continue;
+			}
+
+			children[pid] = {point_index, fds[0], {}};
+		}
+
+		if(children.empty()) break;
+
+		//drain the pipes before reaping so a child with a row bigger than the pipe buffer never blocks on us
+		std::vector<pollfd> poll_fds;
+		std::vector<pid_t> pids;
+		for(const auto& [pid, child] : children)
+		{
+			poll_fds.push_back({child.fd, POLLIN, 0});
+			pids.push_back(pid);
+		}
+
+		if(poll(poll_fds.data(), poll_fds.size(), -1) < 0)
+		{
+			if(errno == EINTR) continue;
+			break;
+		}
+
+		for(uint i = 0; i < poll_fds.size(); ++i)
+		{
+			if(!poll_fds[i].revents) continue;
+
+			Child& child = children[pids[i]];
+			char buffer[4096];
+			ssize_t bytes_read = read(child.fd, buffer, sizeof(buffer));
+			if(bytes_read > 0)
+			{
+				child.output.append(buffer, bytes_read);
+				continue;
+			}
+			if(bytes_read < 0 && errno == EINTR) continue;
+
+			//the child closed its end of the pipe so it is exiting
+			close(child.fd);
+
+			int status;
+			pid_t pid;
+			do pid = waitpid(pids[i], &status, 0);
+			while(pid < 0 && errno == EINTR);
+
+			Row row;
+			std::string name, value;
+			size_t offset = 0;
+			while(read_string(child.output, offset, name) && read_string(child.output, offset, value))
+				row.add(name, value);
+
+			bool finished = pid == pids[i] && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+			if(finished) _rows[child.point_index] = row;
+			_finish_point(child.point_index, finished);
+			children.erase(pids[i]);
+		}
+	}
+#endif
+}
+
+void Sweep::_write_csv()
+{
+	//failed points have no row so the header comes from the first point that finished
+	const Row* header = nullptr;
+	for(uint point_index = 0; point_index < _rows.size(); ++point_index)
+		if(_finished[point_index])
+		{
+			header = &_rows[point_index];
+			break;
+		}
+
+	FILE* stream = fopen(_config.csv_path.c_str(), "w");
+	if(!stream)
+	{
+		printf("Sweep: Failed to open %s\n", _config.csv_path.c_str());
+		return;
+	}
+
+	fprintf(stream, "point,status");
+	if(header)
+		for(const std::string& name : header->names)
+			fprintf(stream, ",%s", csv_field(name).c_str());
+	fprintf(stream, "\n");
+
+	for(uint point_index = 0; point_index < _rows.size(); ++point_index)
+	{
+		fprintf(stream, "%d,%s", point_index, _finished[point_index] ? "finished" : "failed");
+		for(const std::string& value : _rows[point_index].values)
+			fprintf(stream, ",%s", csv_field(value).c_str());
+		fprintf(stream, "\n");
+	}
+
+	fclose(stream);
+}
+
+void Sweep::run(uint num_points, const Point& point)
+{
+	_rows.assign(num_points, Row());
+	_finished.assign(num_points, false);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	printf("Sweep: %d points, %d at a time\n", num_points, max_jobs());
+	if(_config.fork) _run_forked(num_points, point);
+	else             _run_in_process(num_points, point);
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	_write_csv();
+
+	uint num_finished = 0;
+	for(bool finished : _finished)
+		if(finished) num_finished++;
+
+	printf("Sweep: %d/%d points finished in %.1fs. Results in %s\n", num_finished, num_points, std::chrono::duration<double>(stop - start).count(), _config.csv_path.c_str());
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "../stdafx.hpp"
+
+#include <functional>
+
+namespace Arches {
+
+//Runs a list of design points and collates one CSV row per point. Each point builds and simulates its own machine.
+//Anything built before run(), like the scene and the ELF, is shared. Forked children see it copy on write and in process points just reuse it.
+//USIMM keeps the dram state in globals so only one machine can exist in a process at a time and points only run concurrently when forked.
+class Sweep
+{
+public:
+	//Column names and values for one point. Every point should add the same columns in the same order
+	class Row
+	{
+	public:
+		std::vector<std::string> names;
+		std::vector<std::string> values;
+
+		void add(const std::string& name, const std::string& value)
+		{
+			names.push_back(name);
+			values.push_back(value);
+		}
+
+		void add(const std::string& name, const char* value) { add(name, std::string(value)); }
+
+		void add(const std::string& name, double value)
+		{
+			char buffer[64];
+			snprintf(buffer, sizeof(buffer), "%.6g", value);
+			add(name, std::string(buffer));
+		}
+
+		template<typename T>
+		requires std::is_integral_v<T>
+		void add(const std::string& name, T value) { add(name, std::to_string(value)); }
+	};
+
+	typedef std::function<Row(uint point_index)> Point;
+
+	struct Configuration
+	{
+		uint max_jobs{0}; //points running at once when forking. 0 runs one per host core
+		bool fork{true}; //runs each point in a forked child. Otherwise points run one after another. Windows can't fork so it always runs in process
+
+		std::string csv_path{"sweep.csv"};
+		std::string log_path{"sweep"}; //forked points print to <log_path>.<point index>.log
+	};
+
+private:
+	Configuration _config;
+	std::vector<Row> _rows;
+	std::vector<bool> _finished;
+
+	void _finish_point(uint point_index, bool finished);
+	void _run_in_process(uint num_points, const Point& point);
+	void _run_forked(uint num_points, const Point& point);
+	void _write_csv();
+
+public:
+	Sweep(const Configuration& config);
+
+	bool forking() { return _config.fork; }
+	uint max_jobs() { return _config.fork ? _config.max_jobs : 1; }
+
+	//Points should size their simulation thread count with this so concurrent points don't oversubscribe the host
+	uint threads_per_point() { return std::max(std::thread::hardware_concurrency() / max_jobs(), 1u); }
+
+	void run(uint num_points, const Point& point);
+};
+
+}
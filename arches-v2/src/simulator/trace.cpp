@@ -0,0 +1,221 @@
+#include "trace.hpp"
+
+#include "../util/file.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace Arches {
+
+std::atomic<TraceWriter*> TraceWriter::_active{nullptr};
+std::atomic_uint TraceWriter::_generations{0};
+thread_local TraceWriter::ThreadBuffer* TraceWriter::_thread_buffer{nullptr};
+thread_local uint TraceWriter::_thread_generation{0};
+
+TraceWriter::TraceWriter(const std::string& path, uint buffer_capacity) : _generation(_generations.fetch_add(1) + 1), _buffer_capacity(std::max(buffer_capacity, 1u))
+{
+	if(_active.load()) throw std::runtime_error("Only one trace writer can exist at a time!");
+
+	_file = fopen(path.c_str(), "wb");
+	if(!_file) throw std::runtime_error("Failed to open trace file: " + path);
+
+	TraceHeader header;
+	fwrite(&header, sizeof(header), 1, _file);
+
+	_thread = std::thread(&TraceWriter::_run, this);
+	_active.store(this);
+}
+
+TraceWriter::~TraceWriter()
+{
+	//the simulation threads are done with us by now so the last pass after the stop drains everything
+	_active.store(nullptr);
+	_stop.store(true, std::memory_order_release);
+	_thread.join();
+	fclose(_file);
+
+	for(ThreadBuffer* buffer : _buffers)
+		delete buffer;
+}
+
+void TraceWriter::_register_thread()
+{
+	ThreadBuffer* buffer = new ThreadBuffer(_buffer_capacity);
+	{
+		std::lock_guard<std::mutex> lock(_buffers_mutex);
+		_buffers.push_back(buffer);
+	}
+
+	_thread_buffer = buffer;
+	_thread_generation = _generation;
+}
+
+bool TraceWriter::_drain(ThreadBuffer& buffer)
+{
+	uint64_t head = buffer.head.load(std::memory_order_relaxed);
+	uint64_t tail = buffer.tail.load(std::memory_order_acquire);
+	if(head == tail) return false;
+
+	//at most two runs since the ring wraps once
+	uint64_t capacity = buffer.records.size();
+	while(head != tail)
+	{
+		uint64_t start = head % capacity;
+		uint64_t count = std::min(tail - head, capacity - start);
+		fwrite(&buffer.records[start], sizeof(TraceRecord), count, _file);
+		head += count;
+	}
+
+	buffer.head.store(tail, std::memory_order_release);
+	return true;
+}
+
+void TraceWriter::_run()
+{
+	std::vector<ThreadBuffer*> buffers;
+	while(true)
+	{
+		//anything recorded before the stop is visible to the pass that sees it
+		bool stopping = _stop.load(std::memory_order_acquire);
+
+		{
+			std::lock_guard<std::mutex> lock(_buffers_mutex);
+			buffers = _buffers;
+		}
+
+		bool drained = false;
+		for(ThreadBuffer* buffer : buffers)
+			drained |= _drain(*buffer);
+
+		if(drained) continue;
+		if(stopping) break;
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+
+
+TraceReport::TraceReport(const std::string& path)
+{
+	Util::File file(path, Util::File::MODE::R);
+
+	TraceHeader header, expected;
+	if(fread(&header, sizeof(header), 1, file.backing) != 1 || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0)
+		throw std::runtime_error("Not a trace file: " + path);
+	if(header.version != expected.version)
+		throw std::runtime_error("Unsupported trace version: " + path);
+
+	std::vector<TraceRecord> records(64 * 1024);
+	while(size_t count = fread(records.data(), sizeof(TraceRecord), records.size(), file.backing))
+	{
+		for(size_t i = 0; i < count; ++i)
+			_add(records[i]);
+		_records += count;
+	}
+}
+
+void TraceReport::_add(const TraceRecord& record)
+{
+	if(record.id >= _lifecycles.size()) _lifecycles.resize(std::max<uint64_t>(record.id + 1, _lifecycles.size() * 2));
+	Lifecycle& lifecycle = _lifecycles[record.id];
+
+	switch((TraceStage)record.stage)
+	{
+	case TraceStage::ISSUE: lifecycle.issue = record.cycle; break;
+	case TraceStage::CACHE_BANK:
+		if(lifecycle.num_banks < MAX_LEVELS) lifecycle.banks[lifecycle.num_banks++] = record.cycle;
+		break;
+	case TraceStage::LFB_ALLOCATE: _lfb_allocations++; break;
+	case TraceStage::LFB_MERGE: lifecycle.lfb_merge = true; break;
+	case TraceStage::DRAM_INSERT: lifecycle.dram_insert = record.cycle; break;
+	case TraceStage::DRAM_COMPLETE: lifecycle.dram_complete = record.cycle; break;
+	case TraceStage::RETURN: lifecycle.ret = record.cycle; break;
+	default: break;
+	}
+}
+
+void TraceReport::print(FILE* stream)
+{
+	//classes are ordered by how deep they go. Merges into an LFB sort right after the hits of their level
+	std::map<std::pair<uint, std::string>, Class> classes;
+	uint64_t requests = 0;
+	uint64_t returned = 0;
+	for(Lifecycle& lifecycle : _lifecycles)
+	{
+		if(lifecycle.issue == NONE) continue;
+		requests++;
+		if(lifecycle.ret == NONE) continue;
+		returned++;
+
+		//records from different threads can reach the file out of order
+		std::sort(lifecycle.banks, lifecycle.banks + lifecycle.num_banks);
+
+		std::vector<cycles_t> path{lifecycle.issue};
+		std::vector<std::string> segment_names;
+		for(uint i = 0; i < lifecycle.num_banks; ++i)
+		{
+			path.push_back(lifecycle.banks[i]);
+			segment_names.push_back(i == 0 ? "Issue to L1" : "L" + std::to_string(i) + " to L" + std::to_string(i + 1));
+		}
+
+		std::string name;
+		uint order;
+		if(lifecycle.dram_insert != NONE)
+		{
+			path.push_back(lifecycle.dram_insert);
+			segment_names.push_back(lifecycle.num_banks ? "L" + std::to_string(lifecycle.num_banks) + " to DRAM" : "Issue to DRAM");
+			if(lifecycle.dram_complete != NONE)
+			{
+				path.push_back(lifecycle.dram_complete);
+				segment_names.push_back("DRAM");
+			}
+			name = "DRAM";
+			order = ~0u;
+		}
+		else
+		{
+			//atomics are served by units outside the cache hierarchy
+			name = lifecycle.num_banks ? "L" + std::to_string(lifecycle.num_banks) + (lifecycle.lfb_merge ? " LFB" : "") : "Uncached";
+			order = lifecycle.num_banks * 2 + lifecycle.lfb_merge;
+		}
+		path.push_back(lifecycle.ret);
+		segment_names.push_back("Return");
+
+		//requests that took a different path through the same level get their own entry
+		std::string key = name;
+		for(const std::string& segment_name : segment_names)
+			key += "|" + segment_name;
+
+		Class& c = classes[{order, key}];
+		if(c.count == 0)
+		{
+			c.name = name;
+			c.segment_names = segment_names;
+			c.segment_cycles.resize(segment_names.size(), 0);
+		}
+
+		cycles_t latency = lifecycle.ret - lifecycle.issue;
+		c.count++;
+		c.total_cycles += latency;
+		c.max_cycles = std::max(c.max_cycles, latency);
+		for(uint i = 0; i + 1 < path.size(); ++i)
+			c.segment_cycles[i] += path[i + 1] - path[i];
+	}
+
+	fprintf(stream, "Records: %llu\n", (unsigned long long)_records);
+	fprintf(stream, "Requests: %llu\n", (unsigned long long)requests);
+	fprintf(stream, "Returned: %llu\n", (unsigned long long)returned);
+	fprintf(stream, "LFB Allocations: %llu\n", (unsigned long long)_lfb_allocations);
+
+	for(auto& [key, c] : classes)
+	{
+		fprintf(stream, "\n%s: %llu (%.2f%%)\n", c.name.c_str(), (unsigned long long)c.count, 100.0 * c.count / returned);
+		fprintf(stream, "\tMean Latency: %.2f\n", (double)c.total_cycles / c.count);
+		fprintf(stream, "\tMax Latency: %llu\n", (unsigned long long)c.max_cycles);
+		for(uint i = 0; i < c.segment_names.size(); ++i)
+			fprintf(stream, "\t%s: %.2f\n", c.segment_names[i].c_str(), (double)c.segment_cycles[i] / c.count);
+	}
+}
+
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include "../stdafx.hpp"
+
+namespace Arches {
+
+//Points in a memory request's life where it gets a timestamp. Every cache records CACHE_BANK when one of its banks accepts the request
+//so the nth bank record of a request is level n of the hierarchy.
+enum class TraceStage : uint8_t
+{
+	ISSUE,
+	CACHE_BANK,
+	LFB_ALLOCATE, //missed and allocated the LFB that fetches the line
+	LFB_MERGE, //missed and joined an LFB that was already fetching the line
+	DRAM_INSERT,
+	DRAM_COMPLETE,
+	RETURN,
+
+	NUM_STAGES,
+};
+
+struct TraceRecord
+{
+	uint64_t id : 56;
+	uint64_t stage : 8;
+	uint64_t cycle;
+};
+
+struct TraceHeader
+{
+	char magic[4]{'A', 'T', 'R', 'C'};
+	uint32_t version{1};
+};
+
+//Writes a lifecycle trace of memory requests to a binary file while it exists. Request ids start at 1. Id 0 marks a request that isn't
+//traced so recording costs one predictable branch when no writer exists. Each simulation thread fills its own ring buffer and a background
+//thread drains them to the file, so the clock loops only wait on it when a ring fills up. Records from different threads reach the file in no
+//particular order. Only one writer can exist at a time.
+class TraceWriter
+{
+private:
+	struct ThreadBuffer
+	{
+		std::vector<TraceRecord> records;
+		std::atomic_uint64_t head{0}; //next record the writer thread drains
+		std::atomic_uint64_t tail{0}; //next record the simulation thread fills
+		uint64_t next_id{0};
+		uint64_t end_id{0};
+
+		ThreadBuffer(uint capacity) : records(capacity) {}
+	};
+
+	//ids are handed to threads in blocks so issuing doesn't contend on one counter
+	static constexpr uint64_t ID_BLOCK_SIZE = 4096;
+
+	static std::atomic<TraceWriter*> _active;
+	static std::atomic_uint _generations;
+	static thread_local ThreadBuffer* _thread_buffer;
+	static thread_local uint _thread_generation;
+
+	FILE* _file;
+	uint _generation;
+	uint _buffer_capacity;
+	std::mutex _buffers_mutex;
+	std::vector<ThreadBuffer*> _buffers;
+	std::atomic_uint64_t _next_id{1};
+	std::atomic_bool _stop{false};
+	std::thread _thread;
+
+	ThreadBuffer& _buffer()
+	{
+		if(_thread_generation != _generation) _register_thread();
+		return *_thread_buffer;
+	}
+
+	void _register_thread();
+	bool _drain(ThreadBuffer& buffer);
+	void _run();
+
+	void _record(uint64_t id, TraceStage stage, cycles_t cycle)
+	{
+		ThreadBuffer& buffer = _buffer();
+		uint64_t tail = buffer.tail.load(std::memory_order_relaxed);
+		while(tail - buffer.head.load(std::memory_order_acquire) == buffer.records.size())
+			std::this_thread::yield();
+
+		TraceRecord& record = buffer.records[tail % buffer.records.size()];
+		record.id = id;
+		record.stage = (uint64_t)stage;
+		record.cycle = cycle;
+		buffer.tail.store(tail + 1, std::memory_order_release);
+	}
+
+public:
+	TraceWriter(const std::string& path, uint buffer_capacity = 64 * 1024);
+	~TraceWriter();
+
+	static bool enabled()
+	{
+		return _active.load(std::memory_order_relaxed) != nullptr;
+	}
+
+	//Only valid while enabled
+	static uint64_t new_id()
+	{
+		ThreadBuffer& buffer = _active.load(std::memory_order_relaxed)->_buffer();
+		if(buffer.next_id == buffer.end_id)
+		{
+			buffer.next_id = _active.load(std::memory_order_relaxed)->_next_id.fetch_add(ID_BLOCK_SIZE, std::memory_order_relaxed);
+			buffer.end_id = buffer.next_id + ID_BLOCK_SIZE;
+		}
+		return buffer.next_id++;
+	}
+
+	static void record(uint64_t id, TraceStage stage, cycles_t cycle)
+	{
+		if(id == 0) return;
+		if(TraceWriter* writer = _active.load(std::memory_order_relaxed))
+			writer->_record(id, stage, cycle);
+	}
+};
+
+//Reads a trace back and breaks the latency of returned requests down by the deepest level that served them.
+//Keeps one lifecycle per request id so it needs memory for every request in the trace.
+class TraceReport
+{
+private:
+	static constexpr uint MAX_LEVELS = 4;
+	static constexpr cycles_t NONE = ~0ull;
+
+	struct Lifecycle
+	{
+		cycles_t issue{NONE};
+		cycles_t banks[MAX_LEVELS]{NONE, NONE, NONE, NONE};
+		cycles_t dram_insert{NONE};
+		cycles_t dram_complete{NONE};
+		cycles_t ret{NONE};
+		uint8_t num_banks{0};
+		bool lfb_merge{false}; //merged into an LFB at its deepest level
+	};
+
+	//Latencies of the requests served at one place. Segment i covers the time between the ith and i + 1th timestamp of the path
+	struct Class
+	{
+		std::string name;
+		std::vector<std::string> segment_names;
+		std::vector<uint64_t> segment_cycles;
+		uint64_t count{0};
+		uint64_t total_cycles{0};
+		cycles_t max_cycles{0};
+	};
+
+	std::vector<Lifecycle> _lifecycles;
+	uint64_t _records{0};
+	uint64_t _lfb_allocations{0};
+
+	void _add(const TraceRecord& record);
+
+public:
+	TraceReport(const std::string& path);
+
+	void print(FILE* stream = stdout);
+};
+
+}
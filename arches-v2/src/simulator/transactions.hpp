@@ -2,6 +2,8 @@
 
 #include "../stdafx.hpp"
 
+#include "../util/checkpoint.hpp"
+
 #include "../../../dual-streaming-benchmark/src/work-item.hpp"
 
 namespace Arches {
@@ -36,6 +38,7 @@ public:
 	uint16_t port;
 
 	uint64_t write_mask;
+	uint64_t id{0}; //lifecycle trace id. 0 when the request isn't traced
 
 	union
 	{
@@ -55,9 +58,9 @@ public:
 public:
 	MemoryRequest() = default;
 
-	MemoryRequest(const MemoryRequest& other) : type(other.type), size(other.size), dst(other.dst), port(other.port), write_mask(other.write_mask), paddr(other.paddr)
+	MemoryRequest(const MemoryRequest& other) : type(other.type), size(other.size), dst(other.dst), port(other.port), write_mask(other.write_mask), id(other.id), paddr(other.paddr)
 	{
-		std::memcpy(data, other.data, size);
+		std::memcpy(data, other.data, other.payload_size());
 	}
 
 	MemoryRequest& operator=(const MemoryRequest& other)
@@ -67,19 +70,50 @@ public:
 		dst = other.dst;
 		port = other.port;
 		write_mask = other.write_mask;
+		id = other.id;
 		paddr = other.paddr;
-		std::memcpy(data, other.data, size);
+		std::memcpy(data, other.data, other.payload_size());
 		return *this;
 	}
+
+	//Loads only send the address. Stores and atomics carry their data
+	uint payload_size() const { return type == Type::LOAD ? 0 : size; }
+
+	//the copy only moves the valid bytes so it isn't trivially copyable
+	void serialize(Checkpoint& checkpoint) { checkpoint.bytes(this, sizeof(*this)); }
 };
 
+inline uint payload_bytes(const MemoryRequest& request) { return request.payload_size(); }
+
+//Where a load was served. The TPs sort their load latencies by it
+enum class MemorySource : uint8_t
+{
+	OTHER,
+	L1,
+	L1_LFB, //merged into an LFB that was fetching or still held the line
+	L2, //deeper levels count as L2
+	DRAM,
+	RSB, //ray staging buffer
+
+	NUM_SOURCES,
+};
+
+//Source for a return served by a cache at the given level of the hierarchy
+inline MemorySource cache_source(uint level, bool lfb)
+{
+	if(level <= 1) return lfb ? MemorySource::L1_LFB : MemorySource::L1;
+	return MemorySource::L2;
+}
+
 struct MemoryReturn
 {
 public:
 	//meta data 
 	uint8_t  size;
+	MemorySource source{MemorySource::OTHER};
 	uint16_t dst;
 	uint16_t port;
+	uint64_t id{0}; //trace id of the request being returned
 
 	union
 	{
@@ -99,12 +133,12 @@ public:
 public:
 	MemoryReturn() = default;
 
-	MemoryReturn(const MemoryReturn& other) : size(other.size), port(other.port), dst(other.dst), paddr(other.paddr)
+	MemoryReturn(const MemoryReturn& other) : size(other.size), source(other.source), dst(other.dst), port(other.port), id(other.id), paddr(other.paddr)
 	{
 		std::memcpy(data, other.data, size);
 	}
 
-	MemoryReturn(const MemoryRequest& request, void* data) : size(request.size), dst(request.dst), port(request.port), paddr(request.paddr)
+	MemoryReturn(const MemoryRequest& request, void* data) : size(request.size), dst(request.dst), port(request.port), id(request.id), paddr(request.paddr)
 	{
 		std::memcpy(this->data, data, request.size);
 	}
@@ -112,14 +146,21 @@ public:
 	MemoryReturn& operator=(const MemoryReturn& other)
 	{
 		size = other.size;
+		source = other.source;
 		dst = other.dst;
 		port = other.port;
+		id = other.id;
 		paddr = other.paddr;
 		std::memcpy(data, other.data, size);
 		return *this;
 	}
+
+	//the copy only moves the valid bytes so it isn't trivially copyable
+	void serialize(Checkpoint& checkpoint) { checkpoint.bytes(this, sizeof(*this)); }
 };
 
+inline uint payload_bytes(const MemoryReturn& ret) { return ret.size; }
+
 struct StreamSchedulerRequest
 {
 	enum class Type : uint8_t
@@ -142,6 +183,8 @@ struct StreamSchedulerRequest
 	}
 };
 
+inline uint payload_bytes(const StreamSchedulerRequest& request) { return request.type == StreamSchedulerRequest::Type::STORE_WORKITEM ? sizeof(BucketRay) : 0; }
+
 struct SFURequest
 {
 	uint16_t dst;
@@ -2,6 +2,8 @@
 #include "stdafx.hpp"
 
 #include "simulator/simulator.hpp"
+#include "simulator/functional-simulator.hpp"
+#include "simulator/sweep.hpp"
 
 #include "units/unit-dram.hpp"
 #include "units/unit-blocking-cache.hpp"
@@ -10,6 +12,7 @@
 #include "units/unit-tile-scheduler.hpp"
 #include "units/unit-sfu.hpp"
 #include "units/unit-tp.hpp"
+#include "units/unit-quantum-bridge.hpp"
 
 #include "util/elf.hpp"
 
@@ -39,7 +42,7 @@ const static InstructionInfo traxamoin(ISA::RISCV::CUSTOM_OPCODE0, "fchthrd", In
 }}}
 
 template <typename RET>
-static RET* write_array(Units::UnitMainMemoryBase* main_memory, size_t alignment, RET* data, size_t size, paddr_t& heap_address)
+static RET* write_array(Units::UnitMainMemoryBase* main_memory, size_t alignment, const RET* data, size_t size, paddr_t& heap_address)
 {
 	paddr_t array_address = align_to(alignment, heap_address);
 	heap_address = array_address + size * sizeof(RET);
@@ -48,23 +51,89 @@ static RET* write_array(Units::UnitMainMemoryBase* main_memory, size_t alignment
 }
 
 template <typename RET>
-static RET* write_vector(Units::UnitMainMemoryBase* main_memory, size_t alignment, std::vector<RET> v, paddr_t& heap_address)
+static RET* write_vector(Units::UnitMainMemoryBase* main_memory, size_t alignment, const std::vector<RET>& v, paddr_t& heap_address)
 {
 	return write_array(main_memory, alignment, v.data(), v.size(), heap_address);
 }
 
-static KernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, paddr_t& heap_address)
+//Hardware and run settings for one machine. The defaults are the baseline configuration
+struct TRaXConfig
 {
-	rtm::Mesh mesh("../datasets/sponza.obj");
-	rtm::BVH blas;
+	uint num_tps_per_tm{32};
+	uint num_tms_per_l2{8};
+	uint num_l2{4};
+
+	uint l1_size{32 * 1024};
+	uint l1_associativity{1};
+	ReplacementPolicy::Type l1_replacement_policy{ReplacementPolicy::Type::LRU};
+	uint l1_num_banks{8};
+	uint64_t l1_bank_select_mask{0b0101'0100'0000};
+	uint l1_num_lfb{8};
+
+	uint l2_size{512 * 1024};
+	uint l2_associativity{1};
+	ReplacementPolicy::Type l2_replacement_policy{ReplacementPolicy::Type::LRU};
+	uint l2_num_banks{16};
+	uint l2_num_mshr{0}; //per bank. 0 models a blocking L2 otherwise the L2 is non-blocking with misses merging in the MSHRs
+	uint l2_num_hit_lfb{4}; //per bank lfbs of the non-blocking L2 that only stage hits so hits keep flowing when every MSHR holds a miss
+	uint64_t l2_bank_select_mask{0b0001'1110'0000'0000'0000ull};
+	NetworkConfiguration l2_network{}; //between the L1s and the L2 banks. One router per bank for a ring or mesh
+
+	uint num_threads{0}; //0 runs on tbb otherwise the number of persistent simulation threads
+	uint quantum{1}; //cycles the unit groups can run ahead of each other. Above 1 groups talk through quantum bridges
+
+	std::string checkpoint_path{"trax.checkpoint"};
+	cycles_t checkpoint_cycle{0}; //saves a checkpoint once the simulation reaches this cycle. 0 disables
+	bool restore_checkpoint{false}; //skips buffer initialization and warm up by restoring the checkpoint. Needs the same configuration it was saved with
+
+	bool functional{false}; //runs the kernel with no timing model as a quick reference for the frame. Skips checkpoints and sampling
+
+	uint64_t sample_interval{0}; //instructions to fast forward functionally between detailed samples. 0 simulates the whole frame in detail
+	cycles_t sample_warmup{2000}; //detailed cycles to refill the pipelines and queues before each sample
+	cycles_t sample_window{2000}; //detailed cycles measured per sample
+
+	bool log_networks{false}; //reports occupancy, backpressure and arbitration conflicts for every interconnect at the end of the run
+	std::string trace_path{""}; //writes the lifecycle of every memory request the TPs issue to this file. Empty disables. Break it down with --trace-report <path>
+
+	std::string framebuffer_path{"out.png"}; //empty skips writing the frame
+};
+
+struct TRaXResult
+{
+	cycles_t cycles{0}; //estimated when sampling
+	uint64_t instructions{0};
+	double runtime{0.0}; //host seconds
+	double l1_hit_rate{0.0};
+	double l2_hit_rate{0.0};
+	float dram_power{0.0f}; //watts
+};
+
+//Everything built on the host ahead of the machine. Nothing touches it once it is built so a sweep builds it once and shares it between points
+struct TRaXScene
+{
+	ELF elf;
+	std::vector<rtm::BVH::Node> blas_nodes;
 	std::vector<rtm::Triangle> tris;
-	std::vector<rtm::BVH::BuildObject> build_objects;
-	for(uint i = 0; i < mesh.size(); ++i)
-		build_objects.push_back(mesh.get_build_object(i));
-	blas.build(build_objects);
-	mesh.reorder(build_objects);
-	mesh.get_triangles(tris);
 
+	//restoring a checkpoint brings the buffers back with the rest of memory so it only needs the ELF
+	TRaXScene(bool build_buffers = true) : elf("../trax-benchmark/riscv/kernel")
+	{
+		if(!build_buffers) return;
+
+		rtm::Mesh mesh("../datasets/sponza.obj");
+		rtm::BVH blas;
+		std::vector<rtm::BVH::BuildObject> build_objects;
+		for(uint i = 0; i < mesh.size(); ++i)
+			build_objects.push_back(mesh.get_build_object(i));
+		blas.build(build_objects);
+		mesh.reorder(build_objects);
+		mesh.get_triangles(tris);
+		blas_nodes = blas.nodes;
+	}
+};
+
+static KernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, paddr_t& heap_address, const TRaXScene& scene)
+{
 	KernelArgs args;
 	args.framebuffer_width = 1024;
 	args.framebuffer_height = 1024;
@@ -81,19 +150,22 @@ static KernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, padd
 	//global_data.camera = Camera(global_data.framebuffer_width, global_data.framebuffer_height, 24.0f, rtm::vec3(0.0f, 0.0f, 5.0f));
 
 	heap_address = align_to(CACHE_BLOCK_SIZE, heap_address) + 32;
-	args.mesh.blas = write_vector(main_memory, 32, blas.nodes, heap_address);
-	args.mesh.tris = write_vector(main_memory, CACHE_BLOCK_SIZE, tris, heap_address);
+	args.mesh.blas = write_vector(main_memory, 32, scene.blas_nodes, heap_address);
+	args.mesh.tris = write_vector(main_memory, CACHE_BLOCK_SIZE, scene.tris, heap_address);
 
 	main_memory->direct_write(&args, sizeof(KernelArgs), KERNEL_ARGS_ADDRESS);
 
 	return args;
 }
 
-static void run_sim_trax(int argc, char* argv[])
+static TRaXResult simulate_trax(const TRaXConfig& config, const TRaXScene& scene)
 {
-	uint num_tps_per_tm = 32;
-	uint num_tms_per_l2 = 8;
-	uint num_l2 = 4;
+	TRaXResult result;
+
+	uint num_tps_per_tm = config.num_tps_per_tm;
+	uint num_tms_per_l2 = config.num_tms_per_l2;
+	uint num_l2 = config.num_l2;
+	uint quantum = config.quantum;
 
 	uint num_tps = num_l2 * num_tms_per_l2 * num_tps_per_tm;
 	uint num_tms = num_tms_per_l2 * num_l2;
@@ -109,67 +181,146 @@ static void run_sim_trax(int argc, char* argv[])
 	ISA::RISCV::InstructionTypeNameDatabase::get_instance()[ISA::RISCV::InstrType::CUSTOM0] = "FCHTHRD";
 
 	Simulator simulator;
+	simulator.log_networks = config.log_networks;
 
 	std::vector<Units::UnitTP*> tps;
 	std::vector<Units::UnitSFU*> sfus;
 	std::vector<Units::UnitNonBlockingCache*> l1s;
 	std::vector<Units::UnitBlockingCache*> l2s;
+	std::vector<Units::UnitNonBlockingCache*> non_blocking_l2s;
 	std::vector<Units::UnitThreadScheduler*> thread_schedulers;
 	std::vector<std::vector<Units::UnitBase*>> unit_tables; unit_tables.reserve(num_tms);
 	std::vector<std::vector<Units::UnitSFU*>> sfu_lists; sfu_lists.reserve(num_tms);
 	std::vector<std::vector<Units::UnitMemoryBase*>> mem_lists; mem_lists.reserve(num_tms);
+	std::vector<Units::UnitQuantumBridge*> quantum_bridges;
+
+	//clients in other groups connect through a bridge in the unit's group when running in quantum mode
+	auto connect = [&](Units::UnitMemoryBase* unit, uint num_ports) -> Units::UnitMemoryBase*
+	{
+		if(quantum <= 1) return unit;
+		quantum_bridges.push_back(simulator.new_unit<Units::UnitQuantumBridge>(unit, num_ports));
+		simulator.register_quantum_bridge(quantum_bridges.back());
+		return quantum_bridges.back();
+	};
 	
 	Units::UnitDRAM mm(num_l2 * 16, 1024ull * 1024ull * 1024ull, &simulator); mm.clear();
 	simulator.register_unit(&mm);
+	Units::UnitMemoryBase* mm_port = connect(&mm, num_l2 * 16);
 	
-	ELF elf("../trax-benchmark/riscv/kernel");
-	vaddr_t global_pointer;
+	const ELF& elf = scene.elf;
 	paddr_t heap_address = mm.write_elf(elf);
+
+	if(config.functional)
+	{
+		KernelArgs kernel_args = initilize_buffers(&mm, heap_address, scene);
+
+		FunctionalSimulator::Configuration functional_config;
+		functional_config.pc = elf.elf_header->e_entry.u64;
+		functional_config.sp = 0x0;
+		functional_config.stack_size = stack_size;
+		functional_config.main_memory = &mm;
+		FunctionalSimulator functional_simulator(functional_config);
+
+		//pixel order doesn't matter without timing so fchthrd just counts up
+		std::atomic_uint next_index{0};
+		functional_simulator.set_handler(ISA::RISCV::InstrType::CUSTOM0, [&](const MemoryRequest& request, MemoryReturn& ret)
+		{
+			uint32_t index = next_index++;
+			ret = MemoryReturn(request, &index);
+			return true;
+		});
+
+		functional_simulator.execute();
+
+		printf("Functional Threads: %d\n", functional_simulator.num_threads());
+		printf("Runtime: %.0f ms\n", functional_simulator.seconds * 1000.0);
+		printf("Instructions: %lld\n", functional_simulator.instructions);
+		printf("MIPS: %.2f\n", functional_simulator.instructions / functional_simulator.seconds / 1000000.0);
+
+		result.instructions = functional_simulator.instructions;
+		result.runtime = functional_simulator.seconds;
+
+		if(!config.framebuffer_path.empty())
+		{
+			paddr_t paddr_frame_buffer = reinterpret_cast<paddr_t>(kernel_args.framebuffer);
+			stbi_flip_vertically_on_write(true);
+			mm.dump_as_png_uint8(paddr_frame_buffer, kernel_args.framebuffer_width, kernel_args.framebuffer_height, config.framebuffer_path);
+		}
+		return result;
+	}
 	
-	KernelArgs kernel_args = initilize_buffers(&mm, heap_address);
+	//the kernel args are saved ahead of the units so we can skip building the buffers on restore
+	Checkpoint* restore = config.restore_checkpoint ? new Checkpoint(config.checkpoint_path, true) : nullptr;
+	KernelArgs kernel_args;
+	if(restore) (*restore)(kernel_args);
+	else kernel_args = initilize_buffers(&mm, heap_address, scene);
 
 	Units::UnitAtomicRegfile atomic_regs(num_tms);
 	simulator.register_unit(&atomic_regs);
+	Units::UnitMemoryBase* atomic_regs_port = connect(&atomic_regs, num_tms);
 
 	for(uint l2_index = 0; l2_index < num_l2; ++l2_index)
 	{
-		Units::UnitBlockingCache::Configuration l2_config;
-		l2_config.size = 512 * 1024;
-		l2_config.associativity = 1;
-		l2_config.data_array_latency = 3;
-		l2_config.num_ports = num_tms_per_l2 * 8;
-		l2_config.num_banks = 16;
-		l2_config.bank_select_mask = 0b0001'1110'0000'0000'0000ull;
-		l2_config.mem_higher = &mm;
-		l2_config.mem_higher_port_offset = l2_index;
-		l2_config.mem_higher_port_stride = num_l2;
-
-		l2s.push_back(new Units::UnitBlockingCache(l2_config));
+		//both l2 models share these fields
+		auto set_l2_config = [&](auto& l2_config)
+		{
+			l2_config.size = config.l2_size;
+			l2_config.associativity = config.l2_associativity;
+			l2_config.replacement_policy = config.l2_replacement_policy;
+			l2_config.data_array_latency = 3;
+			l2_config.num_ports = num_tms_per_l2 * 8;
+			l2_config.num_banks = config.l2_num_banks;
+			l2_config.bank_select_mask = config.l2_bank_select_mask;
+			l2_config.network = config.l2_network;
+			l2_config.mem_higher = mm_port;
+			l2_config.mem_higher_port_offset = l2_index;
+			l2_config.mem_higher_port_stride = num_l2;
+			l2_config.level = 2;
+		};
+
+		Units::UnitMemoryBase* l2_port = nullptr;
 
 		for(uint tm_i = 0; tm_i < num_tms_per_l2; ++tm_i)
 		{
 			simulator.new_unit_group();
-			if(tm_i == 0) simulator.register_unit(l2s.back());
+			if(tm_i == 0)
+			{
+				if(config.l2_num_mshr)
+				{
+					Units::UnitNonBlockingCache::Configuration l2_config;
+					set_l2_config(l2_config);
+					l2_config.num_lfb = config.l2_num_mshr + config.l2_num_hit_lfb;
+					l2_config.num_mshr = config.l2_num_mshr;
+					l2_config.check_retired_lfb = false;
+					non_blocking_l2s.push_back(simulator.new_unit<Units::UnitNonBlockingCache>(l2_config));
+					l2_port = connect(non_blocking_l2s.back(), num_tms_per_l2 * 8);
+				}
+				else
+				{
+					Units::UnitBlockingCache::Configuration l2_config;
+					set_l2_config(l2_config);
+					l2s.push_back(simulator.new_unit<Units::UnitBlockingCache>(l2_config));
+					l2_port = connect(l2s.back(), num_tms_per_l2 * 8);
+				}
+			}
 
 			uint tm_index = l2_index * num_tms_per_l2 + tm_i;
 
 			Units::UnitNonBlockingCache::Configuration l1_config;
-			l1_config.size = 32 * 1024;
-			l1_config.associativity = 1;
+			l1_config.size = config.l1_size;
+			l1_config.associativity = config.l1_associativity;
+			l1_config.replacement_policy = config.l1_replacement_policy;
 			l1_config.data_array_latency = 0;
 			l1_config.num_ports = num_tps_per_tm;
-			l1_config.num_banks = 8;
-			l1_config.bank_select_mask = 0b0101'0100'0000;
-			l1_config.num_lfb = 8;
+			l1_config.num_banks = config.l1_num_banks;
+			l1_config.bank_select_mask = config.l1_bank_select_mask;
+			l1_config.num_lfb = config.l1_num_lfb;
 			l1_config.check_retired_lfb = false;
-			l1_config.mem_higher = l2s.back();
+			l1_config.mem_higher = l2_port;
 			l1_config.mem_higher_port_offset = 8 * tm_i;
 
-			l1s.push_back(new Units::UnitNonBlockingCache(l1_config));
-			simulator.register_unit(l1s.back());
-
-			thread_schedulers.push_back(_new  Units::UnitThreadScheduler(num_tps_per_tm, tm_index, &atomic_regs, kernel_args.framebuffer_width, kernel_args.framebuffer_height, 8, 8));
-			simulator.register_unit(thread_schedulers.back());
+			l1s.push_back(simulator.new_unit<Units::UnitNonBlockingCache>(l1_config));
+			thread_schedulers.push_back(simulator.new_unit<Units::UnitThreadScheduler>(num_tps_per_tm, tm_index, atomic_regs_port, kernel_args.framebuffer_width, kernel_args.framebuffer_height, 8, 8));
 
 			std::vector<Units::UnitSFU*> sfu_list;
 			std::vector<Units::UnitBase*> unit_table((uint)ISA::RISCV::InstrType::NUM_TYPES, nullptr);
@@ -179,19 +330,16 @@ static void run_sim_trax(int argc, char* argv[])
 			unit_table[(uint)ISA::RISCV::InstrType::STORE] = l1s.back();
 			unit_table[(uint)ISA::RISCV::InstrType::CUSTOM0] = thread_schedulers.back();
 
-			sfu_list.push_back(_new Units::UnitSFU(16, 1, 1, num_tps_per_tm));
-			simulator.register_unit(sfu_list.back());
+			sfu_list.push_back(simulator.new_unit<Units::UnitSFU>(16, 1, 1, num_tps_per_tm));
 			unit_table[(uint)ISA::RISCV::InstrType::FADD] = sfu_list.back();
 			unit_table[(uint)ISA::RISCV::InstrType::FMUL] = sfu_list.back();
 			unit_table[(uint)ISA::RISCV::InstrType::FFMAD] = sfu_list.back();
 
-			sfu_list.push_back(_new Units::UnitSFU(2, 1, 1, num_tps_per_tm));
-			simulator.register_unit(sfu_list.back());
+			sfu_list.push_back(simulator.new_unit<Units::UnitSFU>(2, 1, 1, num_tps_per_tm));
 			unit_table[(uint)ISA::RISCV::InstrType::IMUL] = sfu_list.back();
 			unit_table[(uint)ISA::RISCV::InstrType::IDIV] = sfu_list.back();
 
-			sfu_list.push_back(_new Units::UnitSFU(1, 1, 20, num_tps_per_tm));
-			simulator.register_unit(sfu_list.back());
+			sfu_list.push_back(simulator.new_unit<Units::UnitSFU>(1, 1, 20, num_tps_per_tm));
 			unit_table[(uint)ISA::RISCV::InstrType::FDIV] = sfu_list.back();
 			unit_table[(uint)ISA::RISCV::InstrType::FSQRT] = sfu_list.back();
 
@@ -215,54 +363,210 @@ static void run_sim_trax(int argc, char* argv[])
 				tp_config.unique_mems = &mem_lists.back();
 				tp_config.unique_sfus = &sfu_lists.back();
 
-				tps.push_back(new Units::UnitTP(tp_config));
-				simulator.register_unit(tps.back());
+				tps.push_back(simulator.new_unit<Units::UnitTP>(tp_config));
 				simulator.units_executing++;
 			}
 		}
 	}
 
+	uint num_tiles = (kernel_args.framebuffer_width / 8) * (kernel_args.framebuffer_height / 8);
+	simulator.set_progress_work("Tiles", [&]() -> uint64_t { return std::min<uint64_t>(atomic_regs.get_register(0), num_tiles); }, num_tiles);
+
+	if(restore)
+	{
+		simulator.serialize(*restore);
+		delete restore;
+		printf("Restored checkpoint at cycle %lld\n", simulator.current_cycle);
+	}
+
+	TraceWriter* trace = config.trace_path.empty() ? nullptr : new TraceWriter(config.trace_path);
+
 	{
 		auto start = std::chrono::high_resolution_clock::now();
-		simulator.execute();
+		if(config.checkpoint_cycle > 0 && !config.restore_checkpoint)
+		{
+			simulator.execute(config.num_threads, quantum, config.checkpoint_cycle);
+
+			Checkpoint checkpoint(config.checkpoint_path, false);
+			checkpoint(kernel_args);
+			simulator.serialize(checkpoint);
+			printf("Saved checkpoint at cycle %lld\n", simulator.current_cycle);
+		}
+		if(config.sample_interval > 0) simulator.execute_sampled(config.num_threads, quantum, config.sample_interval, config.sample_warmup, config.sample_window);
+		else                           simulator.execute(config.num_threads, quantum);
 		auto stop = std::chrono::high_resolution_clock::now();
 
 		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
 		std::cout << "Runtime: " << duration.count() << " ms\n";
-		std::cout << "Cycles: " << simulator.current_cycle << "\n";
+		result.runtime = std::chrono::duration<double>(stop - start).count();
+		result.cycles = config.sample_interval > 0 ? simulator.sampling_log.get_estimated_cycles() : simulator.current_cycle;
+		if(config.sample_interval > 0)
+		{
+			std::cout << "Estimated Cycles: " << simulator.sampling_log.get_estimated_cycles() << "\n";
+			std::cout << "Detailed Cycles: " << simulator.current_cycle << "\n";
+		}
+		else
+		{
+			std::cout << "Cycles: " << simulator.current_cycle << "\n";
+			std::cout << "Simulation Rate: " << simulator.cycles_per_second / 1000.0 << " KHz\n";
+		}
+	}
+
+	if(trace)
+	{
+		delete trace;
+		printf("Trace: %s\n", config.trace_path.c_str());
+	}
+
+	if(config.sample_interval > 0)
+	{
+		printf("\nSampling\n");
+		simulator.sampling_log.print_log();
 	}
 
 	printf("\nTP\n");
 	Units::UnitTP::Log tp_log(elf.segments[0]->vaddr);
+	for(auto& tp : tps)
+		tp->flush_outstanding_loads();
 	for(auto& tp : tps)
 		tp_log.accumulate(tp->log);
 	tp_log.print_log();
+	for(auto& tp : tps)
+		result.instructions += tp->instructions_issued();
+
+	printf("\nTM Loads\n");
+	for(uint tm_index = 0; tm_index < num_tms; ++tm_index)
+	{
+		Units::UnitTP::Log tm_log(elf.segments[0]->vaddr);
+		for(uint tp_index = 0; tp_index < num_tps_per_tm; ++tp_index)
+			tm_log.accumulate(tps[tm_index * num_tps_per_tm + tp_index]->log);
+		printf("\tTM %d: Mean Latency: %.2f Mean Outstanding: %.2f\n", tm_index, tm_log.get_mean_load_latency(), simulator.current_cycle ? (double)tm_log.get_outstanding_load_cycles() / simulator.current_cycle : 0.0);
+	}
 
 	printf("\nL1\n");
 	Units::UnitNonBlockingCache::Log l1_log;
 	for(auto& l1 : l1s)
 		l1_log.accumulate(l1->log);
 	l1_log.print_log();
+	if(l1_log.get_total() > 0) result.l1_hit_rate = (double)l1_log._hits / l1_log.get_total();
 
 	printf("\nL2\n");
-	Units::UnitBlockingCache::Log l2_log;
-	for(auto& l2 : l2s)
-		l2_log.accumulate(l2->log);
-	l2_log.print_log();
+	if(config.l2_num_mshr)
+	{
+		Units::UnitNonBlockingCache::Log l2_log;
+		for(auto& l2 : non_blocking_l2s)
+			l2_log.accumulate(l2->log);
+		l2_log.print_log();
+		if(l2_log.get_total() > 0) result.l2_hit_rate = (double)l2_log._hits / l2_log.get_total();
+	}
+	else
+	{
+		Units::UnitBlockingCache::Log l2_log;
+		for(auto& l2 : l2s)
+			l2_log.accumulate(l2->log);
+		l2_log.print_log();
+		if(l2_log.get_total() > 0) result.l2_hit_rate = (double)l2_log._hits / l2_log.get_total();
+	}
+
+	if(!quantum_bridges.empty())
+	{
+		printf("\nQuantum Bridges\n");
+		printf("Quantum: %d\n", quantum);
+		Units::QuantumBridge::Log bridge_log;
+		for(auto& bridge : quantum_bridges)
+			bridge_log.accumulate(bridge->log);
+		bridge_log.print_log();
+
+		//a load picks up the delay of every bridge it crosses on the way out and back. Stores add their delay too so this bounds the error from above
+		uint64_t load_latency_cycles = tp_log.get_load_latency_cycles();
+		printf("Share of Load Latency: %.2f%%\n", load_latency_cycles ? 100.0 * bridge_log.get_delay() / load_latency_cycles : 0.0);
+	}
 
 	printf("\n");
 	mm.print_usimm_stats(CACHE_BLOCK_SIZE, 4, simulator.current_cycle);
+	result.dram_power = mm.total_power_in_watts();
+
+	printf("\n");
+	simulator.print_profile();
 	//tp_log.print_profile(mm._data_u8);
 
-	for(auto& tp : tps) delete tp;
-	for(auto& sfu : sfus) delete sfu;
-	for(auto& l1 : l1s) delete l1;
-	for(auto& l2 : l2s) delete l2;
-	for(auto& ts : thread_schedulers) delete ts;
+	if(config.log_networks)
+	{
+		printf("\n");
+		simulator.print_network_log();
+	}
+
+	if(!config.framebuffer_path.empty())
+	{
+		paddr_t paddr_frame_buffer = reinterpret_cast<paddr_t>(kernel_args.framebuffer);
+		stbi_flip_vertically_on_write(true);
+		mm.dump_as_png_uint8(paddr_frame_buffer, kernel_args.framebuffer_width, kernel_args.framebuffer_height, config.framebuffer_path);
+	}
+
+	return result;
+}
+
+static void run_sim_trax(int argc, char* argv[])
+{
+	TRaXConfig config;
+	TRaXScene scene(!config.restore_checkpoint || config.functional);
+	simulate_trax(config, scene);
+}
 
-	paddr_t paddr_frame_buffer = reinterpret_cast<paddr_t>(kernel_args.framebuffer);
-	stbi_flip_vertically_on_write(true);
-	mm.dump_as_png_uint8(paddr_frame_buffer, kernel_args.framebuffer_width, kernel_args.framebuffer_height, "out.png");
+//Design space exploration. Builds the scene once and simulates every point in the grid. Results go to trax-sweep.csv
+static void run_sweep_trax(int argc, char* argv[])
+{
+	std::vector<TRaXConfig> configs;
+	for(uint l1_size : {16 * 1024, 32 * 1024, 64 * 1024})
+		for(uint l2_size : {256 * 1024, 512 * 1024, 1024 * 1024})
+		{
+			TRaXConfig config;
+			config.l1_size = l1_size;
+			config.l2_size = l2_size;
+			configs.push_back(config);
+		}
+
+	Sweep::Configuration sweep_config;
+	sweep_config.csv_path = "trax-sweep.csv";
+	sweep_config.log_path = "trax-sweep";
+	Sweep sweep(sweep_config);
+
+	TRaXScene scene;
+	sweep.run(configs.size(), [&](uint point_index) -> Sweep::Row
+	{
+		TRaXConfig config = configs[point_index];
+		config.num_threads = sweep.forking() ? sweep.threads_per_point() : 0;
+		config.framebuffer_path = "";
+
+		TRaXResult result = simulate_trax(config, scene);
+
+		Sweep::Row row;
+		row.add("num_tps_per_tm", config.num_tps_per_tm);
+		row.add("num_tms_per_l2", config.num_tms_per_l2);
+		row.add("num_l2", config.num_l2);
+		row.add("l1_size", config.l1_size);
+		row.add("l1_associativity", config.l1_associativity);
+		row.add("l1_replacement_policy", ReplacementPolicy::name(config.l1_replacement_policy));
+		row.add("l1_num_banks", config.l1_num_banks);
+		row.add("l1_num_lfb", config.l1_num_lfb);
+		row.add("l2_size", config.l2_size);
+		row.add("l2_associativity", config.l2_associativity);
+		row.add("l2_replacement_policy", ReplacementPolicy::name(config.l2_replacement_policy));
+		row.add("l2_num_banks", config.l2_num_banks);
+		row.add("l2_num_mshr", config.l2_num_mshr);
+		row.add("l2_num_hit_lfb", config.l2_num_hit_lfb);
+		row.add("l2_topology", (uint)config.l2_network.topology);
+		row.add("quantum", config.quantum);
+		row.add("sample_interval", config.sample_interval);
+		row.add("cycles", result.cycles);
+		row.add("instructions", result.instructions);
+		row.add("ipc", result.cycles > 0 ? (double)result.instructions / result.cycles : 0.0);
+		row.add("l1_hit_rate", result.l1_hit_rate);
+		row.add("l2_hit_rate", result.l2_hit_rate);
+		row.add("dram_power", (double)result.dram_power);
+		row.add("runtime", result.runtime);
+		return row;
+	});
 }
 
 }
\ No newline at end of file
@@ -29,9 +29,10 @@ struct RayBucketBuffer
 class UnitRayStagingBuffer : public UnitMemoryBase
 {
 public:
-	UnitRayStagingBuffer(uint num_tp, uint tm_index, UnitStreamScheduler* stream_scheduler) : UnitMemoryBase(),
+	UnitRayStagingBuffer(uint num_tp, uint tm_index, UnitStreamSchedulerBase* stream_scheduler) : UnitMemoryBase(),
 		_request_network(num_tp, 1), _return_network(num_tp), num_tp(num_tp), tm_index(tm_index), _stream_scheduler(stream_scheduler)
 	{
+		_stream_scheduler->set_return_port_unit(tm_index, this);
 		front_buffer = &ray_buffer[0];
 		back_buffer = &ray_buffer[1];
 		segment_executing_on_tp.resize(num_tp, ~0u);
@@ -41,7 +42,7 @@ private:
 	Casscade<MemoryRequest> _request_network;
 	FIFOArray<MemoryReturn> _return_network;
 
-	UnitStreamScheduler* _stream_scheduler;
+	UnitStreamSchedulerBase* _stream_scheduler;
 
 	uint tm_index;
 	uint num_tp;
@@ -204,6 +205,7 @@ private:
 			ret.dst = reg_addr.u8;
 
 			ret.size = sizeof(WorkItem);
+			ret.source = MemorySource::RSB;
 			ret.port = workitem_request_queue.front();
 
 			WorkItem wi;
@@ -231,6 +233,24 @@ private:
 		_return_network.clock();
 	}
 
+	void get_networks(std::vector<std::pair<const char*, NetworkBase*>>& networks) override
+	{
+		networks.push_back({"Request", &_request_network});
+		networks.push_back({"Return", &_return_network});
+	}
+
+	void serialize(Checkpoint& checkpoint) override
+	{
+		//the buffers swap by pointer so save which one is in front
+		uint front_buffer_index = front_buffer - ray_buffer;
+		checkpoint(front_buffer_index);
+		front_buffer = &ray_buffer[front_buffer_index];
+		back_buffer = &ray_buffer[front_buffer_index ^ 0x1];
+
+		checkpoint(_request_network, _return_network, rgs_complete, ray_buffer, segment_state_map, segment_executing_on_tp);
+		checkpoint(completed_buckets, workitem_request_queue, request_valid, request);
+	}
+
 	bool request_port_write_valid(uint port_index) override
 	{
 		return _request_network.is_write_valid(port_index);
@@ -239,6 +259,7 @@ private:
 	void write_request(const MemoryRequest& request, uint port_index) override
 	{
 		_request_network.write(request, port_index);
+		wake();
 	}
 
 	bool return_port_read_valid(uint port_index) override
@@ -255,6 +276,11 @@ private:
 	{
 		return _return_network.read(port_index);
 	}
+
+	void set_return_port_unit(uint port_index, UnitBase* unit) override
+	{
+		_return_network.set_sink_unit(port_index, unit);
+	}
 };
 
 }}}
\ No newline at end of file
@@ -85,7 +85,7 @@ void UnitStreamScheduler::_proccess_request(uint bank_index)
 		if(!write_buffer.is_full())
 		{
 			write_buffer.write_ray(req.bray);
-			_request_network.read(bank_index);
+			_request_network.pop(bank_index);
 		}
 
 		if(write_buffer.is_full())
@@ -102,13 +102,13 @@ void UnitStreamScheduler::_proccess_request(uint bank_index)
 	{
 		//forward to stream scheduler
 		_scheduler.bucket_complete_queue.push(req.segment);
-		_request_network.read(bank_index);
+		_request_network.pop(bank_index);
 	}
 	else if(req.type == StreamSchedulerRequest::Type::LOAD_BUCKET)
 	{
 		//forward to stream scheduler
 		_scheduler.bucket_request_queue.push(req.port);
-		_request_network.read(bank_index);
+		_request_network.pop(bank_index);
 	}
 	else assert(false);
 }
@@ -154,6 +154,7 @@ void UnitStreamScheduler::_update_scheduler()
 
 			//remove from the active segments
 			_scheduler.active_segments.erase(segment_index);
+			_scheduler.segments_retired++;
 
 			//free the segment state
 			_scheduler.segment_state_map.erase(segment_index);
@@ -214,6 +215,7 @@ void UnitStreamScheduler::_update_scheduler()
 				if(state.total_buckets == 0)
 				{
 					_scheduler.active_segments.erase(_scheduler.current_segment);
+					_scheduler.segments_retired++;
 				}
 				else
 				{
@@ -246,7 +248,6 @@ void UnitStreamScheduler::_update_scheduler()
 				_scheduler.active_segments.insert(next_segment);
 				_scheduler.current_segment = next_segment;
 
-				printf("Segment %d scheduled\n", _scheduler.current_segment);
 			}
 		}
 	}
@@ -269,7 +270,7 @@ void UnitStreamScheduler::_update_scheduler()
 		channel_work_item.is_read = false;
 		channel_work_item.address = bucket_adddress;
 		channel_work_item.bucket = bucket;
-		_scheduler.bucket_write_cascade.read(0);
+		_scheduler.bucket_write_cascade.pop(0);
 
 		Channel& channel = _channels[channel_index];
 		channel.work_queue.push(channel_work_item);
@@ -356,4 +357,9 @@ void UnitStreamScheduler::_issue_return(uint channel_index)
 	}
 }
 
+void UnitStreamScheduler::serialize(Checkpoint& checkpoint)
+{
+	checkpoint(_request_network, _banks, _scheduler, _channels, _return_network);
+}
+
 }}}
\ No newline at end of file
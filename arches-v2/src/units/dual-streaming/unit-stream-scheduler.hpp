@@ -4,6 +4,7 @@
 #include "../unit-base.hpp"
 #include "../unit-dram.hpp"
 #include "../unit-buffer.hpp"
+#include "../unit-quantum-bridge.hpp"
 
 #include "../../../../dual-streaming-benchmark/src/include.hpp"
 
@@ -34,7 +35,24 @@ struct alignas(RAY_BUCKET_SIZE) RayBucket
 	}
 };
 
-class UnitStreamScheduler : public UnitBase
+//Ports the ray staging buffers see. Lets a quantum bridge stand in for the stream scheduler
+class UnitStreamSchedulerBase : public UnitBase
+{
+public:
+	//Should only be used on clock fall
+	virtual bool request_port_write_valid(uint port_index) = 0;
+	virtual void write_request(const StreamSchedulerRequest& request, uint port_index) = 0;
+
+	//Should only be used on clock rise
+	virtual bool return_port_read_valid(uint port_index) = 0;
+	virtual const MemoryReturn& peek_return(uint port_index) = 0;
+	virtual const MemoryReturn read_return(uint port_index) = 0;
+
+	//Unit to wake when a return arrives at the port
+	virtual void set_return_port_unit(uint port_index, UnitBase* unit) = 0;
+};
+
+class UnitStreamScheduler : public UnitStreamSchedulerBase
 {
 public:
 	struct Configuration
@@ -44,37 +62,46 @@ public:
 
 		uint num_tms;
 		uint num_banks;
+		NetworkConfiguration network{}; //topology between the TMs and the banks
 
-		UnitMainMemoryBase* main_mem;
-		uint                main_mem_port_offset{0};
-		uint                main_mem_port_stride{1};
+		UnitMemoryBase* main_mem;
+		uint            main_mem_port_offset{0};
+		uint            main_mem_port_stride{1};
 	};
 
 private:
-	class StreamSchedulerRequestCrossbar : public CasscadedCrossBar<StreamSchedulerRequest>
+	struct StreamSchedulerRouter
 	{
-	public:
-		StreamSchedulerRequestCrossbar(uint ports, uint banks) : CasscadedCrossBar<StreamSchedulerRequest>(ports, banks, banks) {}
+		uint ports;
+		uint banks;
 
-		uint get_sink(const StreamSchedulerRequest& request) override
+		uint get_sink(const StreamSchedulerRequest& request) const
 		{
 			if(request.type == StreamSchedulerRequest::Type::STORE_WORKITEM)
 			{
 				//if this is a workitem write or bucket completed then distrbute across banks
-				return request.segment % num_sinks();
+				return request.segment % banks;
 			}
 			else
 			{
 				//otherwise cascade
-				return request.port * num_sinks() / num_sources();
+				return request.port * banks / ports;
 			}
 		}
 	};
 
+	class StreamSchedulerRequestCrossbar : public TopologyNetwork<StreamSchedulerRequest, StreamSchedulerRouter>
+	{
+	public:
+		StreamSchedulerRequestCrossbar(uint ports, uint banks, const NetworkConfiguration& network) : TopologyNetwork<StreamSchedulerRequest, StreamSchedulerRouter>(ports, banks, banks, network, {ports, banks}) {}
+	};
+
 	struct Bank
 	{
 		std::queue<uint> bucket_flush_queue;
 		std::map<uint, RayBucket> ray_coalescer{};
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(bucket_flush_queue, ray_coalescer); }
 	};
 
 	class MemoryManager
@@ -107,6 +134,11 @@ private:
 			free_buckets.push(bucket_address);
 		}
 
+		void serialize(Checkpoint& checkpoint)
+		{
+			checkpoint(next_bucket_addr, free_buckets);
+		}
+
 		MemoryManager(uint channel_index, paddr_t start_address)
 		{
 			next_bucket_addr = align_to(ROW_BUFFER_SIZE, start_address);
@@ -122,6 +154,8 @@ private:
 		uint                total_buckets{0};
 		uint                active_buckets{0};
 		bool                parent_finished{false};
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(bucket_address_queue, next_channel, total_buckets, active_buckets, parent_finished); }
 	};
 
 	struct Scheduler
@@ -141,6 +175,7 @@ private:
 		std::set<uint>   active_segments;
 		uint             current_segment{0};
 		std::priority_queue<uint, std::vector<uint>, std::greater<uint>> candidate_segments;
+		uint64_t         segments_retired{0};
 
 		Scheduler(const Configuration& config) : bucket_write_cascade(config.num_banks, 1)
 		{
@@ -162,6 +197,12 @@ private:
 		{
 			return active_segments.size() == 0 && candidate_segments.size() == 0;
 		}
+
+		void serialize(Checkpoint& checkpoint)
+		{
+			checkpoint(bucket_allocated_queue, bucket_request_queue, bucket_complete_queue, bucket_write_cascade);
+			checkpoint(segment_state_map, memory_managers, active_segments, current_segment, candidate_segments, segments_retired);
+		}
 	};
 
 	struct Channel
@@ -194,11 +235,13 @@ private:
 		//forwarding
 		MemoryReturn forward_return{};
 		bool forward_return_valid{false};
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(work_queue, stream_state, bytes_requested, forward_return, forward_return_valid); }
 	};
 
-	UnitMainMemoryBase* _main_mem;
-	uint                _main_mem_port_offset;
-	uint                _main_mem_port_stride;
+	UnitMemoryBase* _main_mem;
+	uint            _main_mem_port_offset;
+	uint            _main_mem_port_stride;
 
 	//request flow from _request_network -> bank -> scheduler -> channel
 	StreamSchedulerRequestCrossbar _request_network;
@@ -208,41 +251,61 @@ private:
 	UnitMemoryBase::ReturnCrossBar _return_network;
 
 public:
-	UnitStreamScheduler(const Configuration& config) :_request_network(config.num_tms, config.num_banks), _banks(config.num_banks), _scheduler(config), _channels(NUM_DRAM_CHANNELS), _return_network(config.num_tms, NUM_DRAM_CHANNELS)
+	UnitStreamScheduler(const Configuration& config) :_request_network(config.num_tms, config.num_banks, config.network), _banks(config.num_banks), _scheduler(config), _channels(NUM_DRAM_CHANNELS), _return_network(config.num_tms, NUM_DRAM_CHANNELS, config.network)
 	{
 		_main_mem = config.main_mem;
 		_main_mem_port_offset = config.main_mem_port_offset;
 		_main_mem_port_stride = config.main_mem_port_stride;
+
+		for(uint channel_index = 0; channel_index < _channels.size(); ++channel_index)
+			_main_mem->set_return_port_unit(channel_index * _main_mem_port_stride + _main_mem_port_offset, this);
 	}
 
+	//Only for progress reporting
+	uint64_t segments_retired() { return _scheduler.segments_retired; }
+
 	void clock_rise() override;
 	void clock_fall() override;
+	void serialize(Checkpoint& checkpoint) override;
 
-	bool request_port_write_valid(uint port_index)
+	void get_networks(std::vector<std::pair<const char*, NetworkBase*>>& networks) override
+	{
+		networks.push_back({"Request", &_request_network});
+		networks.push_back({"Return", &_return_network});
+		networks.push_back({"Bucket Write", &_scheduler.bucket_write_cascade});
+	}
+
+	bool request_port_write_valid(uint port_index) override
 	{
 		return _request_network.is_write_valid(port_index);
 	}
 
-	void write_request(const StreamSchedulerRequest& request, uint port_index)
+	void write_request(const StreamSchedulerRequest& request, uint port_index) override
 	{
 		_request_network.write(request, port_index);
+		wake();
 	}
 
-	bool return_port_read_valid(uint port_index)
+	bool return_port_read_valid(uint port_index) override
 	{
 		return _return_network.is_read_valid(port_index);
 	}
 
-	const MemoryReturn& peek_return(uint port_index)
+	const MemoryReturn& peek_return(uint port_index) override
 	{
 		return _return_network.peek(port_index);
 	}
 
-	const MemoryReturn read_return(uint port_index)
+	const MemoryReturn read_return(uint port_index) override
 	{
 		return _return_network.read(port_index);
 	}
 
+	void set_return_port_unit(uint port_index, UnitBase* unit) override
+	{
+		_return_network.set_sink_unit(port_index, unit);
+	}
+
 private:
 	void _proccess_request(uint bank_index);
 	void _proccess_return(uint channel_index);
@@ -251,4 +314,7 @@ private:
 	void _issue_return(uint channel_index);
 };
 
+//Bridge in front of the stream scheduler for the ray staging buffers in quantum mode
+using UnitStreamSchedulerBridge = UnitQuantumBridgeBase<StreamSchedulerRequest, UnitStreamSchedulerBase>;
+
 }}}
\ No newline at end of file
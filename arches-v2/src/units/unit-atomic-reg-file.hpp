@@ -19,6 +19,58 @@ private:
 	Casscade<MemoryRequest> _request_network;
 	FIFOArray<MemoryReturn> _return_network;
 
+	//Applies the request to the registers and returns the old value
+	uint32_t _execute(const MemoryRequest& request)
+	{
+		uint32_t reg_index = (request.paddr >> 2) & 0b1'1111;
+		uint32_t request_data = request.data_u32;
+		uint32_t ret_val = _iregs[reg_index];
+
+		switch(request.type)
+		{
+		case MemoryRequest::Type::STORE:
+			_iregs[reg_index] = request_data;
+			break;
+
+		case MemoryRequest::Type::LOAD:
+			break;
+
+		case MemoryRequest::Type::AMO_ADD:
+			_iregs[reg_index] += request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_AND:
+			_iregs[reg_index] &= request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_OR:
+			_iregs[reg_index] |= request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_XOR:
+			_iregs[reg_index] ^= request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_MIN:
+			_iregs[reg_index] = std::min((int32_t)request_data, (int32_t)_iregs[reg_index]);
+			break;
+
+		case MemoryRequest::Type::AMO_MAX:
+			_iregs[reg_index] = std::max((int32_t)request_data, (int32_t)_iregs[reg_index]);
+			break;
+
+		case MemoryRequest::Type::AMO_MINU:
+			_iregs[reg_index] = std::min(request_data, _iregs[reg_index]);
+			break;
+		
+		case MemoryRequest::Type::AMO_MAXU:
+			_iregs[reg_index] = std::max(request_data, _iregs[reg_index]);
+			break;
+		}
+
+		return ret_val;
+	}
+
 public:
 	UnitAtomicRegfile(uint num_clients) : UnitMemoryBase(),
 		_request_network(num_clients, 1), _return_network(num_clients)
@@ -27,6 +79,9 @@ public:
 			_iregs[i] = 0;
 	}
 
+	//Only for progress reporting
+	uint32_t get_register(uint index) { return _iregs[index]; }
+
 	void clock_rise() override
 	{
 		_request_network.clock();
@@ -36,6 +91,8 @@ public:
 			_current_request = _request_network.read(0);
 			_current_request_valid = true;
 		}
+
+		if(!_current_request_valid && _request_network.empty()) sleep();
 	}
 
 	void clock_fall() override
@@ -44,53 +101,7 @@ public:
 		{
 			if(_current_request.type != MemoryRequest::Type::STORE && !_return_network.is_write_valid(0)) return;
 
-			uint32_t reg_index = (_current_request.paddr >> 2) & 0b1'1111;
-			uint32_t request_data = _current_request.data_u32;
-			uint32_t ret_val = _iregs[reg_index];
-
-			switch(_current_request.type)
-			{
-			case MemoryRequest::Type::STORE:
-				_iregs[reg_index] = request_data;
-				break;
-
-			case MemoryRequest::Type::LOAD:
-				break;
-
-			case MemoryRequest::Type::AMO_ADD:
-				_iregs[reg_index] += request_data;
-				if(ret_val % 64 == 0) 
-					printf("Tiles Launched: %d\n", ret_val);
-				break;
-
-			case MemoryRequest::Type::AMO_AND:
-				_iregs[reg_index] &= request_data;
-				break;
-
-			case MemoryRequest::Type::AMO_OR:
-				_iregs[reg_index] |= request_data;
-				break;
-
-			case MemoryRequest::Type::AMO_XOR:
-				_iregs[reg_index] ^= request_data;
-				break;
-
-			case MemoryRequest::Type::AMO_MIN:
-				_iregs[reg_index] = std::min((int32_t)request_data, (int32_t)_iregs[reg_index]);
-				break;
-
-			case MemoryRequest::Type::AMO_MAX:
-				_iregs[reg_index] = std::max((int32_t)request_data, (int32_t)_iregs[reg_index]);
-				break;
-
-			case MemoryRequest::Type::AMO_MINU:
-				_iregs[reg_index] = std::min(request_data, _iregs[reg_index]);
-				break;
-			
-			case MemoryRequest::Type::AMO_MAXU:
-				_iregs[reg_index] = std::max(request_data, _iregs[reg_index]);
-				break;
-			}
+			uint32_t ret_val = _execute(_current_request);
 
 			if(_current_request.type != MemoryRequest::Type::STORE)
 			{
@@ -104,6 +115,26 @@ public:
 		_return_network.clock();
 	}
 
+	void get_networks(std::vector<std::pair<const char*, NetworkBase*>>& networks) override
+	{
+		networks.push_back({"Request", &_request_network});
+		networks.push_back({"Return", &_return_network});
+	}
+
+	void serialize(Checkpoint& checkpoint) override
+	{
+		checkpoint(_iregs, _current_request_valid, _current_request, _request_network, _return_network);
+	}
+
+	bool functional_request(const MemoryRequest& request, MemoryReturn& ret) override
+	{
+		uint32_t ret_val = _execute(request);
+		if(request.type == MemoryRequest::Type::STORE) return false;
+
+		ret = MemoryReturn(request, &ret_val);
+		return true;
+	}
+
 	bool request_port_write_valid(uint port_index) override
 	{
 		return _request_network.is_write_valid(port_index);
@@ -112,6 +143,7 @@ public:
 	void write_request(const MemoryRequest& request, uint port_index) override
 	{
 		_request_network.write(request, port_index);
+		wake();
 	}
 
 	bool return_port_read_valid(uint port_index) override
@@ -128,6 +160,11 @@ public:
 	{
 		return _return_network.read(port_index);
 	}
+
+	void set_return_port_unit(uint port_index, UnitBase* unit) override
+	{
+		_return_network.set_sink_unit(port_index, unit);
+	}
 };
 
 }}
\ No newline at end of file
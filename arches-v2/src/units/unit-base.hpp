@@ -3,7 +3,11 @@
 
 #include "../simulator/simulator.hpp"
 
-namespace Arches { namespace Units {
+namespace Arches {
+
+class NetworkBase;
+
+namespace Units {
 
 class UnitBase
 {
@@ -12,8 +16,43 @@ public:
 
 	Simulator* simulator{nullptr};
 	uint64_t   unit_id{~0ull};
+	uint       group_index{~0u};
 	virtual void clock_rise() = 0;
 	virtual void clock_fall() = 0;
+
+	//Saves or restores everything about the unit that changes after construction
+	virtual void serialize(Checkpoint& checkpoint) = 0;
+
+	//Sampled simulation. Units that run programs execute one instruction with no timing while the simulator fast forwards between detailed windows.
+	//Returns false once the unit has nothing left to execute
+	virtual bool step_functional() { return false; }
+	virtual uint64_t instructions_issued() { return 0; }
+
+	//Interconnects the unit owns and clocks, named for the end of run network report. Units that don't list any are left out of it
+	virtual void get_networks(std::vector<std::pair<const char*, NetworkBase*>>&) {}
+
+	//Sleeping units are skipped by the simulator until something writes to one of their ports or the simulator reaches their wake cycle.
+	//Port writes happen on clock fall so units should only go to sleep on clock rise and only when their clock fall would do nothing.
+	bool is_awake() { return _awake.load(std::memory_order_relaxed); }
+	void wake() { if(!is_awake()) _awake.store(true, std::memory_order_relaxed); }
+	cycles_t wake_cycle() { return _wake_cycle; }
+
+	//Cycle the unit's group is on. Only differs from simulator->current_cycle while groups run ahead of each other in quantum mode
+	cycles_t group_cycle() { return simulator->get_group_cycle(group_index); }
+
+protected:
+	void sleep() { sleep_until(INT64_MAX); }
+	void sleep_until(cycles_t cycle)
+	{
+		_wake_cycle = cycle;
+		_awake.store(false, std::memory_order_relaxed);
+	}
+
+private:
+	friend class Arches::Simulator;
+
+	std::atomic_bool _awake{true};
+	cycles_t _wake_cycle{INT64_MAX};
 };
 
 }}
\ No newline at end of file
@@ -3,14 +3,18 @@
 namespace Arches {namespace Units {
 
 UnitBlockingCache::UnitBlockingCache(Configuration config) : 
-	UnitCacheBase(config.size, config.associativity),
-	_request_cross_bar(config.num_ports, config.num_banks, config.bank_select_mask),
-	_return_cross_bar(config.num_ports, config.num_banks),
+	UnitCacheBase(config.size, config.associativity, config.replacement_policy),
+	_request_cross_bar(config.num_ports, config.num_banks, config.bank_select_mask, config.network),
+	_return_cross_bar(config.num_ports, config.num_banks, config.network),
 	_banks(config.num_banks, config.data_array_latency)
 {
 	_mem_higher = config.mem_higher;
 	_mem_higher_port_offset = config.mem_higher_port_offset;
 	_mem_higher_port_stride = config.mem_higher_port_stride;
+	_hit_source = cache_source(config.level, false);
+
+	for(uint bank_index = 0; bank_index < _banks.size(); ++bank_index)
+		_mem_higher->set_return_port_unit(bank_index * _mem_higher_port_stride + _mem_higher_port_offset, this);
 }
 
 UnitBlockingCache::~UnitBlockingCache()
@@ -27,6 +31,7 @@ void UnitBlockingCache::_clock_rise(uint bank_index)
 	{
 		if(!_request_cross_bar.is_read_valid(bank_index) || !bank.data_array_pipline.is_write_valid()) return;
 		bank.current_request = _request_cross_bar.read(bank_index);
+		TraceWriter::record(bank.current_request.id, TraceStage::CACHE_BANK, group_cycle());
 
 		if(bank.current_request.type == MemoryRequest::Type::LOAD)
 		{
@@ -38,6 +43,7 @@ void UnitBlockingCache::_clock_rise(uint bank_index)
 			if(block_data)
 			{
 				MemoryReturn ret(bank.current_request, block_data->bytes + block_offset);
+				ret.source = _hit_source;
 				bank.data_array_pipline.write(ret);
 				bank.state = Bank::State::IDLE;
 				log.log_hit();
@@ -70,6 +76,7 @@ void UnitBlockingCache::_clock_rise(uint bank_index)
 
 		uint block_offset = _get_block_offset(bank.current_request.paddr);
 		std::memcpy(bank.current_request.data, &ret.data[block_offset], bank.current_request.size);
+		bank.fill_source = ret.source;
 
 		bank.state = Bank::State::FILLED;	
 	}
@@ -90,6 +97,7 @@ void UnitBlockingCache::_clock_fall(uint bank_index)
 				request.size = CACHE_BLOCK_SIZE;
 				request.paddr = _get_block_addr(bank.current_request.paddr);
 				request.port = mem_higher_port_index;
+				request.id = bank.current_request.id;
 				_mem_higher->write_request(request, request.port);
 				bank.state = Bank::State::ISSUED;
 			}
@@ -111,6 +119,7 @@ void UnitBlockingCache::_clock_fall(uint bank_index)
 		{
 			//early restart
 			MemoryReturn ret(bank.current_request, bank.current_request.data);
+			ret.source = bank.fill_source;
 			_return_cross_bar.write(ret, bank_index);
 			bank.state = Bank::State::IDLE;
 		}
@@ -124,6 +133,23 @@ void UnitBlockingCache::_clock_fall(uint bank_index)
 }
 
 
+bool UnitBlockingCache::_is_idle()
+{
+	if(!_request_cross_bar.is_idle() || !_return_cross_bar.is_idle()) return false;
+
+	for(uint bank_index = 0; bank_index < _banks.size(); ++bank_index)
+	{
+		Bank& bank = _banks[bank_index];
+		if(!bank.data_array_pipline.empty()) return false;
+
+		//issued banks are waiting on mem higher which will wake us when the return arrives
+		if(bank.state == Bank::State::ISSUED) continue;
+		if(bank.state != Bank::State::IDLE || _request_cross_bar.is_read_valid(bank_index)) return false;
+	}
+
+	return true;
+}
+
 void UnitBlockingCache::clock_rise()
 {
 	_request_cross_bar.clock();
@@ -132,6 +158,8 @@ void UnitBlockingCache::clock_rise()
 	{
 		_clock_rise(i);
 	}
+
+	if(_is_idle()) sleep();
 }
 
 void UnitBlockingCache::clock_fall()
@@ -152,6 +180,7 @@ bool UnitBlockingCache::request_port_write_valid(uint port_index)
 void UnitBlockingCache::write_request(const MemoryRequest& request, uint port_index)
 {
 	_request_cross_bar.write(request, port_index);
+	wake();
 }
 
 bool UnitBlockingCache::return_port_read_valid(uint port_index)
@@ -169,4 +198,15 @@ const MemoryReturn UnitBlockingCache::read_return(uint port_index)
 	return _return_cross_bar.read(port_index);
 }
 
+void UnitBlockingCache::set_return_port_unit(uint port_index, UnitBase* unit)
+{
+	_return_cross_bar.set_sink_unit(port_index, unit);
+}
+
+void UnitBlockingCache::serialize(Checkpoint& checkpoint)
+{
+	UnitCacheBase::serialize(checkpoint);
+	checkpoint(_banks, _request_cross_bar, _return_cross_bar, log);
+}
+
 }}
\ No newline at end of file
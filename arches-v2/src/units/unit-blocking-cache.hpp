@@ -12,16 +12,20 @@ public:
 	{
 		uint size{1024};
 		uint associativity{1};
+		ReplacementPolicy::Type replacement_policy{ReplacementPolicy::Type::LRU};
 
 		uint data_array_latency{0};
 
 		uint num_ports{1};
 		uint num_banks{1};
 		uint64_t bank_select_mask{0};
+		NetworkConfiguration network{}; //topology between the ports and the banks
 
 		UnitMemoryBase* mem_higher{nullptr};
 		uint            mem_higher_port_offset{0};
 		uint            mem_higher_port_stride{1};
+
+		uint level{1}; //position in the hierarchy. Returns are tagged with it so the TPs know what served them
 	};
 
 	UnitBlockingCache(Configuration config);
@@ -29,6 +33,13 @@ public:
 
 	void clock_rise() override;
 	void clock_fall() override;
+	void serialize(Checkpoint& checkpoint) override;
+
+	void get_networks(std::vector<std::pair<const char*, NetworkBase*>>& networks) override
+	{
+		networks.push_back({"Request", &_request_cross_bar});
+		networks.push_back({"Return", &_return_cross_bar});
+	}
 
 	bool request_port_write_valid(uint port_index) override;
 	void write_request(const MemoryRequest& request, uint port_index) override;
@@ -36,6 +47,9 @@ public:
 	bool return_port_read_valid(uint port_index) override;
 	const MemoryReturn& peek_return(uint port_index) override;
 	const MemoryReturn read_return(uint port_index) override;
+	void set_return_port_unit(uint port_index, UnitBase* unit) override;
+
+	bool functional_request(const MemoryRequest& request, MemoryReturn& ret) override { return _functional_request(request, ret, _mem_higher); }
 
 private:
 	struct Bank
@@ -49,10 +63,15 @@ private:
 		}
 		state{State::IDLE};
 		MemoryRequest current_request{};
+		MemorySource fill_source{MemorySource::OTHER};
 		Pipline<MemoryReturn> data_array_pipline;
 		Bank(uint data_array_latency) : data_array_pipline(data_array_latency) {}
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(state, current_request, fill_source, data_array_pipline); }
 	};
 
+	MemorySource _hit_source;
+
 	std::vector<Bank> _banks;
 	RequestCrossBar _request_cross_bar;
 	ReturnCrossBar _return_cross_bar;
@@ -64,6 +83,8 @@ private:
 	void _clock_rise(uint bank_index);
 	void _clock_fall(uint bank_index);
 
+	bool _is_idle();
+
 public:
 	class Log
 	{
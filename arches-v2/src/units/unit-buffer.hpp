@@ -16,6 +16,7 @@ public:
 		uint num_ports{1};
 		uint num_banks{1};
 		uint64_t bank_select_mask{0};
+		NetworkConfiguration network{}; //topology between the ports and the banks
 		uint latency{1};
 	};
 
@@ -24,6 +25,8 @@ private:
 	{
 		Pipline<MemoryRequest> data_pipline;
 		Bank(uint latency) : data_pipline(latency, 1) {}
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(data_pipline); }
 	};
 
 	uint8_t* _data_u8;
@@ -35,7 +38,7 @@ private:
 
 public:
 	UnitBuffer(Configuration config) : UnitMemoryBase(),
-		_request_cross_bar(config.num_ports, config.num_banks, config.bank_select_mask), _return_cross_bar(config.num_ports, config.num_banks), _banks(config.num_banks, config.latency)
+		_request_cross_bar(config.num_ports, config.num_banks, config.bank_select_mask, config.network), _return_cross_bar(config.num_ports, config.num_banks, config.network), _banks(config.num_banks, config.latency)
 	{
 		_data_u8 = (uint8_t*)malloc(config.size);
 		_buffer_address_mask = generate_nbit_mask(log2i(config.size));
@@ -58,6 +61,8 @@ public:
 			if(!bank.data_pipline.is_write_valid() || !_request_cross_bar.is_read_valid(bank_index)) continue;
 			bank.data_pipline.write(_request_cross_bar.read(bank_index));
 		}
+
+		if(_is_idle()) sleep();
 	}
 
 	void clock_fall() override
@@ -87,6 +92,18 @@ public:
 		_return_cross_bar.clock();
 	}
 
+	void get_networks(std::vector<std::pair<const char*, NetworkBase*>>& networks) override
+	{
+		networks.push_back({"Request", &_request_cross_bar});
+		networks.push_back({"Return", &_return_cross_bar});
+	}
+
+	void serialize(Checkpoint& checkpoint) override
+	{
+		checkpoint(_banks, _request_cross_bar, _return_cross_bar);
+		checkpoint.bytes(_data_u8, _buffer_address_mask + 1);
+	}
+
 	bool request_port_write_valid(uint port_index) override
 	{
 		return _request_cross_bar.is_write_valid(port_index);
@@ -96,6 +113,7 @@ public:
 	{
 		assert(request.port == port_index);
 		_request_cross_bar.write(request, port_index);
+		wake();
 	}
 
 	bool return_port_read_valid(uint port_index) override
@@ -113,8 +131,23 @@ public:
 		return _return_cross_bar.read(port_index);
 	}
 
+	void set_return_port_unit(uint port_index, UnitBase* unit) override
+	{
+		_return_cross_bar.set_sink_unit(port_index, unit);
+	}
+
 private:
 	paddr_t _get_buffer_addr(paddr_t paddr) { return paddr & _buffer_address_mask; }
+
+	bool _is_idle()
+	{
+		if(!_request_cross_bar.empty() || !_return_cross_bar.is_idle()) return false;
+
+		for(Bank& bank : _banks)
+			if(!bank.data_pipline.empty()) return false;
+
+		return true;
+	}
 };
 
 }}
\ No newline at end of file
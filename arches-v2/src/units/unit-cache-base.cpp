@@ -2,14 +2,15 @@
 
 namespace Arches {namespace Units {
 
-UnitCacheBase::UnitCacheBase(size_t size, uint associativity) : UnitMemoryBase()
+UnitCacheBase::UnitCacheBase(size_t size, uint associativity, ReplacementPolicy::Type replacement_policy) : UnitMemoryBase()
 {
-	_tag_array.resize(size / CACHE_BLOCK_SIZE);
+	_tag_array.resize(size / CACHE_BLOCK_SIZE, INVALID_TAG);
 	_data_array.resize(size / CACHE_BLOCK_SIZE);
 
 	_associativity = associativity;
 
 	uint num_sets = size / (CACHE_BLOCK_SIZE * associativity);
+	_replacement_policy = ReplacementPolicy::create(replacement_policy, num_sets, associativity);
 
 	uint offset_bits = log2i(CACHE_BLOCK_SIZE);
 	uint set_index_bits = log2i(num_sets);
@@ -28,68 +29,93 @@ UnitCacheBase::~UnitCacheBase()
 
 }
 
-//update lru and returns data pointer to cache line
-UnitCacheBase::BlockData* UnitCacheBase::_get_block(paddr_t paddr)
+//returns a mask with a bit set for every way of the set holding tag
+uint64_t UnitCacheBase::_match_ways(uint set_index, uint64_t tag)
 {
-	uint start = _get_set_index(paddr) * _associativity;
-	uint end = start + _associativity;
+	const uint64_t* tags = &_tag_array[set_index * _associativity];
+	uint64_t mask = 0x0ull;
+	uint way = 0;
 
-	uint64_t tag = _get_tag(paddr);
+#if defined(__AVX2__)
+	__m256i tag4 = _mm256_set1_epi64x(tag);
+	for(; way + 4 <= _associativity; way += 4)
+	{
+		__m256i ways = _mm256_loadu_si256((const __m256i*)(tags + way));
+		mask |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(ways, tag4))) << way;
+	}
+#endif
 
-	uint found_index = ~0;
-	uint found_lru = 0;
-	for(uint i = start; i < end; ++i)
+#if defined(__AVX2__) || defined(__AVX__) || defined(__SSE4_1__)
+	__m128i tag2 = _mm_set1_epi64x(tag);
+	for(; way + 2 <= _associativity; way += 2)
 	{
-		if(_tag_array[i].valid && _tag_array[i].tag == tag)
-		{
-			found_index = i;
-			found_lru = _tag_array[i].lru;
-			break;
-		}
+		__m128i ways = _mm_loadu_si128((const __m128i*)(tags + way));
+		mask |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(ways, tag2))) << way;
 	}
+#endif
 
-	if(found_index == ~0) return nullptr; //didn't find line so we will leave lru alone and return nullptr
+	for(; way < _associativity; ++way)
+		mask |= (uint64_t)(tags[way] == tag) << way;
 
-	for(uint i = start; i < end; ++i)
-		if(_tag_array[i].lru < found_lru) _tag_array[i].lru++;
+	return mask;
+}
 
-	_tag_array[found_index].lru = 0;
+//update replacement state and returns data pointer to cache line
+UnitCacheBase::BlockData* UnitCacheBase::_get_block(paddr_t paddr)
+{
+	uint set_index = _get_set_index(paddr);
+	uint64_t mask = _match_ways(set_index, _get_tag(paddr));
+	if(!mask) return nullptr; //didn't find line so we will leave the replacement state alone and return nullptr
 
-	return &_data_array[found_index];
+	uint way = ctz(mask);
+	_replacement_policy->touch(set_index, way);
+	return &_data_array[set_index * _associativity + way];
 }
 
-//inserts cacheline associated with paddr replacing least recently used. Assumes cachline isn't already in cache if it is this has undefined behaviour
+//inserts cacheline associated with paddr into an invalid way or the replacement policy's victim. Assumes cachline isn't already in cache if it is this has undefined behaviour
 UnitCacheBase::BlockData* UnitCacheBase::_insert_block(paddr_t paddr, const uint8_t* data)
 {
-	uint start = _get_set_index(paddr) * _associativity;
-	uint end = start + _associativity;
+	uint set_index = _get_set_index(paddr);
+	uint64_t invalid_mask = _match_ways(set_index, INVALID_TAG);
+	uint way = invalid_mask ? ctz(invalid_mask) : _replacement_policy->victim(set_index);
+	_replacement_policy->insert(set_index, way);
+
+	uint replacement_index = set_index * _associativity + way;
+	_tag_array[replacement_index] = _get_tag(paddr);
+
+	std::memcpy(_data_array[replacement_index].bytes, data, CACHE_BLOCK_SIZE);
+	return &_data_array[replacement_index];
+}
+
+bool UnitCacheBase::_functional_request(const MemoryRequest& request, MemoryReturn& ret, UnitMemoryBase* mem_higher)
+{
+	//stores and atomics go through to memory
+	if(request.type != MemoryRequest::Type::LOAD)
+		return mem_higher->functional_request(request, ret);
 
-	uint replacement_index = ~0u;
-	uint replacement_lru = 0u;
-	for(uint i = start; i < end; ++i)
+	paddr_t block_addr = _get_block_addr(request.paddr);
+	BlockData* block_data = _get_block(block_addr);
+	if(!block_data)
 	{
-		if(!_tag_array[i].valid)
-		{
-			replacement_index = i;
-			break;
-		}
-		
-		if(_tag_array[i].lru >= replacement_lru)
-		{
-			replacement_lru = _tag_array[i].lru;
-			replacement_index = i;
-		}
+		//the data array holds real data so warming fills the block as well as the tag
+		MemoryRequest block_request;
+		block_request.type = MemoryRequest::Type::LOAD;
+		block_request.size = CACHE_BLOCK_SIZE;
+		block_request.paddr = block_addr;
+		block_request.port = request.port;
+
+		MemoryReturn block_return;
+		mem_higher->functional_request(block_request, block_return);
+		block_data = _insert_block(block_addr, block_return.data);
 	}
 
-	for(uint i = start; i < end; ++i)
-		_tag_array[i].lru++;
-
-	_tag_array[replacement_index].lru = 0;
-	_tag_array[replacement_index].valid = true;
-	_tag_array[replacement_index].tag = _get_tag(paddr);
+	ret = MemoryReturn(request, block_data->bytes + _get_block_offset(request.paddr));
+	return true;
+}
 
-	std::memcpy(_data_array[replacement_index].bytes, data, CACHE_BLOCK_SIZE);
-	return &_data_array[replacement_index];
+void UnitCacheBase::serialize(Checkpoint& checkpoint)
+{
+	checkpoint(_tag_array, _data_array, *_replacement_policy);
 }
 
 }}
\ No newline at end of file
@@ -3,28 +3,19 @@
 
 #include "unit-memory-base.hpp"
 #include "../util/bit-manipulation.hpp"
+#include "../util/replacement-policy.hpp"
 
 namespace Arches { namespace Units {
 
 class UnitCacheBase : public UnitMemoryBase
 {
 public:
-	UnitCacheBase(size_t size, uint associativity);
+	UnitCacheBase(size_t size, uint associativity, ReplacementPolicy::Type replacement_policy = ReplacementPolicy::Type::LRU);
 	virtual ~UnitCacheBase();
 
-protected:
-	struct BlockMetaData
-	{
-		uint64_t tag     : 59;
-		uint64_t lru     : 4;
-		uint64_t valid   : 1;
-
-		BlockMetaData()
-		{
-			valid = 0;
-		}
-	};
+	void serialize(Checkpoint& checkpoint) override;
 
+protected:
 	struct alignas(CACHE_BLOCK_SIZE) BlockData
 	{
 		uint8_t bytes[CACHE_BLOCK_SIZE];
@@ -33,13 +24,21 @@ protected:
 	uint64_t _set_index_mask, _tag_mask, _block_offset_mask;
 	uint _set_index_offset, _tag_offset;
 
+	//tags are never wider than 58 bits so no address maps to the invalid tag
+	static constexpr uint64_t INVALID_TAG = ~0x0ull;
+
 	uint _associativity;
-	std::vector<BlockMetaData> _tag_array;
+	std::vector<uint64_t> _tag_array; //a set's tags are contiguous so one compare covers the set
 	std::vector<BlockData> _data_array;
+	std::unique_ptr<ReplacementPolicy> _replacement_policy;
 
+	uint64_t _match_ways(uint set_index, uint64_t tag);
 	BlockData* _get_block(paddr_t paddr);
 	BlockData* _insert_block(paddr_t paddr, const uint8_t* data);
 
+	//Loads fill the block from mem_higher on a miss and stores go around like they do in the detailed model
+	bool _functional_request(const MemoryRequest& request, MemoryReturn& ret, UnitMemoryBase* mem_higher);
+
 	paddr_t _get_block_offset(paddr_t paddr) { return  (paddr >> 0) & _block_offset_mask; }
 	paddr_t _get_block_addr(paddr_t paddr) { return paddr & ~_block_offset_mask; }
 	paddr_t _get_set_index(paddr_t paddr) { return  (paddr >> _set_index_offset) & _set_index_mask; }
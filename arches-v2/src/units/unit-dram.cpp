@@ -33,6 +33,7 @@ bool UnitDRAM::request_port_write_valid(uint port_index)
 void UnitDRAM::write_request(const MemoryRequest& request, uint port_index)
 {
 	_request_network.write(request, port_index);
+	wake();
 }
 
 bool UnitDRAM::return_port_read_valid(uint port_index)
@@ -50,6 +51,11 @@ const MemoryReturn UnitDRAM::read_return(uint port_index)
 	return _return_network.read(port_index);
 }
 
+void UnitDRAM::set_return_port_unit(uint port_index, UnitBase* unit)
+{
+	_return_network.set_sink_unit(port_index, unit);
+}
+
 bool UnitDRAM::usimm_busy() {
 	return usimmIsBusy();
 }
@@ -58,16 +64,19 @@ void UnitDRAM::print_usimm_stats(uint32_t const L2_line_size,
 	uint32_t const word_size,
 	cycles_t cycle_count)
 {
+	_fast_forward();
 	printUsimmStats(L2_line_size, word_size, cycle_count);
 }
 
 float UnitDRAM::total_power_in_watts()
 {
+	_fast_forward();
 	return getUsimmPower() / 1000.0f;
 }
 
 void UnitDRAM::UsimmNotifyEvent(cycles_t write_cycle, const arches_request_t& req)
 {
+	TraceWriter::record(returns[req.return_id].id, TraceStage::DRAM_COMPLETE, write_cycle);
 	_channels[req.channel].return_queue.push({write_cycle, req});
 }
 
@@ -99,17 +108,28 @@ bool UnitDRAM::_load(const MemoryRequest& request, uint channel_index)
 	reqInsertRet_t reqRet = insert_read(dram_addr, arches_request, _current_cycle * DRAM_CLOCK_MULTIPLIER);
 	if(reqRet.retType == reqInsertRet_tt::RRT_READ_QUEUE_FULL)
 	{
+		free_return_ids.push(arches_request.return_id);
 		return false;
 	}
 
+	//fill the return slot in place. Stores update memory as soon as they are accepted so the data has to be captured here
 	MemoryReturn& ret = returns[arches_request.return_id];
-	ret = MemoryReturn(request, _data_u8 + request.paddr);
+	ret.size = request.size;
+	ret.dst = request.dst;
+	ret.port = request.port;
+	ret.id = request.id;
+	ret.source = MemorySource::DRAM;
+	ret.paddr = request.paddr;
+	std::memcpy(ret.data, _data_u8 + request.paddr, request.size);
 
 	assert(reqRet.retType == reqInsertRet_tt::RRT_WRITE_QUEUE || reqRet.retType == reqInsertRet_tt::RRT_READ_QUEUE);
+	TraceWriter::record(request.id, TraceStage::DRAM_INSERT, _current_cycle);
 
 	if (reqRet.retLatencyKnown)
 	{
-		_channels[dram_addr.channel].return_queue.push({(Arches::cycles_t)reqRet.completionTime / DRAM_CLOCK_MULTIPLIER, arches_request});
+		cycles_t return_cycle = (Arches::cycles_t)reqRet.completionTime / DRAM_CLOCK_MULTIPLIER;
+		TraceWriter::record(request.id, TraceStage::DRAM_COMPLETE, return_cycle);
+		_channels[dram_addr.channel].return_queue.push({return_cycle, arches_request});
 	}
 
 	return true;
@@ -142,12 +162,25 @@ bool UnitDRAM::_store(const MemoryRequest& request, uint channel_index)
 
 	assert(!reqRet.retLatencyKnown);
 	assert(reqRet.retType == reqInsertRet_tt::RRT_WRITE_QUEUE);
+	TraceWriter::record(request.id, TraceStage::DRAM_INSERT, _current_cycle);
 
 	return true;
 }
 
+void UnitDRAM::_fast_forward()
+{
+	//usimm is idle while we sleep so we can catch it up in one step
+	cycles_t cycle = group_cycle();
+	if(_current_cycle >= cycle) return;
+
+	usimmFastForward((cycle - _current_cycle) * DRAM_CLOCK_MULTIPLIER);
+	_current_cycle = cycle;
+}
+
 void UnitDRAM::clock_rise()
 {
+	_fast_forward();
+
 	_request_network.clock();
 
 	for(uint channel_index = 0; channel_index < _channels.size(); ++channel_index)
@@ -159,12 +192,12 @@ void UnitDRAM::clock_rise()
 		if(request.type == MemoryRequest::Type::STORE)
 		{
 			if(_store(request, channel_index))
-				_request_network.read(channel_index);
+				_request_network.pop(channel_index);
 		}
 		else if(request.type == MemoryRequest::Type::LOAD)
 		{
 			if(_load(request, channel_index))
-				_request_network.read(channel_index);
+				_request_network.pop(channel_index);
 		}
 
 		if(!_busy)
@@ -173,6 +206,16 @@ void UnitDRAM::clock_rise()
 			simulator->units_executing++;
 		}
 	}
+
+	//with usimm idle the only thing left to do is return loads so sleep until the cycle before the next one is due
+	if(_busy || usimmIsBusy() || !_request_network.empty()) return;
+
+	cycles_t wake_cycle = INT64_MAX;
+	for(Channel& channel : _channels)
+		if(!channel.return_queue.empty())
+			wake_cycle = std::min(wake_cycle, channel.return_queue.top().return_cycle - 1);
+
+	if(wake_cycle > _current_cycle) sleep_until(wake_cycle);
 }
 
 void UnitDRAM::clock_fall()
@@ -209,6 +252,11 @@ void UnitDRAM::clock_fall()
 	_return_network.clock();
 }
 
-
+void UnitDRAM::serialize(Checkpoint& checkpoint)
+{
+	UnitMainMemoryBase::serialize(checkpoint);
+	checkpoint(_busy, _channels, _request_network, _return_network, _current_cycle, returns, free_return_ids);
+	usimmSerialize(checkpoint);
+}
 
 }}
\ No newline at end of file
@@ -28,6 +28,8 @@ private:
 	struct Channel
 	{
 		std::priority_queue<USIMMReturn> return_queue;
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(return_queue); }
 	};
 
 	bool _busy{false};
@@ -50,9 +52,17 @@ public:
 	bool return_port_read_valid(uint port_index) override;
 	const MemoryReturn& peek_return(uint port_index) override;
 	const MemoryReturn read_return(uint port_index) override;
+	void set_return_port_unit(uint port_index, UnitBase* unit) override;
 
 	void clock_rise() override;
 	void clock_fall() override;
+	void serialize(Checkpoint& checkpoint) override;
+
+	void get_networks(std::vector<std::pair<const char*, NetworkBase*>>& networks) override
+	{
+		networks.push_back({"Request", &_request_network});
+		networks.push_back({"Return", &_return_network});
+	}
 
 	bool usimm_busy();
 	void print_usimm_stats(uint32_t const L2_line_size, uint32_t const word_size, cycles_t cycle_count);
@@ -63,6 +73,7 @@ public:
 private:
 	bool _load(const MemoryRequest& request_item, uint channel_index);
 	bool _store(const MemoryRequest& request_item, uint channel_index);
+	void _fast_forward();
 };
 
 }}
\ No newline at end of file
@@ -37,6 +37,61 @@ public:
 		memset(_data_u8, 0x00, size_bytes);
 	}
 
+	//Only saves pages that aren't zero since most of memory is never touched
+	void serialize(Checkpoint& checkpoint) override
+	{
+		constexpr size_t PAGE_SIZE = 4096;
+		static const uint8_t zero_page[PAGE_SIZE] = {};
+
+		checkpoint.check(size_bytes);
+		if(checkpoint.restoring()) clear();
+
+		uint64_t num_pages = (size_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+		uint64_t page_index = 0;
+		while(true)
+		{
+			if(!checkpoint.restoring())
+			{
+				while(page_index < num_pages && std::memcmp(_data_u8 + page_index * PAGE_SIZE, zero_page, std::min(PAGE_SIZE, size_bytes - page_index * PAGE_SIZE)) == 0)
+					page_index++;
+
+				if(page_index == num_pages) page_index = ~0ull;
+			}
+
+			checkpoint(page_index);
+			if(page_index == ~0ull) break;
+
+			checkpoint.bytes(_data_u8 + page_index * PAGE_SIZE, std::min(PAGE_SIZE, size_bytes - page_index * PAGE_SIZE));
+			page_index++;
+		}
+	}
+
+	bool functional_request(const MemoryRequest& request, MemoryReturn& ret) override
+	{
+		if(request.type == MemoryRequest::Type::LOAD)
+		{
+			ret = MemoryReturn(request, _data_u8 + request.paddr);
+			return true;
+		}
+
+		if(request.type == MemoryRequest::Type::STORE)
+		{
+			//Masked write
+			for(uint i = 0; i < request.size; ++i)
+				if((request.write_mask >> i) & 0x1)
+					_data_u8[request.paddr + i] = request.data[i];
+
+			return false;
+		}
+
+		//Atomics return the old value like the atomic reg file
+		ret = MemoryReturn(request, _data_u8 + request.paddr);
+		if(request.size == sizeof(uint32_t))      _execute_atomic<uint32_t>(request);
+		else if(request.size == sizeof(uint64_t)) _execute_atomic<uint64_t>(request);
+		else throw std::runtime_error("Invalid atomic size in functional request!");
+		return true;
+	}
+
 	void direct_read(void* data, size_t size, paddr_t paddr) const
 	{ 
 		memcpy(data, _data_u8 + paddr, size);
@@ -48,7 +103,7 @@ public:
 	}
 
 	//return the physical address imidiatly following the end of the elf. This can be used as the start of our heap
-	paddr_t write_elf(ELF& elf)
+	paddr_t write_elf(const ELF& elf)
 	{
 		paddr_t paddr = 0ull;
 		for(ELF::LoadableSegment const* seg : elf.segments)
@@ -65,6 +120,56 @@ public:
 		stbi_write_png(path.c_str(), static_cast<int>(width), static_cast<int>(height), 4, src, 0);
 	}
 
+	template<typename T>
+	void _execute_atomic(const MemoryRequest& request)
+	{
+		using S = std::make_signed_t<T>;
+
+		T value, request_data;
+		std::memcpy(&value, _data_u8 + request.paddr, sizeof(T));
+		std::memcpy(&request_data, request.data, sizeof(T));
+
+		switch(request.type)
+		{
+		case MemoryRequest::Type::AMO_ADD:
+			value += request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_AND:
+			value &= request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_OR:
+			value |= request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_XOR:
+			value ^= request_data;
+			break;
+
+		case MemoryRequest::Type::AMO_MIN:
+			value = std::min((S)request_data, (S)value);
+			break;
+
+		case MemoryRequest::Type::AMO_MAX:
+			value = std::max((S)request_data, (S)value);
+			break;
+
+		case MemoryRequest::Type::AMO_MINU:
+			value = std::min(request_data, value);
+			break;
+
+		case MemoryRequest::Type::AMO_MAXU:
+			value = std::max(request_data, value);
+			break;
+
+		default:
+			throw std::runtime_error("Unsupported request type in functional request!");
+		}
+
+		std::memcpy(_data_u8 + request.paddr, &value, sizeof(T));
+	}
+
 	void _print_data(uint8_t* data, int size) const
 	{
 		for(int i = 0; i < size; i++)
@@ -4,6 +4,8 @@
 
 #include "unit-base.hpp"
 #include "../simulator/interconnects.hpp"
+#include "../simulator/noc.hpp"
+#include "../simulator/trace.hpp"
 #include "../simulator/transactions.hpp"
 
 namespace Arches { namespace Units {
@@ -11,33 +13,37 @@ namespace Arches { namespace Units {
 class UnitMemoryBase : public UnitBase
 {
 public:
-	class RequestCrossBar : public CasscadedCrossBar<MemoryRequest>
+	struct BankRouter
 	{
-	private:
-		uint64_t mask;
+		uint64_t bank_select_mask;
 
-	public:
-		RequestCrossBar(uint ports, uint banks, uint64_t bank_select_mask) : mask(bank_select_mask), CasscadedCrossBar<MemoryRequest>(ports, banks, banks) {}
-
-		uint get_sink(const MemoryRequest& request) override
+		uint get_sink(const MemoryRequest& request) const
 		{
-			uint bank = pext(request.paddr, mask);
-			assert(bank < num_sinks());
-			return bank;
+			return pext(request.paddr, bank_select_mask);
 		}
 	};
 
-	class ReturnCrossBar : public CasscadedCrossBar<MemoryReturn>
+	struct PortRouter
 	{
-	public:
-		ReturnCrossBar(uint ports, uint banks) : CasscadedCrossBar<MemoryReturn>(banks, ports, banks) {}
-
-		uint get_sink(const MemoryReturn& ret) override
+		uint get_sink(const MemoryReturn& ret) const
 		{
 			return ret.port;
 		}
 	};
 
+	//Crossbars by default. A ring or mesh network configuration puts one router per bank between the ports and the banks instead
+	class RequestCrossBar : public TopologyNetwork<MemoryRequest, BankRouter>
+	{
+	public:
+		RequestCrossBar(uint ports, uint banks, uint64_t bank_select_mask, const NetworkConfiguration& network = {}) : TopologyNetwork<MemoryRequest, BankRouter>(ports, banks, banks, network, {bank_select_mask}) {}
+	};
+
+	class ReturnCrossBar : public TopologyNetwork<MemoryReturn, PortRouter>
+	{
+	public:
+		ReturnCrossBar(uint ports, uint banks, const NetworkConfiguration& network = {}) : TopologyNetwork<MemoryReturn, PortRouter>(banks, ports, banks, network) {}
+	};
+
 public:
 	UnitMemoryBase() = default;
 
@@ -49,6 +55,16 @@ public:
 	virtual bool return_port_read_valid(uint port_index) = 0;
 	virtual const MemoryReturn& peek_return(uint port_index) = 0;
 	virtual const MemoryReturn read_return(uint port_index) = 0;
+
+	//Unit to wake when a return arrives at the port. Lets clients sleep while they wait on a return
+	virtual void set_return_port_unit(uint port_index, UnitBase* unit) = 0;
+
+	//Sampled simulation. Services the request on the spot with no timing and bypasses the ports so it is only safe while the machine is drained.
+	//Caches warm their tags along the way. Returns true if the request produced a return
+	virtual bool functional_request(const MemoryRequest&, MemoryReturn&)
+	{
+		throw std::runtime_error("Unit can't be fast forwarded!");
+	}
 };
 
 class MemoryMap
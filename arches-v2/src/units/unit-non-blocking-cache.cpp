@@ -3,17 +3,22 @@
 namespace Arches {namespace Units {
 
 UnitNonBlockingCache::UnitNonBlockingCache(Configuration config) : 
-	UnitCacheBase(config.size, config.associativity),
-	_request_cross_bar(config.num_ports, config.num_banks, config.bank_select_mask),
-	_return_cross_bar(config.num_ports, config.num_banks)
+	UnitCacheBase(config.size, config.associativity, config.replacement_policy),
+	_request_cross_bar(config.num_ports, config.num_banks, config.bank_select_mask, config.network),
+	_return_cross_bar(config.num_ports, config.num_banks, config.network)
 {
 	_check_retired_lfb = config.check_retired_lfb;
+	_num_mshr = config.num_mshr ? std::min(config.num_mshr, config.num_lfb) : config.num_lfb;
+	_level = config.level;
 
 	_mem_higher = config.mem_higher;
 	_mem_higher_port_offset = config.mem_higher_port_offset;
 	_mem_higher_port_stride = config.mem_higher_port_stride;
 
 	_banks.resize(config.num_banks, {config.num_lfb, config.data_array_latency});
+
+	for(uint bank_index = 0; bank_index < _banks.size(); ++bank_index)
+		_mem_higher->set_return_port_unit(bank_index * _mem_higher_port_stride + _mem_higher_port_offset, this);
 }
 
 UnitNonBlockingCache::~UnitNonBlockingCache()
@@ -62,7 +67,15 @@ uint UnitNonBlockingCache::_allocate_lfb(uint bank_index, LFB& lfb)
 	return replacement_index;
 }
 
-uint UnitNonBlockingCache::_fetch_or_allocate_lfb(uint bank_index, uint64_t block_addr, LFB::Type type)
+uint UnitNonBlockingCache::_num_missed_lfbs(uint bank_index)
+{
+	uint num_missed = 0;
+	for(LFB& lfb : _banks[bank_index].lfbs)
+		if(lfb.state == LFB::State::MISSED) num_missed++;
+	return num_missed;
+}
+
+uint UnitNonBlockingCache::_fetch_or_allocate_lfb(uint bank_index, uint64_t block_addr, LFB::Type type, bool miss)
 {
 	std::vector<LFB>& lfbs = _banks[bank_index].lfbs;
 
@@ -73,6 +86,9 @@ uint UnitNonBlockingCache::_fetch_or_allocate_lfb(uint bank_index, uint64_t bloc
 	
 	uint lfb_index = _fetch_lfb(bank_index, lfb);
 	if(lfb_index != ~0) return lfb_index;
+
+	//a new miss needs a free mshr so at least num_lfb - num_mshr lfbs are always left to stage hits
+	if(miss && _num_missed_lfbs(bank_index) >= _num_mshr) return ~0u;
 	return _allocate_lfb(bank_index, lfb);
 }
 
@@ -83,6 +99,8 @@ void UnitNonBlockingCache::_push_request(LFB& lfb, const MemoryRequest& request)
 	sub_entry.size = request.size;
 	sub_entry.port = request.port;
 	sub_entry.dst = request.dst;
+	sub_entry.id = request.id;
+	sub_entry.merged = lfb.state != LFB::State::EMPTY;
 	lfb.sub_entries.push(sub_entry);
 }
 
@@ -96,6 +114,7 @@ MemoryRequest UnitNonBlockingCache::_pop_request(LFB& lfb)
 	req.size = sub_entry.size;
 	req.port = sub_entry.port;
 	req.dst = sub_entry.dst;
+	req.id = sub_entry.id;
 	req.paddr = lfb.block_addr + sub_entry.offset;
 	return req;
 }
@@ -124,15 +143,16 @@ bool UnitNonBlockingCache::_proccess_return(uint bank_index)
 	const MemoryReturn ret = _mem_higher->read_return(mem_higher_port_index);
 	assert(ret.paddr == _get_block_addr(ret.paddr));
 
-	//Mark the associated lse as filled and put it in the return queue
+	//Mark the associated lse as filled and put it in the return queue. Invalid and write combining lfbs can still hold the address
 	Bank& bank = _banks[bank_index];
 	for(uint i = 0; i < bank.lfbs.size(); ++i)
 	{
 		LFB& lfb = bank.lfbs[i];
-		if(lfb.block_addr == ret.paddr)
+		if(lfb.state == LFB::State::MISSED && lfb.block_addr == ret.paddr)
 		{
-			assert(lfb.state == LFB::State::MISSED);
+			assert(lfb.type == LFB::Type::READ);
 			std::memcpy(lfb.block_data.bytes, ret.data, CACHE_BLOCK_SIZE);
+			lfb.source = ret.source;
 			lfb.state = LFB::State::FILLED;
 			bank.lfb_return_queue.push(i);
 			break;
@@ -162,13 +182,13 @@ bool UnitNonBlockingCache::_proccess_request(uint bank_index)
 
 	if(request.type == MemoryRequest::Type::LOAD)
 	{
-		//Try to fetch an lfb for the line or allocate a new lfb for the line
-		uint lfb_index = _fetch_or_allocate_lfb(bank_index, block_addr, LFB::Type::READ);
-
-		//In parallel access the tag array to check for the line
+		//Access the tag array to check for the line
 		BlockData* block_data = _get_block(block_addr);
 		log.log_tag_array_access();
 
+		//In parallel try to fetch an lfb for the line or allocate a new lfb for the line
+		uint lfb_index = _fetch_or_allocate_lfb(bank_index, block_addr, LFB::Type::READ, !block_data);
+
 		//If the data array access is zero cycle then that means we did it in parallel with th tag lookup
 		if(bank.data_array_pipline.lantecy() == 0)
 		{
@@ -179,12 +199,14 @@ bool UnitNonBlockingCache::_proccess_request(uint bank_index)
 		{
 			LFB& lfb = bank.lfbs[lfb_index];
 			_push_request(lfb, request);
+			TraceWriter::record(request.id, TraceStage::CACHE_BANK, group_cycle());
 
 			if(lfb.state == LFB::State::EMPTY)
 			{
 				if(block_data)
 				{
 					std::memcpy(lfb.block_data.bytes, block_data, CACHE_BLOCK_SIZE);
+					lfb.source = cache_source(_level, false);
 
 					//Copy line from data array to LFB
 					if(bank.data_array_pipline.lantecy() == 0)
@@ -205,14 +227,17 @@ bool UnitNonBlockingCache::_proccess_request(uint bank_index)
 				{
 					//Missed the cache queue up a request to mem higher
 					lfb.state = LFB::State::MISSED;
+					lfb.trace_id = request.id;
 					bank.lfb_request_queue.push(lfb_index);
 					log.log_miss();
+					TraceWriter::record(request.id, TraceStage::LFB_ALLOCATE, group_cycle());
 				}
 			}
 			else if(lfb.state == LFB::State::MISSED)
 			{
 				log.log_miss();
 				log.log_half_miss();
+				TraceWriter::record(request.id, TraceStage::LFB_MERGE, group_cycle());
 			}
 			else if(lfb.state == LFB::State::FILLED)
 			{
@@ -228,18 +253,23 @@ bool UnitNonBlockingCache::_proccess_request(uint bank_index)
 				log.log_lfb_hit();
 			}
 
-			_request_cross_bar.read(bank_index);
+			_request_cross_bar.pop(bank_index);
+		}
+		else
+		{
+			log.log_lfb_stall();
+			if(!block_data && _num_missed_lfbs(bank_index) >= _num_mshr) log.log_mshr_stall();
 		}
-		else log.log_lfb_stall();
 	}
 	else if(request.type == MemoryRequest::Type::STORE)
 	{
 		//try to allocate an lfb
-		uint lfb_index = _fetch_or_allocate_lfb(bank_index, block_addr, LFB::Type::WRITE_COMBINING);
+		uint lfb_index = _fetch_or_allocate_lfb(bank_index, block_addr, LFB::Type::WRITE_COMBINING, false);
 		if(lfb_index != ~0)
 		{
 			LFB& lfb = bank.lfbs[lfb_index];
 			lfb.write_mask |= request.write_mask << block_offset;
+			TraceWriter::record(request.id, TraceStage::CACHE_BANK, group_cycle());
 			for(uint i = 0; i < request.size; ++i)
 				if((request.write_mask >> i) & 0x1)
 					lfb.block_data.bytes[block_offset + i] = request.data[i];
@@ -247,10 +277,11 @@ bool UnitNonBlockingCache::_proccess_request(uint bank_index)
 			if(lfb.state == LFB::State::EMPTY)
 			{
 				lfb.state = LFB::State::FILLED; //since we just filled it
+				lfb.trace_id = request.id;
 				bank.lfb_request_queue.push(lfb_index);
 			}
 
-			_request_cross_bar.read(bank_index);
+			_request_cross_bar.pop(bank_index);
 		}
 	}
 
@@ -273,6 +304,7 @@ void UnitNonBlockingCache::_try_request_lfb(uint bank_index)
 		outgoing_request.type = MemoryRequest::Type::LOAD;
 		outgoing_request.size = CACHE_BLOCK_SIZE;
 		outgoing_request.port = mem_higher_port_index;
+		outgoing_request.id = lfb.trace_id;
 		outgoing_request.paddr = lfb.block_addr;
 		_mem_higher->write_request(outgoing_request, mem_higher_port_index);
 
@@ -287,6 +319,7 @@ void UnitNonBlockingCache::_try_request_lfb(uint bank_index)
 		outgoing_request.size = CACHE_BLOCK_SIZE;
 		outgoing_request.port = mem_higher_port_index;
 		outgoing_request.write_mask = lfb.write_mask;
+		outgoing_request.id = lfb.trace_id;
 		outgoing_request.paddr = lfb.block_addr;
 		std::memcpy(outgoing_request.data, lfb.block_data.bytes, CACHE_BLOCK_SIZE);
 		_mem_higher->write_request(outgoing_request, mem_higher_port_index);
@@ -307,8 +340,10 @@ void UnitNonBlockingCache::_try_return_lfb(uint bank_index)
 
 	//select the next subentry and copy return to interconnect
 
+	bool merged = lfb.sub_entries.front().merged;
 	MemoryRequest req = _pop_request(lfb);
 	MemoryReturn ret(req, lfb.block_data.bytes + _get_block_offset(req.paddr));
+	ret.source = merged ? cache_source(_level, true) : lfb.source;
 	_return_cross_bar.write(ret, bank_index);
 
 	if(lfb.sub_entries.empty())
@@ -319,6 +354,23 @@ void UnitNonBlockingCache::_try_return_lfb(uint bank_index)
 	}
 }
 
+bool UnitNonBlockingCache::_is_idle()
+{
+	if(!_request_cross_bar.empty() || !_return_cross_bar.is_idle()) return false;
+
+	for(Bank& bank : _banks)
+	{
+		if(!bank.lfb_request_queue.empty() || !bank.lfb_return_queue.empty() || !bank.data_array_pipline.empty()) return false;
+
+		//retired lfbs only hold data for future hits so they don't need the clock
+		//missed lfbs have been issued to mem higher which will wake us when the return arrives
+		for(LFB& lfb : bank.lfbs)
+			if(lfb.state != LFB::State::INVALID && lfb.state != LFB::State::RETIRED && lfb.state != LFB::State::MISSED) return false;
+	}
+
+	return true;
+}
+
 void UnitNonBlockingCache::clock_rise()
 {
 	_request_cross_bar.clock();
@@ -333,6 +385,8 @@ void UnitNonBlockingCache::clock_rise()
 			_proccess_request(i);
 		}
 	}
+
+	if(_is_idle()) sleep();
 }
 
 void UnitNonBlockingCache::clock_fall()
@@ -354,6 +408,7 @@ bool UnitNonBlockingCache::request_port_write_valid(uint port_index)
 void UnitNonBlockingCache::write_request(const MemoryRequest& request, uint port_index)
 {
 	_request_cross_bar.write(request, port_index);
+	wake();
 }
 
 bool UnitNonBlockingCache::return_port_read_valid(uint port_index)
@@ -371,4 +426,15 @@ const MemoryReturn UnitNonBlockingCache::read_return(uint port_index)
 	return _return_cross_bar.read(port_index);
 }
 
+void UnitNonBlockingCache::set_return_port_unit(uint port_index, UnitBase* unit)
+{
+	_return_cross_bar.set_sink_unit(port_index, unit);
+}
+
+void UnitNonBlockingCache::serialize(Checkpoint& checkpoint)
+{
+	UnitCacheBase::serialize(checkpoint);
+	checkpoint(_banks, _request_cross_bar, _return_cross_bar, log);
+}
+
 }}
\ No newline at end of file
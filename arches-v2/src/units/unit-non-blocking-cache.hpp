@@ -13,19 +13,24 @@ public:
 	{
 		uint size{1024};
 		uint associativity{1};
+		ReplacementPolicy::Type replacement_policy{ReplacementPolicy::Type::LRU};
 
 		uint data_array_latency{0};
 
 		uint num_ports{1};
 		uint num_banks{1};
 		uint64_t bank_select_mask{0};
+		NetworkConfiguration network{}; //topology between the ports and the banks
 
-		uint num_lfb{1};
+		uint num_lfb{1}; //per bank. Every request to the data goes through one so hits need them too
+		uint num_mshr{0}; //lfbs per bank that can wait on mem higher at once. 0 lets all of them. The rest stay free for hits under the misses
 		bool check_retired_lfb{true};
 
 		UnitMemoryBase* mem_higher{nullptr};
 		uint            mem_higher_port_offset{0};
 		uint            mem_higher_port_stride{1};
+
+		uint level{1}; //position in the hierarchy. Returns are tagged with it so the TPs know what served them
 	};
 
 	UnitNonBlockingCache(Configuration config);
@@ -33,6 +38,13 @@ public:
 
 	void clock_rise() override;
 	void clock_fall() override;
+	void serialize(Checkpoint& checkpoint) override;
+
+	void get_networks(std::vector<std::pair<const char*, NetworkBase*>>& networks) override
+	{
+		networks.push_back({"Request", &_request_cross_bar});
+		networks.push_back({"Return", &_return_cross_bar});
+	}
 
 	bool request_port_write_valid(uint port_index) override;
 	void write_request(const MemoryRequest& request, uint port_index) override;
@@ -40,6 +52,9 @@ public:
 	bool return_port_read_valid(uint port_index) override;
 	const MemoryReturn& peek_return(uint port_index) override;
 	const MemoryReturn read_return(uint port_index) override;
+	void set_return_port_unit(uint port_index, UnitBase* unit) override;
+
+	bool functional_request(const MemoryRequest& request, MemoryReturn& ret) override { return _functional_request(request, ret, _mem_higher); }
 
 private:
 	struct LFB //Line Fill Buffer
@@ -47,9 +62,11 @@ private:
 		struct SubEntry
 		{
 			uint64_t  dst;
+			uint64_t  id;
 			uint16_t  port;
 			uint8_t   size;
 			uint8_t   offset;
+			bool      merged; //the lfb already existed when the request arrived
 		};
 
 		enum class Type : uint8_t
@@ -76,6 +93,8 @@ private:
 
 		uint64_t write_mask{0x0};
 		std::queue<SubEntry> sub_entries;
+		uint64_t trace_id{0}; //of the request that allocated it. The request to mem higher carries it
+		MemorySource source{MemorySource::OTHER}; //where the line came from
 
 		uint8_t lru{0u};
 		Type type{Type::READ};
@@ -88,6 +107,8 @@ private:
 		{
 			return block_addr == other.block_addr && type == other.type;
 		}
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(block_data, block_addr, write_mask, sub_entries, trace_id, source, lru, type, state); }
 	};
 
 	struct Bank
@@ -98,9 +119,13 @@ private:
 		Pipline<uint> data_array_pipline;
 		uint64_t outgoing_write_mask;
 		Bank(uint num_lfb, uint data_array_latency) : lfbs(num_lfb), data_array_pipline(data_array_latency) {}
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(lfbs, lfb_request_queue, lfb_return_queue, data_array_pipline, outgoing_write_mask); }
 	};
 
 	bool _check_retired_lfb;
+	uint _num_mshr;
+	uint _level;
 	std::vector<Bank> _banks;
 	RequestCrossBar _request_cross_bar;
 	ReturnCrossBar _return_cross_bar;
@@ -114,7 +139,8 @@ private:
 
 	uint _fetch_lfb(uint bank_index, LFB& lfb);
 	uint _allocate_lfb(uint bank_index, LFB& lfb);
-	uint _fetch_or_allocate_lfb(uint bank_index, uint64_t block_addr, LFB::Type type);
+	uint _num_missed_lfbs(uint bank_index);
+	uint _fetch_or_allocate_lfb(uint bank_index, uint64_t block_addr, LFB::Type type, bool miss);
 
 	void _clock_data_array(uint bank_index);
 
@@ -124,6 +150,8 @@ private:
 	void _try_request_lfb(uint bank_index);
 	void _try_return_lfb(uint bank_index);
 
+	bool _is_idle();
+
 public:
 	class Log
 	{
@@ -135,6 +163,7 @@ public:
 		uint64_t _uncached_writes;
 		uint64_t _lfb_hits;
 		uint64_t _lfb_stalls;
+		uint64_t _mshr_stalls;
 		uint64_t _tag_array_access;
 		uint64_t _data_array_reads;
 		uint64_t _data_array_writes;
@@ -150,6 +179,7 @@ public:
 			_half_misses = 0;
 			_uncached_writes = 0;
 			_lfb_stalls = 0;
+			_mshr_stalls = 0;
 			_tag_array_access = 0;
 			_data_array_reads = 0;
 			_data_array_writes = 0;
@@ -163,6 +193,7 @@ public:
 			_misses += other._misses;
 			_half_misses += other._half_misses;;
 			_lfb_stalls += other._lfb_stalls;
+			_mshr_stalls += other._mshr_stalls;
 			_tag_array_access += other._tag_array_access;
 			_data_array_reads += other._data_array_reads;
 			_data_array_writes += other._data_array_writes;
@@ -178,6 +209,7 @@ public:
 		void log_uncached_write(uint n = 1) { _uncached_writes += n; }
 
 		void log_lfb_stall() { _lfb_stalls++; }
+		void log_mshr_stall() { _mshr_stalls++; } //the lfb stall was a miss waiting on an mshr
 
 		void log_tag_array_access() { _tag_array_access++; }
 		void log_data_array_read() { _data_array_reads++; }
@@ -199,6 +231,7 @@ public:
 			fprintf(stream, "Half Misses: %lld(%.2f%%)\n", _half_misses / units, _half_misses / ft);
 			fprintf(stream, "LFB Hits: %lld(%.2f%%)\n", _lfb_hits / units, _lfb_hits / ft);
 			fprintf(stream, "LFB Stalls: %lld\n", _lfb_stalls / units);
+			fprintf(stream, "MSHR Stalls: %lld\n", _mshr_stalls / units);
 			fprintf(stream, "Tag Array Total: %lld\n", _tag_array_access);
 			fprintf(stream, "Data Array Total: %lld\n", da_total);
 			fprintf(stream, "Data Array Reads: %lld\n", _data_array_reads);
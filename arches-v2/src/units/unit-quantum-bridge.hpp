@@ -0,0 +1,223 @@
+#pragma once
+#include "../stdafx.hpp"
+
+#include "unit-base.hpp"
+#include "unit-memory-base.hpp"
+
+namespace Arches { namespace Units {
+
+//Exchanged by the simulator between quanta. Every bridge logs the latency the transactions it carried picked up from waiting for the boundary
+class QuantumBridge
+{
+public:
+	class Log
+	{
+	public:
+		uint64_t _requests;
+		uint64_t _returns;
+		uint64_t _request_delay;
+		uint64_t _return_delay;
+
+		Log() { reset(); }
+
+		void reset()
+		{
+			_requests = 0;
+			_returns = 0;
+			_request_delay = 0;
+			_return_delay = 0;
+		}
+
+		void accumulate(const Log& other)
+		{
+			_requests += other._requests;
+			_returns += other._returns;
+			_request_delay += other._request_delay;
+			_return_delay += other._return_delay;
+		}
+
+		void log_request(cycles_t delay) { _requests++; _request_delay += delay; }
+		void log_return(cycles_t delay) { _returns++; _return_delay += delay; }
+
+		uint64_t get_delay() const { return _request_delay + _return_delay; }
+
+		void print_log(FILE* stream = stdout)
+		{
+			fprintf(stream, "Requests: %lld\n", _requests);
+			fprintf(stream, "Returns: %lld\n", _returns);
+			fprintf(stream, "Average Request Delay: %.2f\n", _requests ? (double)_request_delay / _requests : 0.0);
+			fprintf(stream, "Average Return Delay: %.2f\n", _returns ? (double)_return_delay / _returns : 0.0);
+		}
+	}log;
+
+	virtual ~QuantumBridge() = default;
+
+	//Called by the simulator between quanta while no group is being clocked. Returns true if the bridge is still carrying transactions
+	virtual bool exchange() = 0;
+};
+
+//Connects clients in other unit groups to a unit in quantum mode. Must be registered in the same group as the unit.
+//BASE is the port interface the unit shows its clients and REQUEST is what they write to it. Returns are always memory returns.
+//During a quantum the clients only touch the client side of a port and the bridge only touches the unit side.
+//Transactions move between the sides in exchange() at the quantum boundary so each one picks up latency the lockstep simulation wouldn't have.
+template<typename REQUEST, typename BASE>
+class UnitQuantumBridgeBase : public BASE, public QuantumBridge
+{
+private:
+	template<typename T>
+	struct Staged
+	{
+		T transaction;
+		cycles_t cycle; //first cycle the other side could have seen the transaction in lockstep
+
+		void serialize(Checkpoint& checkpoint) { checkpoint(transaction, cycle); }
+	};
+
+	struct Port
+	{
+		//client side
+		std::queue<Staged<REQUEST>> staged_requests;
+		std::queue<MemoryReturn> returns;
+		uint request_credits;
+		UnitBase* client{nullptr};
+
+		//unit side
+		std::queue<REQUEST> requests;
+		std::queue<Staged<MemoryReturn>> staged_returns;
+		uint return_credits;
+
+		//the client is wiring so it isn't saved
+		void serialize(Checkpoint& checkpoint) { checkpoint(staged_requests, returns, request_credits, requests, staged_returns, return_credits); }
+	};
+
+protected:
+	BASE* _mem;
+	std::vector<Port> _ports;
+	uint _depth;
+
+public:
+	UnitQuantumBridgeBase(BASE* mem, uint num_ports, uint depth = 8) : BASE(),
+		_mem(mem), _ports(num_ports), _depth(depth)
+	{
+		for(uint port_index = 0; port_index < _ports.size(); ++port_index)
+		{
+			_ports[port_index].request_credits = _depth;
+			_ports[port_index].return_credits = _depth;
+			_mem->set_return_port_unit(port_index, this);
+		}
+	}
+
+	void clock_rise() override
+	{
+		bool idle = true;
+		for(uint port_index = 0; port_index < _ports.size(); ++port_index)
+		{
+			Port& port = _ports[port_index];
+			if(port.staged_returns.size() < port.return_credits && _mem->return_port_read_valid(port_index))
+				port.staged_returns.push({_mem->read_return(port_index), this->group_cycle()});
+
+			if(!port.requests.empty()) idle = false;
+		}
+
+		//returns wake us through the unit's return ports and requests only show up on exchange
+		if(idle) this->sleep();
+	}
+
+	void clock_fall() override
+	{
+		for(uint port_index = 0; port_index < _ports.size(); ++port_index)
+		{
+			Port& port = _ports[port_index];
+			if(port.requests.empty() || !_mem->request_port_write_valid(port_index)) continue;
+
+			_mem->write_request(port.requests.front(), port_index);
+			port.requests.pop();
+		}
+	}
+
+	bool exchange() override
+	{
+		bool busy = false;
+		cycles_t cycle = this->simulator->current_cycle;
+		for(Port& port : _ports)
+		{
+			if(!port.staged_requests.empty() || !port.staged_returns.empty() || !port.requests.empty() || !port.returns.empty()) busy = true;
+
+			while(!port.staged_requests.empty())
+			{
+				log.log_request(cycle - port.staged_requests.front().cycle);
+				port.requests.push(port.staged_requests.front().transaction);
+				port.staged_requests.pop();
+			}
+
+			while(!port.staged_returns.empty())
+			{
+				log.log_return(cycle - port.staged_returns.front().cycle);
+				port.returns.push(port.staged_returns.front().transaction);
+				port.staged_returns.pop();
+			}
+
+			//credits keep both sides bounded by the depth
+			port.request_credits = _depth - static_cast<uint>(std::min<size_t>(port.requests.size(), _depth));
+			port.return_credits = _depth - static_cast<uint>(std::min<size_t>(port.returns.size(), _depth));
+
+			if(!port.returns.empty() && port.client) port.client->wake();
+		}
+
+		//unit side returns may have been held back by credits
+		this->wake();
+		return busy;
+	}
+
+	bool request_port_write_valid(uint port_index) override
+	{
+		return _ports[port_index].staged_requests.size() < _ports[port_index].request_credits;
+	}
+
+	void write_request(const REQUEST& request, uint port_index) override
+	{
+		Port& port = _ports[port_index];
+		port.staged_requests.push({request, port.client ? port.client->group_cycle() + 1 : this->simulator->current_cycle});
+	}
+
+	bool return_port_read_valid(uint port_index) override
+	{
+		return !_ports[port_index].returns.empty();
+	}
+
+	const MemoryReturn& peek_return(uint port_index) override
+	{
+		return _ports[port_index].returns.front();
+	}
+
+	const MemoryReturn read_return(uint port_index) override
+	{
+		MemoryReturn ret = _ports[port_index].returns.front();
+		_ports[port_index].returns.pop();
+		return ret;
+	}
+
+	void serialize(Checkpoint& checkpoint) override
+	{
+		checkpoint(_ports, log);
+	}
+
+	void set_return_port_unit(uint port_index, UnitBase* unit) override
+	{
+		_ports[port_index].client = unit;
+	}
+};
+
+//Bridge in front of a memory unit
+class UnitQuantumBridge : public UnitQuantumBridgeBase<MemoryRequest, UnitMemoryBase>
+{
+public:
+	UnitQuantumBridge(UnitMemoryBase* mem, uint num_ports, uint depth = 8) : UnitQuantumBridgeBase(mem, num_ports, depth) {}
+
+	bool functional_request(const MemoryRequest& request, MemoryReturn& ret) override
+	{
+		return _mem->functional_request(request, ret);
+	}
+};
+
+}}
@@ -31,6 +31,7 @@ public:
 	virtual void write_request(const SFURequest& request, uint port_index)
 	{
 		request_crossbar.write(request, port_index);
+		wake();
 	}
 
 	//Should only be used on clock rise
@@ -49,6 +50,12 @@ public:
 		return return_crossbar.read(port_index);
 	}
 
+	//Unit to wake when a return arrives at the port
+	virtual void set_return_port_unit(uint port_index, UnitBase* unit)
+	{
+		return_crossbar.set_sink_unit(port_index, unit);
+	}
+
 	void clock_rise() override
 	{
 		request_crossbar.clock();
@@ -63,6 +70,8 @@ public:
 
 			piplines[pipline_index].clock();
 		}
+
+		if(_is_idle()) sleep();
 	}
 
 	void clock_fall() override
@@ -78,6 +87,28 @@ public:
 
 		return_crossbar.clock();
 	}
+
+	void get_networks(std::vector<std::pair<const char*, NetworkBase*>>& networks) override
+	{
+		networks.push_back({"Request", &request_crossbar});
+		networks.push_back({"Return", &return_crossbar});
+	}
+
+	void serialize(Checkpoint& checkpoint) override
+	{
+		checkpoint(request_crossbar, piplines, return_crossbar);
+	}
+
+private:
+	bool _is_idle()
+	{
+		if(!request_crossbar.empty()) return false;
+
+		for(auto& pipline : piplines)
+			if(!pipline.empty()) return false;
+
+		return true;
+	}
 };
 
 }}
\ No newline at end of file
@@ -11,7 +11,7 @@ namespace Arches { namespace Units {
 class UnitThreadScheduler : public UnitMemoryBase
 {
 private:
-	UnitAtomicRegfile* _atomic_regs;
+	UnitMemoryBase* _atomic_regs;
 
 	Casscade<MemoryRequest> _request_network;
 	FIFOArray<MemoryReturn> _return_network;
@@ -32,11 +32,30 @@ private:
 	uint _current_tile;
 	uint _current_offset;
 
+	uint32_t _pixel_index()
+	{
+		uint x = (_current_tile % (_width / _tile_width)) * _tile_width + (_current_offset % _tile_width);
+		uint y = (_current_tile / (_width / _tile_width)) * _tile_height + (_current_offset / _tile_width);
+		return y * _width + x;
+	}
+
+	MemoryRequest _tile_request()
+	{
+		MemoryRequest request;
+		request.type = MemoryRequest::Type::AMO_ADD;
+		request.size = 4;
+		request.port = _tm_index;
+		request.paddr = 0x0ull;
+		request.data_u32 = 1;
+		return request;
+	}
+
 public:
-	UnitThreadScheduler(uint num_tp, uint tm_index, UnitAtomicRegfile* atomic_regs, uint width, uint height, uint tile_width = 8, uint tile_height = 8) : UnitMemoryBase(),
+	UnitThreadScheduler(uint num_tp, uint tm_index, UnitMemoryBase* atomic_regs, uint width, uint height, uint tile_width = 8, uint tile_height = 8) : UnitMemoryBase(),
 		_width(width), _height(height), _tile_width(tile_width), _tile_height(tile_height), _tile_size(tile_width * tile_height), _request_network(num_tp, 1), _return_network(num_tp), _num_tp(num_tp), _tm_index(tm_index), _atomic_regs(atomic_regs)
 	{
 		_current_offset = _tile_size;
+		_atomic_regs->set_return_port_unit(_tm_index, this);
 	}
 
 	void clock_rise() override
@@ -59,6 +78,9 @@ public:
 			_current_request = _request_network.read(0);
 			_current_request_valid = true;
 		}
+
+		//while stalled we don't read requests so we only need the clock for the return from the atomic regs
+		if(_request_network.is_idle() && (_stalled_for_atomic_reg || (!_current_request_valid && _request_network.empty()))) sleep();
 	}
 
 	void clock_fall() override
@@ -69,21 +91,14 @@ public:
 			{
 				if(_atomic_regs->request_port_write_valid(_tm_index))
 				{
-					MemoryRequest request;
-					request.type = MemoryRequest::Type::AMO_ADD;
-					request.size = 4;
-					request.port = _tm_index;
-					request.paddr = 0x0ull;
-					request.data_u32 = 1;
+					MemoryRequest request = _tile_request();
 					_atomic_regs->write_request(request, request.port);
 					_stalled_for_atomic_reg = true;
 				}
 			}
 			else if(_return_network.is_write_valid(_current_request.port))
 			{
-				uint x = (_current_tile % (_width / _tile_width)) * _tile_width + (_current_offset % _tile_width);
-				uint y = (_current_tile / (_width / _tile_width)) * _tile_height + (_current_offset / _tile_width);
-				uint32_t index = y * _width + x;
+				uint32_t index = _pixel_index();
 				MemoryReturn ret(_current_request, &index);
 
 				_return_network.write(ret, ret.port);
@@ -96,6 +111,34 @@ public:
 		_return_network.clock();
 	}
 
+	void get_networks(std::vector<std::pair<const char*, NetworkBase*>>& networks) override
+	{
+		networks.push_back({"Request", &_request_network});
+		networks.push_back({"Return", &_return_network});
+	}
+
+	void serialize(Checkpoint& checkpoint) override
+	{
+		checkpoint(_request_network, _return_network, _current_request_valid, _current_request);
+		checkpoint(_stalled_for_atomic_reg, _current_tile, _current_offset);
+	}
+
+	bool functional_request(const MemoryRequest& request, MemoryReturn& ret) override
+	{
+		if(_current_offset == _tile_size)
+		{
+			MemoryReturn tile_return;
+			_atomic_regs->functional_request(_tile_request(), tile_return);
+			_current_tile = tile_return.data_u32;
+			_current_offset = 0;
+		}
+
+		uint32_t index = _pixel_index();
+		ret = MemoryReturn(request, &index);
+		_current_offset++;
+		return true;
+	}
+
 	bool request_port_write_valid(uint port_index) override
 	{
 		return _request_network.is_write_valid(port_index);
@@ -104,6 +147,7 @@ public:
 	void write_request(const MemoryRequest& request, uint port_index) override
 	{
 		_request_network.write(request, port_index);
+		wake();
 	}
 
 	bool return_port_read_valid(uint port_index) override
@@ -120,6 +164,11 @@ public:
 	{
 		return _return_network.read(port_index);
 	}
+
+	void set_return_port_unit(uint port_index, UnitBase* unit) override
+	{
+		_return_network.set_sink_unit(port_index, unit);
+	}
 };
 
 }}
\ No newline at end of file
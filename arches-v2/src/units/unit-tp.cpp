@@ -30,6 +30,10 @@ UnitTP::UnitTP(const Configuration& config) :unit_table(*config.unit_table), uni
 		_int_regs_pending[i] = 0;
 		_float_regs_pending[i] = 0;
 	}
+
+	//returns wake us up when we are sleeping on a data stall
+	for(auto& unit : unique_mems) unit->set_return_port_unit(_tp_index, this);
+	for(auto& unit : unique_sfus) unit->set_return_port_unit(_tp_index, this);
 }
 
 void UnitTP::_clear_register_pending(const ISA::RISCV::RegAddr& dst)
@@ -121,9 +125,37 @@ void UnitTP::_process_load_return(const MemoryReturn& ret)
 	}
 }
 
+//Loads are timed from issue to the cycle we read the return. The outstanding load histogram is weighted by the cycles spent at each count
+void UnitTP::_log_load_issue(const MemoryRequest& req)
+{
+	ISA::RISCV::RegAddr reg_addr(req.dst);
+	_load_issue_cycles[reg_addr.reg + (reg_addr.reg_type == ISA::RISCV::RegType::FLOAT ? 32 : 0)] = group_cycle();
+
+	log.log_outstanding_loads(_outstanding_loads, group_cycle() - _outstanding_loads_cycle);
+	_outstanding_loads_cycle = group_cycle();
+	_outstanding_loads++;
+}
+
+void UnitTP::_log_load_return(const MemoryReturn& ret)
+{
+	ISA::RISCV::RegAddr reg_addr(ret.dst);
+	log.log_load_return(ret.source, group_cycle() - _load_issue_cycles[reg_addr.reg + (reg_addr.reg_type == ISA::RISCV::RegType::FLOAT ? 32 : 0)]);
+
+	log.log_outstanding_loads(_outstanding_loads, group_cycle() - _outstanding_loads_cycle);
+	_outstanding_loads_cycle = group_cycle();
+	_outstanding_loads--;
+}
+
+void UnitTP::flush_outstanding_loads()
+{
+	log.log_outstanding_loads(_outstanding_loads, group_cycle() - _outstanding_loads_cycle);
+	_outstanding_loads_cycle = group_cycle();
+}
+
 void UnitTP::_log_instruction_issue(const ISA::RISCV::Instruction& instr, const ISA::RISCV::InstructionInfo& instr_info, const ISA::RISCV::ExecutionItem& exec_item)
 {
 	log.log_instruction_issue(instr_info, exec_item.pc);
+	_instructions_issued++;
 
 #if 1
 	if(ENABLE_TP_DEBUG_PRINTS)
@@ -135,13 +167,83 @@ void UnitTP::_log_instruction_issue(const ISA::RISCV::Instruction& instr, const
 #endif
 }
 
+void UnitTP::_execute_control_flow(const ISA::RISCV::Instruction& instr, const ISA::RISCV::InstructionInfo& instr_info, ISA::RISCV::ExecutionItem& exec_item)
+{
+	if(instr_info.execute_branch(exec_item, instr))
+	{
+		//jumping to address 0 is the halt condition
+		_pc = exec_item.pc;
+		if(_pc == 0x0ull) simulator->units_executing--;
+	}
+	else _pc += 4;
+	_int_regs.zero.u64 = 0x0ull; //Compiler generate jalr with zero register as target so we need to zero the register after all control flow
+}
+
+void UnitTP::_execute(const ISA::RISCV::Instruction& instr, const ISA::RISCV::InstructionInfo& instr_info, ISA::RISCV::ExecutionItem& exec_item)
+{
+	instr_info.execute(exec_item, instr);
+	_pc += 4;
+	_int_regs.zero.u64 = 0x0ull;
+}
+
+MemoryRequest UnitTP::_generate_request(const ISA::RISCV::Instruction& instr, const ISA::RISCV::InstructionInfo& instr_info, ISA::RISCV::ExecutionItem& exec_item)
+{
+	MemoryRequest req = instr_info.generate_request(exec_item, instr);
+	req.port = _tp_index;
+	_pc += 4;
+	return req;
+}
+
+//The stack lives in the TP so its loads and stores complete on the spot
+void UnitTP::_access_stack(const ISA::RISCV::InstructionInfo& instr_info, const MemoryRequest& req)
+{
+	if((req.vaddr | _stack_mask) != ~0ull)
+	{
+		printf("STACK OVERFLOW!!!\n");
+		assert(false);
+	}
+
+	paddr_t buffer_addr = req.vaddr & _stack_mask;
+	if(instr_info.instr_type == ISA::RISCV::InstrType::LOAD)
+	{
+		//Because of forwarding instruction with latency 1 don't cause stalls so we don't need to set pending bit
+		write_register(&_int_regs, &_float_regs, req.dst, req.size, &_stack_mem[buffer_addr]);
+	}
+	else if(instr_info.instr_type == ISA::RISCV::InstrType::STORE)
+	{
+		std::memcpy(&_stack_mem[buffer_addr], req.data, req.size);
+	}
+	else
+	{
+		assert(false);
+	}
+}
+
 void UnitTP::clock_rise()
 {
+	//halted threads never wake back up
+	if(_pc == 0x0ull)
+	{
+		sleep();
+		return;
+	}
+
+	//log the data stalls we slept through
+	if(_data_stall_sleep_cycle != INT64_MAX)
+	{
+		log.log_data_stall(_data_stall_type, _pc, group_cycle() - _data_stall_sleep_cycle);
+		_data_stall_sleep_cycle = INT64_MAX;
+	}
+
+	bool returned = false;
 	for(auto& unit : unique_mems)
 	{
 		if(!unit->return_port_read_valid(_tp_index)) continue;
 		const MemoryReturn ret = unit->read_return(_tp_index);
+		TraceWriter::record(ret.id, TraceStage::RETURN, group_cycle());
+		_log_load_return(ret);
 		_process_load_return(ret);
+		returned = true;
 	}
 
 	for(auto& unit : unique_sfus)
@@ -149,12 +251,29 @@ void UnitTP::clock_rise()
 		if(!unit->return_port_read_valid(_tp_index)) continue;
 		const SFURequest& ret = unit->read_return(_tp_index);
 		_clear_register_pending(ret.dst);
+		returned = true;
+	}
+
+	//while the simulator drains before a fast forward we only collect what is in flight and the returns wake us
+	if(simulator->draining)
+	{
+		_data_stall_type = 0;
+		sleep();
+		return;
+	}
+
+	//only returns can clear a data stall so if nothing came back we would just stall again
+	if(_data_stall_type && !returned)
+	{
+		_data_stall_sleep_cycle = group_cycle();
+		sleep();
 	}
 }
 
 void UnitTP::clock_fall()
 {
 FREE_INSTR:
+	_data_stall_type = 0;
 	if(_pc == 0x0ull) return;
 
 	//Fetch
@@ -177,6 +296,7 @@ FREE_INSTR:
 	if(uint8_t type = _check_dependancies(instr, instr_info))
 	{
 		log.log_data_stall(type, exec_item.pc);
+		_data_stall_type = type;
 		return;
 	}
 
@@ -186,14 +306,7 @@ FREE_INSTR:
 		_log_instruction_issue(instr, instr_info, exec_item);
 		if(ENABLE_TP_DEBUG_PRINTS) printf("\n");
 
-		if(instr_info.execute_branch(exec_item, instr))
-		{
-			//jumping to address 0 is the halt condition
-			_pc = exec_item.pc;
-			if(_pc == 0x0ull) simulator->units_executing--;
-		}
-		else _pc += 4;
-		_int_regs.zero.u64 = 0x0ull; //Compiler generate jalr with zero register as target so we need to zero the register after all control flow
+		_execute_control_flow(instr, instr_info, exec_item);
 	}
 	else if(instr_info.exec_type == ISA::RISCV::ExecType::EXECUTABLE)
 	{
@@ -208,9 +321,7 @@ FREE_INSTR:
 		_log_instruction_issue(instr, instr_info, exec_item);
 		if(ENABLE_TP_DEBUG_PRINTS) printf("\n");
 
-		instr_info.execute(exec_item, instr);
-		_pc += 4;
-		_int_regs.zero.u64 = 0x0ull;
+		_execute(instr, instr_info, exec_item);
 
 		//Issue to SFU
 		ISA::RISCV::RegAddr reg_addr;
@@ -242,11 +353,9 @@ FREE_INSTR:
 
 		//Executing memory instructions spawns a request
 		_log_instruction_issue(instr, instr_info, exec_item);
-		MemoryRequest req = instr_info.generate_request(exec_item, instr);
-		req.port = _tp_index;
-		_pc += 4;
+		MemoryRequest req = _generate_request(instr, instr_info, exec_item);
 
-		if(req.vaddr < (~0x0ull << 20))
+		if(!_is_stack_access(req))
 		{
 			if(ENABLE_TP_DEBUG_PRINTS)
 			{
@@ -260,37 +369,67 @@ FREE_INSTR:
 
 			assert(req.vaddr < 4ull * 1024ull * 1024ull * 1024ull);
 
+			if(TraceWriter::enabled())
+			{
+				req.id = TraceWriter::new_id();
+				TraceWriter::record(req.id, TraceStage::ISSUE, group_cycle());
+			}
+
+			if(req.type != MemoryRequest::Type::STORE)
+				_log_load_issue(req);
+
 			_set_dependancies(instr, instr_info);
 			mem->write_request(req, req.port);
 		}
 		else
 		{
 			if(ENABLE_TP_DEBUG_PRINTS) printf("\n");
+			_access_stack(instr_info, req);
+		}
+	}
+	else assert(false);
+}
 
-			if((req.vaddr | _stack_mask) != ~0ull)
-			{
-				printf("STACK OVERFLOW!!!\n");
-				assert(false);
-			}
+bool UnitTP::step_functional()
+{
+	if(_pc == 0x0ull) return false;
 
-			if(instr_info.instr_type == ISA::RISCV::InstrType::LOAD)
-			{
-				//Because of forwarding instruction with latency 1 don't cause stalls so we don't need to set pending bit
-				paddr_t buffer_addr = req.vaddr & _stack_mask;
-				write_register(&_int_regs, &_float_regs, req.dst, req.size, &_stack_mem[buffer_addr]);
-			}
-			else if(instr_info.instr_type == ISA::RISCV::InstrType::STORE)
-			{
-				paddr_t buffer_addr = req.vaddr & _stack_mask;
-				std::memcpy(&_stack_mem[buffer_addr], req.data, req.size);
-			}
-			else
-			{
-				assert(false);
-			}
+	const ISA::RISCV::Instruction instr(reinterpret_cast<uint32_t*>(_cheat_memory)[_pc / 4]);
+	const ISA::RISCV::InstructionInfo instr_info = instr.get_info();
+	ISA::RISCV::ExecutionItem exec_item = {_pc, &_int_regs, &_float_regs};
+	_instructions_issued++;
+
+	//the simulator drains the machine first so nothing is pending and every instruction completes on the spot
+	if(instr_info.exec_type == ISA::RISCV::ExecType::CONTROL_FLOW)
+	{
+		_execute_control_flow(instr, instr_info, exec_item);
+	}
+	else if(instr_info.exec_type == ISA::RISCV::ExecType::EXECUTABLE)
+	{
+		_execute(instr, instr_info, exec_item);
+	}
+	else if(instr_info.exec_type == ISA::RISCV::ExecType::MEMORY)
+	{
+		MemoryRequest req = _generate_request(instr, instr_info, exec_item);
+		if(!_is_stack_access(req))
+		{
+			UnitMemoryBase* mem = (UnitMemoryBase*)unit_table[(uint)instr_info.instr_type];
+			MemoryReturn ret;
+			if(mem->functional_request(req, ret))
+				_process_load_return(ret);
 		}
+		else _access_stack(instr_info, req);
 	}
 	else assert(false);
+
+	return true;
+}
+
+void UnitTP::serialize(Checkpoint& checkpoint)
+{
+	checkpoint(_int_regs, _float_regs, _pc, _float_regs_pending, _int_regs_pending);
+	checkpoint(_thread_id, _data_stall_type, _data_stall_sleep_cycle, _stack_mem, _instructions_issued, log);
+	checkpoint(_load_issue_cycles, _outstanding_loads, _outstanding_loads_cycle);
 }
 
 }}
\ No newline at end of file
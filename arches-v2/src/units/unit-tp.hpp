@@ -54,25 +54,55 @@ protected:
 
 	uint _thread_id{0};
 
+	uint8_t  _data_stall_type{0};
+	cycles_t _data_stall_sleep_cycle{INT64_MAX};
+
 	std::vector<uint8_t> _stack_mem;
 	uint64_t _stack_mask;
 
+	uint64_t _instructions_issued{0};
+
+	//issue cycle of the load in flight to each register. Float registers follow the int registers
+	cycles_t _load_issue_cycles[64]{};
+	uint     _outstanding_loads{0};
+	cycles_t _outstanding_loads_cycle{0};
+
 public:
 	UnitTP(const Configuration& config);
 
 	void clock_rise() override;
 	void clock_fall() override;
+	void serialize(Checkpoint& checkpoint) override;
+
+	bool step_functional() override;
+	uint64_t instructions_issued() override { return _instructions_issued; }
+
+	//Logs the span since the last load issue or return so the outstanding load histogram covers the whole run
+	void flush_outstanding_loads();
 
 protected:
 	void _process_load_return(const MemoryReturn& ret);
 	virtual uint8_t _check_dependancies(const ISA::RISCV::Instruction& instr, const ISA::RISCV::InstructionInfo& instr_info);
 	virtual void _set_dependancies(const ISA::RISCV::Instruction& instr, const ISA::RISCV::InstructionInfo& instr_info);
 	void _clear_register_pending(const ISA::RISCV::RegAddr& dst);
+	void _log_load_issue(const MemoryRequest& req);
+	void _log_load_return(const MemoryReturn& ret);
 	void _log_instruction_issue(const ISA::RISCV::Instruction& instr, const ISA::RISCV::InstructionInfo& instr_info, const ISA::RISCV::ExecutionItem& exec_item);
 
+	//Shared by clock_fall and step_functional so the detailed and functional paths execute instructions the same way
+	void _execute_control_flow(const ISA::RISCV::Instruction& instr, const ISA::RISCV::InstructionInfo& instr_info, ISA::RISCV::ExecutionItem& exec_item);
+	void _execute(const ISA::RISCV::Instruction& instr, const ISA::RISCV::InstructionInfo& instr_info, ISA::RISCV::ExecutionItem& exec_item);
+	MemoryRequest _generate_request(const ISA::RISCV::Instruction& instr, const ISA::RISCV::InstructionInfo& instr_info, ISA::RISCV::ExecutionItem& exec_item);
+	bool _is_stack_access(const MemoryRequest& req) { return req.vaddr >= (~0x0ull << 20); }
+	void _access_stack(const ISA::RISCV::InstructionInfo& instr_info, const MemoryRequest& req);
+
 public:
 	class Log
 	{
+	public:
+		static constexpr uint NUM_LATENCY_BUCKETS = 16; //log2 buckets, the last one takes everything longer
+		static constexpr uint MAX_OUTSTANDING_LOADS = 64;
+
 	protected:
 		vaddr_t _elf_start_addr;
 		std::vector<uint64_t> _profile_counters;
@@ -82,6 +112,11 @@ public:
 		uint64_t _resource_stall_counters[static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES)];
 		uint64_t _data_stall_counters[static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES)];
 
+		uint64_t _load_latency_buckets[static_cast<size_t>(MemorySource::NUM_SOURCES)][NUM_LATENCY_BUCKETS];
+		uint64_t _load_counters[static_cast<size_t>(MemorySource::NUM_SOURCES)];
+		uint64_t _load_latency_cycles[static_cast<size_t>(MemorySource::NUM_SOURCES)];
+		uint64_t _outstanding_load_cycles[MAX_OUTSTANDING_LOADS + 1]; //cycles spent with n loads in flight
+
 	public:
 		Log(uint64_t elf_start_addr) : _elf_start_addr(elf_start_addr) { reset(); }
 
@@ -94,6 +129,17 @@ public:
 				_data_stall_counters[i] = 0;
 				_profile_counters.clear();
 			}
+
+			for(uint i = 0; i < static_cast<size_t>(MemorySource::NUM_SOURCES); ++i)
+			{
+				for(uint j = 0; j < NUM_LATENCY_BUCKETS; ++j)
+					_load_latency_buckets[i][j] = 0;
+				_load_counters[i] = 0;
+				_load_latency_cycles[i] = 0;
+			}
+
+			for(uint i = 0; i <= MAX_OUTSTANDING_LOADS; ++i)
+				_outstanding_load_cycles[i] = 0;
 		}
 
 		void accumulate(const Log& other)
@@ -105,6 +151,17 @@ public:
 				_data_stall_counters[i] += other._data_stall_counters[i];
 			}
 
+			for(uint i = 0; i < static_cast<size_t>(MemorySource::NUM_SOURCES); ++i)
+			{
+				for(uint j = 0; j < NUM_LATENCY_BUCKETS; ++j)
+					_load_latency_buckets[i][j] += other._load_latency_buckets[i][j];
+				_load_counters[i] += other._load_counters[i];
+				_load_latency_cycles[i] += other._load_latency_cycles[i];
+			}
+
+			for(uint i = 0; i <= MAX_OUTSTANDING_LOADS; ++i)
+				_outstanding_load_cycles[i] += other._outstanding_load_cycles[i];
+
 			_profile_counters.resize(std::max(_profile_counters.size(), other._profile_counters.size()), 0ull);
 			for(uint i = 0; i < other._profile_counters.size(); ++i)
 			{
@@ -112,7 +169,7 @@ public:
 			}
 		}
 
-		void profile_instruction(vaddr_t pc)
+		void profile_instruction(vaddr_t pc, uint64_t n = 1)
 		{
 			assert(pc >= _elf_start_addr);
 
@@ -120,7 +177,7 @@ public:
 			if(instr_index >= _profile_counters.size()) 
 				_profile_counters.resize(instr_index + 1, 0ull);
 
-			_profile_counters[instr_index]++;
+			_profile_counters[instr_index] += n;
 		}
 
 		void log_instruction_issue(const ISA::RISCV::InstructionInfo& info, vaddr_t pc)
@@ -135,10 +192,62 @@ public:
 			profile_instruction(pc);
 		}
 
-		void log_data_stall(uint8_t type, vaddr_t pc)
+		void log_data_stall(uint8_t type, vaddr_t pc, uint64_t n = 1)
 		{
-			_data_stall_counters[type]++;
-			profile_instruction(pc);
+			_data_stall_counters[type] += n;
+			profile_instruction(pc, n);
+		}
+
+		void log_load_return(MemorySource source, cycles_t latency)
+		{
+			uint bucket = std::min(latency ? log2i(latency) + 1 : 0u, NUM_LATENCY_BUCKETS - 1);
+			_load_latency_buckets[(uint)source][bucket]++;
+			_load_counters[(uint)source]++;
+			_load_latency_cycles[(uint)source] += latency;
+		}
+
+		void log_outstanding_loads(uint outstanding_loads, cycles_t cycles)
+		{
+			_outstanding_load_cycles[std::min(outstanding_loads, MAX_OUTSTANDING_LOADS)] += cycles;
+		}
+
+		uint64_t get_loads() const
+		{
+			uint64_t loads = 0;
+			for(uint i = 0; i < static_cast<size_t>(MemorySource::NUM_SOURCES); ++i)
+				loads += _load_counters[i];
+			return loads;
+		}
+
+		uint64_t get_load_latency_cycles() const
+		{
+			uint64_t cycles = 0;
+			for(uint i = 0; i < static_cast<size_t>(MemorySource::NUM_SOURCES); ++i)
+				cycles += _load_latency_cycles[i];
+			return cycles;
+		}
+
+		double get_mean_load_latency() const
+		{
+			uint64_t loads = get_loads();
+			return loads ? (double)get_load_latency_cycles() / loads : 0.0;
+		}
+
+		//sum of loads in flight over every logged cycle
+		uint64_t get_outstanding_load_cycles() const
+		{
+			uint64_t load_cycles = 0;
+			for(uint i = 0; i <= MAX_OUTSTANDING_LOADS; ++i)
+				load_cycles += i * _outstanding_load_cycles[i];
+			return load_cycles;
+		}
+
+		double get_mean_outstanding_loads() const
+		{
+			uint64_t cycles = 0;
+			for(uint i = 0; i <= MAX_OUTSTANDING_LOADS; ++i)
+				cycles += _outstanding_load_cycles[i];
+			return cycles ? (double)get_outstanding_load_cycles() / cycles : 0.0;
 		}
 
 		void print_log(FILE* stream = stdout, uint num_units = 1)
@@ -190,6 +299,41 @@ public:
 			fprintf(stream, "\tTotal: %lld\n", total / num_units);
 			for(uint i = 0; i < _data_stall_counter_pairs.size(); ++i)
 				if(_data_stall_counter_pairs[i].second) fprintf(stream, "\t%s: %lld (%.2f%%)\n", _data_stall_counter_pairs[i].first, _data_stall_counter_pairs[i].second / num_units, static_cast<float>(_data_stall_counter_pairs[i].second) / total * 100.0f);
+
+			const char* source_names[] = {"Other", "L1 Hit", "L1 LFB Hit", "L2", "DRAM", "RSB"};
+			static_assert(sizeof(source_names) / sizeof(source_names[0]) == static_cast<size_t>(MemorySource::NUM_SOURCES));
+
+			total = get_loads();
+			fprintf(stream, "Load Latency\n");
+			fprintf(stream, "\tTotal: %lld\n", total / num_units);
+			fprintf(stream, "\tMean: %.2f\n", get_mean_load_latency());
+			for(uint i = 0; i < static_cast<size_t>(MemorySource::NUM_SOURCES); ++i)
+			{
+				if(!_load_counters[i]) continue;
+				fprintf(stream, "\t%s: %lld (%.2f%%) Mean: %.2f\n", source_names[i], _load_counters[i] / num_units, static_cast<float>(_load_counters[i]) / total * 100.0f, (double)_load_latency_cycles[i] / _load_counters[i]);
+				for(uint j = 0; j < NUM_LATENCY_BUCKETS; ++j)
+				{
+					if(!_load_latency_buckets[i][j]) continue;
+					uint64_t low = j ? 1ull << (j - 1) : 0, high = 1ull << j;
+					if(j == NUM_LATENCY_BUCKETS - 1) fprintf(stream, "\t\t[%lld, inf): %lld (%.2f%%)\n", low, _load_latency_buckets[i][j] / num_units, static_cast<float>(_load_latency_buckets[i][j]) / _load_counters[i] * 100.0f);
+					else                             fprintf(stream, "\t\t[%lld, %lld): %lld (%.2f%%)\n", low, high, _load_latency_buckets[i][j] / num_units, static_cast<float>(_load_latency_buckets[i][j]) / _load_counters[i] * 100.0f);
+				}
+			}
+
+			total = 0;
+			for(uint i = 0; i <= MAX_OUTSTANDING_LOADS; ++i)
+				total += _outstanding_load_cycles[i];
+
+			fprintf(stream, "Outstanding Loads\n");
+			fprintf(stream, "\tMean: %.2f\n", get_mean_outstanding_loads());
+			for(uint i = 0; i <= MAX_OUTSTANDING_LOADS; ++i)
+				if(_outstanding_load_cycles[i]) fprintf(stream, "\t%d: %lld (%.2f%%)\n", i, _outstanding_load_cycles[i] / num_units, static_cast<float>(_outstanding_load_cycles[i]) / total * 100.0f);
+		}
+
+		void serialize(Checkpoint& checkpoint)
+		{
+			checkpoint(_profile_counters, _instr_index, _instruction_counters, _resource_stall_counters, _data_stall_counters);
+			checkpoint(_load_latency_buckets, _load_counters, _load_latency_cycles, _outstanding_load_cycles);
 		}
 
 		void print_profile(uint8_t* backing_memory, FILE* stream = stdout)
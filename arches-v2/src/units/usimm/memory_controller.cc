@@ -194,6 +194,7 @@ void init_memory_controller_vars()
 {
     num_read_merge  = 0;
     num_write_merge = 0;
+    update_mem_count = 0;
     for (int i = 0; i < NUM_CHANNELS; ++i)
     {
         for (int j = 0; j < NUM_RANKS; ++j)
@@ -207,10 +208,13 @@ void init_memory_controller_vars()
             {
                 dram_state[i][j][k].state      = IDLE;
                 dram_state[i][j][k].active_row = -1;
-                dram_state[i][j][k].next_pre   = -1;
-                dram_state[i][j][k].next_pre   = -1;
-                dram_state[i][j][k].next_pre   = -1;
-                dram_state[i][j][k].next_pre   = -1;
+                dram_state[i][j][k].next_pre       = -1;
+                dram_state[i][j][k].next_act       = 0;
+                dram_state[i][j][k].next_read      = 0;
+                dram_state[i][j][k].next_write     = 0;
+                dram_state[i][j][k].next_powerdown = 0;
+                dram_state[i][j][k].next_powerup   = 0;
+                dram_state[i][j][k].next_refresh   = 0;
 
                 cmd_precharge_issuable[i][j][k]   = false;
 
@@ -222,6 +226,11 @@ void init_memory_controller_vars()
                 stats_num_write[i][j][k]          = 0;
                 cas_issued_current_cycle[i][j][k] = CIC_NONE;
 
+                total_col_reads[i][j][k]          = 0;
+                total_pre_cmds[i][j][k]           = 0;
+                total_single_col_reads[i][j][k]   = 0;
+                current_col_reads[i][j][k]        = 0;
+
             }
 
             cmd_all_bank_precharge_issuable[i][j] = false;
@@ -239,7 +248,13 @@ void init_memory_controller_vars()
             stats_time_spent_in_active_power_down[i][j]         = 0;
             stats_time_spent_in_precharge_power_down_slow[i][j] = 0;
             stats_time_spent_in_precharge_power_down_fast[i][j] = 0;
+            stats_time_spent_in_active_standby[i][j]            = 0;
+            stats_time_spent_in_power_up[i][j]                  = 0;
+            stats_time_spent_terminating_reads_from_other_ranks[i][j] = 0;
+            stats_time_spent_terminating_writes_to_other_ranks[i][j]  = 0;
             last_activate[i][j]                 = 0;
+            last_refresh[i][j]                  = 0;
+            average_gap_between_refreshes[i][j] = 0;
             //If average_gap_between_activates is 0 then we know that there have been no activates to [i][j]
             average_gap_between_activates[i][j] = 0;
 
@@ -256,6 +271,10 @@ void init_memory_controller_vars()
         read_queue_length[i]  = 0;
         write_queue_length[i] = 0;
 
+        max_read_queue_length[i]         = 0;
+        max_write_queue_length[i]        = 0;
+        accumulated_read_queue_length[i] = 0;
+
         command_issued_current_cycle[i] = false;
 
         // Stats
@@ -1989,38 +2008,45 @@ void issue_forced_refresh_commands(const int channel, const int rank)
 }
 
 
-void gather_stats(const int channel)
+// accumulates the time a rank spent in its current power state
+// over the given number of cycles
+static void gather_rank_stats(const int channel, const int rank, const long long int cycles)
 {
-    accumulated_read_queue_length[channel] += read_queue_length[channel];
-
-    for (int i = 0; i < NUM_RANKS; i++)
+    switch (dram_state[channel][rank][0].state)
     {
-        switch (dram_state[channel][i][0].state)
-        {
-            case PRECHARGE_POWER_DOWN_SLOW:
-                stats_time_spent_in_precharge_power_down_slow[channel][i] += PROCESSOR_CLK_MULTIPLIER;
-                break;
+        case PRECHARGE_POWER_DOWN_SLOW:
+            stats_time_spent_in_precharge_power_down_slow[channel][rank] += cycles * PROCESSOR_CLK_MULTIPLIER;
+            break;
 
-            case PRECHARGE_POWER_DOWN_FAST:
-                stats_time_spent_in_precharge_power_down_fast[channel][i] += PROCESSOR_CLK_MULTIPLIER;
-                break;
+        case PRECHARGE_POWER_DOWN_FAST:
+            stats_time_spent_in_precharge_power_down_fast[channel][rank] += cycles * PROCESSOR_CLK_MULTIPLIER;
+            break;
 
-            case ACTIVE_POWER_DOWN:
-                stats_time_spent_in_active_power_down[channel][i]         += PROCESSOR_CLK_MULTIPLIER;
-                break;
+        case ACTIVE_POWER_DOWN:
+            stats_time_spent_in_active_power_down[channel][rank]         += cycles * PROCESSOR_CLK_MULTIPLIER;
+            break;
 
-            default:
-                for (int b = 0; b < NUM_BANKS; b++)
+        default:
+            for (int b = 0; b < NUM_BANKS; b++)
+            {
+                if (dram_state[channel][rank][b].state == ROW_ACTIVE)
                 {
-                    if (dram_state[channel][i][b].state == ROW_ACTIVE)
-                    {
-                        stats_time_spent_in_active_standby[channel][i] += PROCESSOR_CLK_MULTIPLIER;
-                        break;
-                    }
+                    stats_time_spent_in_active_standby[channel][rank] += cycles * PROCESSOR_CLK_MULTIPLIER;
+                    break;
                 }
-                stats_time_spent_in_power_up[channel][i] += PROCESSOR_CLK_MULTIPLIER;
-                break;
-        }
+            }
+            stats_time_spent_in_power_up[channel][rank] += cycles * PROCESSOR_CLK_MULTIPLIER;
+            break;
+    }
+}
+
+void gather_stats(const int channel)
+{
+    accumulated_read_queue_length[channel] += read_queue_length[channel];
+
+    for (int i = 0; i < NUM_RANKS; i++)
+    {
+        gather_rank_stats(channel, i, 1);
     }
 }
 
@@ -2120,6 +2146,39 @@ void update_issuable_commands(const int channel)
 }
 
 
+// handles the refresh deadlines of a rank for the current
+// cycle. This is called every DRAM cycle from update_memory
+void update_refresh_deadlines(const int channel, const int rank)
+{
+    // if we are at the refresh completion
+    // deadline
+    if (CYCLE_VAL == next_refresh_completion_deadline[channel][rank])
+    {
+        // calculate the next
+        // refresh_issue_deadline
+        num_issued_refreshes[channel][rank]             = 0;
+        last_refresh_completion_deadline[channel][rank] = CYCLE_VAL;
+        next_refresh_completion_deadline[channel][rank] = CYCLE_VAL + 8 * T_REFI;
+        refresh_issue_deadline[channel][rank]           = next_refresh_completion_deadline[channel][rank] - T_RP - 8 * T_RFC;
+        forced_refresh_mode_on[channel][rank]           = false;
+//        issued_forced_refresh_commands[channel][rank]   = 0;
+    }
+    else if (CYCLE_VAL == refresh_issue_deadline[channel][rank] &&
+             num_issued_refreshes[channel][rank] < 8)
+    {
+        // refresh_issue_deadline has been
+        // reached. Do the auto-refreshes
+        forced_refresh_mode_on[channel][rank] = true;
+        issue_forced_refresh_commands(channel, rank);
+    }
+    else if (CYCLE_VAL < refresh_issue_deadline[channel][rank])
+    {
+        //update the refresh_issue deadline
+        refresh_issue_deadline[channel][rank] = next_refresh_completion_deadline[channel][rank] - T_RP - (8 - num_issued_refreshes[channel][rank]) * T_RFC;
+    }
+}
+
+
 // function that updates the dram state and schedules auto-refresh if
 // necessary. This is called every DRAM cycle
 void update_memory()
@@ -2145,32 +2204,7 @@ void update_memory()
             // CYCLE_VAL - T_FAW
             flush_activate_record(channel, rank, CYCLE_VAL);
 
-            // if we are at the refresh completion
-            // deadline
-            if (CYCLE_VAL == next_refresh_completion_deadline[channel][rank])
-            {
-                // calculate the next
-                // refresh_issue_deadline
-                num_issued_refreshes[channel][rank]             = 0;
-                last_refresh_completion_deadline[channel][rank] = CYCLE_VAL;
-                next_refresh_completion_deadline[channel][rank] = CYCLE_VAL + 8 * T_REFI;
-                refresh_issue_deadline[channel][rank]           = next_refresh_completion_deadline[channel][rank] - T_RP - 8 * T_RFC;
-                forced_refresh_mode_on[channel][rank]           = false;
-//                issued_forced_refresh_commands[channel][rank]   = 0;
-            }
-            else if (CYCLE_VAL == refresh_issue_deadline[channel][rank] &&
-                     num_issued_refreshes[channel][rank] < 8)
-            {
-                // refresh_issue_deadline has been
-                // reached. Do the auto-refreshes
-                forced_refresh_mode_on[channel][rank] = true;
-                issue_forced_refresh_commands(channel, rank);
-            }
-            else if (CYCLE_VAL < refresh_issue_deadline[channel][rank])
-            {
-                //update the refresh_issue deadline
-                refresh_issue_deadline[channel][rank] = next_refresh_completion_deadline[channel][rank] - T_RP - (8 - num_issued_refreshes[channel][rank]) * T_RFC;
-            }
+            update_refresh_deadlines(channel, rank);
         }
 
         // update the variables corresponding to the non-queue
@@ -2188,6 +2222,66 @@ void update_memory()
 }
 
 
+// advances an idle memory system by the given number of cycles. Has the same
+// effect as calling update_memory() and gather_stats() every cycle but with
+// empty queues nothing can be issued, so the only changes are the refresh
+// deadlines and power state statistics. These only change at refresh events
+// so we jump from one event to the next. Does not advance CYCLE_VAL
+void fast_forward_memory(const long long int cycles)
+{
+    if (cycles <= 0)
+        return;
+
+    const Arches::cycles_t start_cycle = CYCLE_VAL;
+    const Arches::cycles_t end_cycle   = CYCLE_VAL + cycles;
+
+    update_mem_count += cycles;
+
+    for (int channel = 0; channel < NUM_CHANNELS; channel++)
+    {
+        assert(read_queue_length[channel] == 0 && write_queue_length[channel] == 0);
+
+        command_issued_current_cycle[channel] = false;
+        for (int rank = 0; rank < NUM_RANKS; rank++)
+        {
+            for (int bank = 0; bank < NUM_BANKS; bank++)
+            {
+                cas_issued_current_cycle[channel][rank][bank] = CIC_NONE;
+            }
+
+            // the record is a ring buffer so after one full window everything is flushed
+            for (Arches::cycles_t cycle = start_cycle; cycle < end_cycle && cycle < start_cycle + BIG_ACTIVATION_WINDOW; cycle++)
+            {
+                flush_activate_record(channel, rank, cycle);
+            }
+
+            Arches::cycles_t cycle = start_cycle;
+            while (cycle < end_cycle)
+            {
+                CYCLE_VAL = cycle;
+                update_refresh_deadlines(channel, rank);
+
+                // the rank state holds until the next refresh event
+                Arches::cycles_t next_event = std::min<Arches::cycles_t>(end_cycle, next_refresh_completion_deadline[channel][rank]);
+                if (refresh_issue_deadline[channel][rank] > cycle && num_issued_refreshes[channel][rank] < 8)
+                    next_event = std::min<Arches::cycles_t>(next_event, refresh_issue_deadline[channel][rank]);
+                if (next_event <= cycle)
+                    next_event = cycle + 1;
+
+                gather_rank_stats(channel, rank, next_event - cycle);
+                cycle = next_event;
+            }
+        }
+
+        // leave the issuable flags as the last cycle would have
+        CYCLE_VAL = end_cycle - 1;
+        update_issuable_commands(channel);
+    }
+
+    CYCLE_VAL = start_cycle;
+}
+
+
 //------------------------------------------------------------
 // Calculate Power: It calculates and returns average power used by every Rank on Every 
 // Channel during the course of the simulation 
@@ -2482,3 +2576,56 @@ float calculate_power(const int channel,
     return total_rank_power;
 }
 
+
+void req::serialize(Arches::Checkpoint& checkpoint)
+{
+    checkpoint(physical_address, dram_addr, arrival_time, dispatch_time, completion_time, latency);
+    checkpoint(next_command, operation_type, command_issuable, request_served, arches_reqs);
+}
+
+
+void serialize_memory_controller(Arches::Checkpoint& checkpoint)
+{
+    checkpoint(usimmUsageStats, max_write_queue_length, max_read_queue_length, accumulated_read_queue_length, update_mem_count);
+    checkpoint(total_col_reads, total_pre_cmds, total_single_col_reads, current_col_reads);
+    checkpoint(dram_state, command_issued_current_cycle, cas_issued_current_cycle, read_queue_head, write_queue_head);
+    checkpoint(cmd_precharge_issuable, cmd_all_bank_precharge_issuable, cmd_powerdown_fast_issuable, cmd_powerdown_slow_issuable, cmd_powerup_issuable, cmd_refresh_issuable);
+    checkpoint(next_refresh_completion_deadline, last_refresh_completion_deadline, forced_refresh_mode_on, refresh_issue_deadline, num_issued_refreshes);
+    checkpoint(read_queue_length, write_queue_length);
+
+    checkpoint(num_read_merge, num_write_merge, stats_reads_merged_per_channel, stats_writes_merged_per_channel);
+    checkpoint(stats_reads_seen, stats_writes_seen, stats_reads_completed, stats_writes_completed);
+    checkpoint(stats_average_read_latency, stats_average_read_queue_latency, stats_average_write_latency, stats_average_write_queue_latency);
+    checkpoint(stats_page_hits, stats_read_row_hit_rate, stats_float_compare, stats_float_add, stats_int_add);
+
+    checkpoint(stats_time_spent_in_active_standby, stats_time_spent_in_active_power_down, stats_time_spent_in_precharge_power_down_fast);
+    checkpoint(stats_time_spent_in_precharge_power_down_slow, stats_time_spent_in_power_up, last_activate, last_refresh);
+    checkpoint(average_gap_between_activates, average_gap_between_refreshes);
+    checkpoint(stats_time_spent_terminating_reads_from_other_ranks, stats_time_spent_terminating_writes_to_other_ranks);
+
+    checkpoint(stats_num_activate_read, stats_num_activate_write, stats_num_activate_spec, stats_num_activate, stats_num_precharge);
+    checkpoint(stats_num_read, stats_num_write, stats_num_powerdown_slow, stats_num_powerdown_fast, stats_num_powerup);
+
+    // the activation record is mostly empty so only the activates in it are saved
+    for (int channel = 0; channel < NUM_CHANNELS; ++channel)
+    {
+        for (int rank = 0; rank < NUM_RANKS; ++rank)
+        {
+            std::vector<uint32_t> activates;
+            if (!checkpoint.restoring())
+            {
+                for (uint32_t i = 0; i < BIG_ACTIVATION_WINDOW; ++i)
+                    if (activation_record[channel][rank][i]) activates.push_back(i);
+            }
+
+            checkpoint(activates);
+
+            if (checkpoint.restoring())
+            {
+                memset(activation_record[channel][rank], 0, sizeof(activation_record[channel][rank]));
+                for (uint32_t i : activates)
+                    activation_record[channel][rank][i] = true;
+            }
+        }
+    }
+}
@@ -13,6 +13,7 @@
 #include <list>
 #include <stdlib.h>
 #include "../../stdafx.hpp"
+#include "../../util/checkpoint.hpp"
 
 #define MAX_QUEUE_LENGTH 80
 #define MAX_NUM_CHANNELS 16
@@ -128,6 +129,8 @@ typedef struct req
 
     //TRaX stuff
     std::vector<arches_request_t> arches_reqs;
+
+    void serialize(Arches::Checkpoint& checkpoint);
 } request_t;
 
 // Returned when inserting a read or a write
@@ -292,6 +295,9 @@ void init_memory_controller_vars();
 // called every cycle to update the read/write queues
 void update_memory();
 
+// advances an idle memory system without stepping through every cycle
+void fast_forward_memory(const long long int cycles);
+
 // activate to bank allowed or not
 bool is_activate_allowed(const int channel,
                          const int rank,
@@ -411,6 +417,9 @@ void gather_stats(const int channel);
 // print statistics
 extern void print_stats();
 
+// save or restore the queues, bank states and stats. Config parameters are reloaded by usimm_setup
+void serialize_memory_controller(Arches::Checkpoint& checkpoint);
+
 // calculate power for each channel
 float calculate_power(const int channel,
                       const int rank,
@@ -10,6 +10,9 @@ extern Arches::cycles_t CYCLE_VAL;
 int BANK_CAN_BE_CLOSED[MAX_NUM_CHANNELS][MAX_NUM_RANKS][MAX_NUM_BANKS];
 long long int schedule_count;
 
+// 1 means we are in write-drain mode for that channel
+int drain_writes[MAX_NUM_CHANNELS];
+
 
 void init_scheduler_vars()
 {
@@ -23,6 +26,7 @@ void init_scheduler_vars()
                 BANK_CAN_BE_CLOSED[i][j][k] = 0;
             }
         }
+        drain_writes[i] = 0;
     }
     return;
 }
@@ -34,9 +38,6 @@ void init_scheduler_vars()
 // end write queue drain once write queue has this many writes in it
 #define LO_WM 20
 
-// 1 means we are in write-drain mode for that channel
-int drain_writes[MAX_NUM_CHANNELS];
-
 
 /* Each cycle it is possible to issue a valid command from the read or write queues
    OR
@@ -313,7 +314,22 @@ void schedule(int channel)
 #endif
 }
 
+
+// same as calling schedule() on an idle channel the given number of times.
+// With both queues empty the only state it changes is the write drain flag
+void fast_forward_schedule(int channel, long long int cycles)
+{
+    schedule_count += cycles;
+    drain_writes[channel] = 1;
+}
+
 void scheduler_stats()
 {
     // Nothing to print for now.
 }
+
+
+void serialize_scheduler(Arches::Checkpoint& checkpoint)
+{
+    checkpoint(BANK_CAN_BE_CLOSED, schedule_count, drain_writes);
+}
@@ -2,10 +2,13 @@
 #define __SCHEDULER_H__
 
 #include "../../stdafx.hpp"
+#include "../../util/checkpoint.hpp"
 
 void init_scheduler_vars(); // called from main
 void scheduler_stats();     // called from main
 void schedule(int);         // scheduler function called every cycle
+void fast_forward_schedule(int, long long int); // same as calling schedule on an idle channel for many cycles
+void serialize_scheduler(Arches::Checkpoint& checkpoint); // save or restore the scheduler state
 
 extern Arches::cycles_t CYCLE_VAL;
 extern long long int schedule_count;
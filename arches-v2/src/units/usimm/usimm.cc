@@ -406,6 +406,8 @@ int usimm_setup(char* config_filename,
         ROB[i].instrpc     = (long long int*)malloc(sizeof(long long int)*ROBSIZE);
         ROB[i].optype      = (int*)malloc(sizeof(int)*ROBSIZE);
     }
+    //a process can set usimm up again once the previous dram is destroyed
+    CYCLE_VAL = 0;
     init_memory_controller_vars();
     init_scheduler_vars();
 
@@ -897,6 +899,19 @@ bool usimmIsBusy()
 }
 
 
+// Advances an idle usimm by the given number of dram cycles. Same as calling usimmClock() that many times
+// without stepping through every cycle.
+void usimmFastForward(Arches::cycles_t cycles)
+{
+    assert(!usimmIsBusy());
+
+    fast_forward_memory(cycles);
+    for (int c = 0; c < NUM_CHANNELS; ++c)
+        fast_forward_schedule(c, cycles);
+    CYCLE_VAL += cycles;
+}
+
+
 void usimmDestroy()
 {
     for (int i = 0; i < (int32_t)NUMCORES; i++)
@@ -913,3 +928,16 @@ void usimmDestroy()
     free(time_done);
     free(prefixtable);
 }
+
+
+// Saves or restores the state that changes after usimm_setup. Restoring needs usimm set up with the same config
+void usimmSerialize(Arches::Checkpoint& checkpoint)
+{
+    checkpoint.check(NUM_CHANNELS);
+    checkpoint.check(NUM_RANKS);
+    checkpoint.check(NUM_BANKS);
+
+    checkpoint(CYCLE_VAL);
+    serialize_memory_controller(checkpoint);
+    serialize_scheduler(checkpoint);
+}
@@ -2,6 +2,7 @@
 #define USIMM_H_
 
 #include "../../stdafx.hpp"
+#include "../../util/checkpoint.hpp"
 
 //#ifndef REL_PATH_BIN_TO_SAMPLES
 //#  define REL_PATH_BIN_TO_SAMPLES "../../config-files/usimm/"
@@ -14,8 +15,10 @@
 int usimm_setup(char* config_filename, char* usimm_vi_file);
 float getUsimmPower();
 void usimmClock();
+void usimmFastForward(Arches::cycles_t cycles);
 bool usimmIsBusy();
 void usimmDestroy();
+void usimmSerialize(Arches::Checkpoint& checkpoint);
 
 void printUsimmStats(uint32_t const L2_line_size,
                      uint32_t const word_size,
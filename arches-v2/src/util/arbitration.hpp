@@ -1,6 +1,7 @@
 #pragma once 
 #include "../stdafx.hpp"
 #include "bit-manipulation.hpp"
+#include "checkpoint.hpp"
 
 //Uses a 64bit integer and BM2 extension to implement a computational and stoarge efficent arbiter for up to 64 clients
 class RoundRobinArbiter
@@ -48,33 +49,89 @@ public:
 	}
 };
 
-#if 0
-template<uint MAX_SIZE>
-class RoundRobinArbiter2
+//Same grant order as RoundRobinArbiter for any number of clients. Pending flags are kept in a hierarchy of bitmaps where each level has a bit for every
+//nonzero word of the level below, so finding the next pending client is a ctz per level instead of a scan. Three levels cover 262144 clients
+class HierarchicalRoundRobinArbiter
 {
 protected:
-	uint64_t _pending[MAX_SIZE];
+	std::vector<std::vector<uint64_t>> _levels; //_levels[0] has a bit per client and the last level is a single word
+	uint32_t _num_pending{0};
 	uint32_t _priority_index{0};
-	uint32_t _size{64};
+	uint32_t _size;
+
+	//first pending index at or after index on this level without wrapping
+	uint _find(uint level, uint index)
+	{
+		std::vector<uint64_t>& words = _levels[level];
+		uint word_index = index >> 6;
+		if(word_index >= words.size()) return ~0u;
+
+		uint64_t word = words[word_index] & (~0x0ull << (index & 0x3f));
+		if(!word)
+		{
+			if(level + 1 == _levels.size()) return ~0u;
+
+			word_index = _find(level + 1, word_index + 1);
+			if(word_index == ~0u) return ~0u;
+			word = words[word_index];
+		}
+
+		return (word_index << 6) + ctz(word);
+	}
 
 public:
-	RoundRobinArbiter(uint size = 64) : _size(size) { assert(size <= MAX_SIZE * 64); }
+	HierarchicalRoundRobinArbiter(uint size = 64) : _size(size)
+	{
+		uint num_bits = std::max(size, 1u);
+		do
+		{
+			_levels.emplace_back((num_bits + 63) / 64, 0x0ull);
+			num_bits = _levels.back().size();
+		}
+		while(num_bits > 1);
+	}
 
 	uint32_t size() { return _size; }
 
 	uint num_pending()
 	{
-		return popcnt(_pending);
+		return _num_pending;
 	}
 
 	void add(uint index)
 	{
-		_pending[index >> 6] |= 0x1ull << (index & 0x3f);
+		assert(index < _size);
+		for(uint level = 0; level < _levels.size(); ++level)
+		{
+			uint64_t& word = _levels[level][index >> 6];
+			uint64_t bit = 0x1ull << (index & 0x3f);
+			if(word & bit) return;
+
+			if(level == 0) _num_pending++;
+			bool was_empty = word == 0;
+			word |= bit;
+			if(!was_empty) return;
+
+			index >>= 6;
+		}
 	}
 
 	void remove(uint index)
 	{
-		_pending[index >> 6] &= ~(0x1ull << (index & 0x3f));
+		assert(index < _size);
+		uint level_index = index;
+		for(uint level = 0; level < _levels.size(); ++level)
+		{
+			uint64_t& word = _levels[level][level_index >> 6];
+			uint64_t bit = 0x1ull << (level_index & 0x3f);
+			if(!(word & bit)) break;
+
+			if(level == 0) _num_pending--;
+			word &= ~bit;
+			if(word) break;
+
+			level_index >>= 6;
+		}
 
 		//Advance the priority index on remove so the grant index is now lowest priority
 		if(index == _priority_index)
@@ -84,32 +141,17 @@ public:
 
 	uint get_index()
 	{
-		uint current_set_index = _priority_index >> 6;
-		while(!_pending[current_set_index])
-		{
-			if(++current_set_index < MAX_SIZE) 
-				current_set_index = 0;
-
-			if(current_set_index == (priority_index >> 6)) 
-				return ~0u;
-		}
-
-
-		bool pending = false;
-		for(uint i = 0; i < MAX_SIZE; ++i)
-			if(_pending[i])
-				pending = true;
-
-		if(!pending)
+		if(!_num_pending)
 			return ~0u;
 
-
-
-		uint64_t rot_mask = rotr(_pending, _priority_index); //rotate the mask so the last index flag is in the 0 bit
-		uint64_t offset = ctz(rot_mask); //count the number of 0s till the next 1
-		uint64_t grant_index = (_priority_index + offset) & 0x3full; //grant the next set bit
+		uint grant_index = _find(0, _priority_index);
+		if(grant_index == ~0u) grant_index = _find(0, 0);
 		_priority_index = grant_index; //make the grant bit the highest priority bit so that it will continue to be granted until removed
 		return grant_index;
 	}
+
+	void serialize(Arches::Checkpoint& checkpoint)
+	{
+		checkpoint(_levels, _num_pending, _priority_index);
+	}
 };
-#endif
\ No newline at end of file
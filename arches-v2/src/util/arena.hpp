@@ -0,0 +1,74 @@
+#pragma once
+#include "../stdafx.hpp"
+
+#include "bit-manipulation.hpp"
+
+//Bump allocator for objects that live as long as the arena. Objects created together end up next to each other in memory instead of scattered across the heap.
+//Objects are destroyed in reverse order of creation when the arena is.
+class Arena
+{
+private:
+	static constexpr size_t BLOCK_ALIGNMENT = 4096;
+
+	struct Block
+	{
+		uint8_t* data;
+		size_t size;
+	};
+
+	struct Object
+	{
+		void* object;
+		void (*destroy)(void* object);
+	};
+
+	std::vector<Block> _blocks;
+	std::vector<Object> _objects;
+	size_t _block_size;
+	size_t _used{0};
+
+	void* _allocate(size_t size, size_t alignment)
+	{
+		if(!_blocks.empty())
+		{
+			size_t offset = align_to(alignment, _used);
+			if(offset + size <= _blocks.back().size)
+			{
+				_used = offset + size;
+				return _blocks.back().data + offset;
+			}
+		}
+
+		//whatever is left in the last block is wasted. Objects bigger than a block get a block to themselves
+		size_t block_size = std::max(_block_size, size);
+		_blocks.push_back({static_cast<uint8_t*>(::operator new(block_size, std::align_val_t(BLOCK_ALIGNMENT))), block_size});
+		_used = size;
+		return _blocks.back().data;
+	}
+
+public:
+	Arena(size_t block_size = 64 * 1024) : _block_size(block_size) {}
+	Arena(Arena&& other) = default;
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	~Arena()
+	{
+		for(auto it = _objects.rbegin(); it != _objects.rend(); ++it)
+			it->destroy(it->object);
+
+		for(Block& block : _blocks)
+			::operator delete(block.data, std::align_val_t(BLOCK_ALIGNMENT));
+	}
+
+	template<typename T, typename... ARGS>
+	T* create(ARGS&&... args)
+	{
+		static_assert(alignof(T) <= BLOCK_ALIGNMENT, "Arena blocks aren't aligned enough for this type");
+
+		T* object = new(_allocate(sizeof(T), alignof(T))) T(std::forward<ARGS>(args)...);
+		if constexpr(!std::is_trivially_destructible_v<T>)
+			_objects.push_back({object, [](void* object) { static_cast<T*>(object)->~T(); }});
+		return object;
+	}
+};
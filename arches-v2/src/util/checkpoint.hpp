@@ -0,0 +1,180 @@
+#pragma once
+#include "../stdafx.hpp"
+
+#include "file.hpp"
+
+#include <list>
+#include <stdexcept>
+
+namespace Arches {
+
+//Saves or restores simulator state. State is described once through operator() and the same code reads or writes it so save and restore can't drift apart.
+//Plain data is copied as raw bytes, std containers are walked element by element and anything else needs a serialize(Checkpoint&) member.
+class Checkpoint
+{
+private:
+	//Some of the math types have a user assignment operator but copy construct bitwise so we only look at the copy constructor
+	template<typename T>
+	static constexpr bool _is_plain_data = std::is_trivially_copy_constructible_v<T> && std::is_trivially_destructible_v<T>;
+
+	Util::File _file;
+	bool _restoring;
+
+	//the std container adapters keep their container in a protected member
+	template<typename ADAPTER>
+	static typename ADAPTER::container_type& _container(ADAPTER& adapter)
+	{
+		struct Access : ADAPTER
+		{
+			static typename ADAPTER::container_type& get(ADAPTER& adapter) { return adapter.*(&Access::c); }
+		};
+		return Access::get(adapter);
+	}
+
+	template<typename CONTAINER>
+	void _sequence(CONTAINER& container)
+	{
+		uint64_t size = container.size();
+		(*this)(size);
+		if(_restoring)
+		{
+			//containers of things without a default constructor are sized by the configuration
+			if constexpr(std::is_default_constructible_v<typename CONTAINER::value_type>) container.resize(size);
+			else if(size != container.size()) throw std::runtime_error("Invalid checkpoint: it was saved from a different configuration!");
+		}
+		for(auto& value : container)
+			(*this)(value);
+	}
+
+	template<typename CONTAINER>
+	void _ordered(CONTAINER& container)
+	{
+		uint64_t size = container.size();
+		(*this)(size);
+
+		if(!_restoring)
+		{
+			for(auto& entry : container)
+			{
+				if constexpr(requires { typename CONTAINER::mapped_type; })
+				{
+					typename CONTAINER::key_type key = entry.first;
+					(*this)(key, entry.second);
+				}
+				else
+				{
+					typename CONTAINER::key_type key = entry;
+					(*this)(key);
+				}
+			}
+			return;
+		}
+
+		container.clear();
+		for(uint64_t i = 0; i < size; ++i)
+		{
+			typename CONTAINER::key_type key{};
+			if constexpr(requires { typename CONTAINER::mapped_type; })
+			{
+				typename CONTAINER::mapped_type value{};
+				(*this)(key, value);
+				container.emplace_hint(container.end(), std::move(key), std::move(value));
+			}
+			else
+			{
+				(*this)(key);
+				container.emplace_hint(container.end(), std::move(key));
+			}
+		}
+	}
+
+public:
+	Checkpoint(const std::string& path, bool restoring) : _file(path, restoring ? Util::File::MODE::R : Util::File::MODE::W_NUKE), _restoring(restoring) {}
+
+	bool restoring() { return _restoring; }
+
+	void bytes(void* data, size_t size)
+	{
+		if(_restoring) _file.read_bin(static_cast<uint8_t*>(data), size);
+		else           _file.write_bin(static_cast<const uint8_t*>(data), size);
+	}
+
+	//Written on save and compared on restore so restoring into a differently configured machine fails loudly instead of running on garbage
+	void check(uint64_t marker)
+	{
+		uint64_t value = marker;
+		(*this)(value);
+		if(value != marker) throw std::runtime_error("Invalid checkpoint: it was saved from a different configuration!");
+	}
+
+	template<typename T>
+	void operator()(T& value)
+	{
+		if constexpr(requires { value.serialize(*this); })
+		{
+			value.serialize(*this);
+		}
+		else
+		{
+			static_assert(_is_plain_data<T>, "Checkpoint needs a serialize member for this type");
+			bytes(&value, sizeof(T));
+		}
+	}
+
+	template<typename T, size_t N>
+	void operator()(T (&values)[N])
+	{
+		if constexpr(_is_plain_data<T> && !requires(T& value) { value.serialize(*this); }) bytes(values, sizeof(values));
+		else for(T& value : values) (*this)(value);
+	}
+
+	template<typename T>
+	void operator()(std::atomic<T>& value)
+	{
+		T copy = value.load();
+		(*this)(copy);
+		value.store(copy);
+	}
+
+	template<typename T>
+	void operator()(std::vector<T>& values)
+	{
+		if constexpr(_is_plain_data<T> && !requires(T& value) { value.serialize(*this); } && !std::is_same_v<T, bool>)
+		{
+			uint64_t size = values.size();
+			(*this)(size);
+			if(_restoring) values.resize(size);
+			bytes(values.data(), size * sizeof(T));
+		}
+		else if constexpr(std::is_same_v<T, bool>)
+		{
+			uint64_t size = values.size();
+			(*this)(size);
+			if(_restoring) values.resize(size);
+			for(uint64_t i = 0; i < size; ++i)
+			{
+				bool value = values[i];
+				(*this)(value);
+				values[i] = value;
+			}
+		}
+		else _sequence(values);
+	}
+
+	template<typename T> void operator()(std::deque<T>& values) { _sequence(values); }
+	template<typename T> void operator()(std::list<T>& values) { _sequence(values); }
+	template<typename T, typename C> void operator()(std::queue<T, C>& values) { (*this)(_container(values)); }
+	template<typename T, typename C> void operator()(std::stack<T, C>& values) { (*this)(_container(values)); }
+	template<typename T, typename C, typename P> void operator()(std::priority_queue<T, C, P>& values) { (*this)(_container(values)); }
+	template<typename K, typename P> void operator()(std::set<K, P>& values) { _ordered(values); }
+	template<typename K, typename V, typename P> void operator()(std::map<K, V, P>& values) { _ordered(values); }
+
+	template<typename T, typename U, typename... ARGS>
+	void operator()(T& first, U& second, ARGS&... rest)
+	{
+		(*this)(first);
+		(*this)(second, rest...);
+	}
+};
+
+}
@@ -0,0 +1,217 @@
+#pragma once
+#include "../stdafx.hpp"
+#include "bit-manipulation.hpp"
+#include "checkpoint.hpp"
+
+#include <memory>
+
+namespace Arches {
+
+//Picks which way of a set a cache evicts. The cache fills invalid ways itself so victim() is only asked about full sets.
+//Ways are indexed within their set and a set can have up to 64 of them
+class ReplacementPolicy
+{
+public:
+	enum class Type : uint8_t
+	{
+		LRU,
+		TREE_PLRU,
+		SRRIP,
+		BRRIP,
+		RANDOM,
+	};
+
+	static const char* name(Type type)
+	{
+		switch(type)
+		{
+		case Type::LRU: return "LRU";
+		case Type::TREE_PLRU: return "TREE_PLRU";
+		case Type::SRRIP: return "SRRIP";
+		case Type::BRRIP: return "BRRIP";
+		case Type::RANDOM: return "RANDOM";
+		}
+		return "UNKNOWN";
+	}
+
+	static std::unique_ptr<ReplacementPolicy> create(Type type, uint num_sets, uint associativity);
+
+protected:
+	uint _associativity;
+
+public:
+	ReplacementPolicy(uint associativity) : _associativity(associativity) { assert(associativity > 0 && associativity <= 64); }
+	virtual ~ReplacementPolicy() = default;
+
+	virtual void touch(uint set, uint way) = 0; //hit
+	virtual void insert(uint set, uint way) = 0; //fill
+	virtual uint victim(uint set) = 0;
+	virtual void serialize(Checkpoint& checkpoint) = 0;
+};
+
+//True LRU. Each way keeps its rank in the recency order so a touch only ages the ways that were more recent than it
+class LRUReplacement : public ReplacementPolicy
+{
+private:
+	std::vector<uint8_t> _ranks; //0 is most recent
+
+public:
+	LRUReplacement(uint num_sets, uint associativity) : ReplacementPolicy(associativity), _ranks(num_sets * associativity)
+	{
+		for(uint i = 0; i < _ranks.size(); ++i)
+			_ranks[i] = i % associativity;
+	}
+
+	void touch(uint set, uint way) override
+	{
+		uint8_t* ranks = &_ranks[set * _associativity];
+		uint8_t rank = ranks[way];
+		for(uint i = 0; i < _associativity; ++i)
+			if(ranks[i] < rank) ranks[i]++;
+		ranks[way] = 0;
+	}
+
+	void insert(uint set, uint way) override { touch(set, way); }
+
+	uint victim(uint set) override
+	{
+		uint8_t* ranks = &_ranks[set * _associativity];
+		for(uint i = 0; i < _associativity; ++i)
+			if(ranks[i] == _associativity - 1) return i;
+		unreachable;
+	}
+
+	void serialize(Checkpoint& checkpoint) override { checkpoint(_ranks); }
+};
+
+//Binary tree of direction bits per set. Node i has children 2i + 1 and 2i + 2 and a set bit points the victim search right.
+//Needs a power of two associativity
+class TreePLRUReplacement : public ReplacementPolicy
+{
+private:
+	std::vector<uint64_t> _trees;
+	uint _levels;
+
+public:
+	TreePLRUReplacement(uint num_sets, uint associativity) : ReplacementPolicy(associativity), _trees(num_sets, 0x0ull), _levels(log2i(associativity))
+	{
+		assert((associativity & (associativity - 1)) == 0);
+	}
+
+	//point every node on the path away from the way
+	void touch(uint set, uint way) override
+	{
+		uint64_t& tree = _trees[set];
+		uint node = 0;
+		for(uint level = 0; level < _levels; ++level)
+		{
+			uint right = (way >> (_levels - level - 1)) & 0x1;
+			if(right) tree &= ~(0x1ull << node);
+			else      tree |= 0x1ull << node;
+			node = 2 * node + 1 + right;
+		}
+	}
+
+	void insert(uint set, uint way) override { touch(set, way); }
+
+	uint victim(uint set) override
+	{
+		uint64_t tree = _trees[set];
+		uint node = 0, way = 0;
+		for(uint level = 0; level < _levels; ++level)
+		{
+			uint right = (tree >> node) & 0x1;
+			way = (way << 1) | right;
+			node = 2 * node + 1 + right;
+		}
+		return way;
+	}
+
+	void serialize(Checkpoint& checkpoint) override { checkpoint(_trees); }
+};
+
+//2 bit re-reference interval prediction (Jaleel et al. 2010). SRRIP inserts with a long interval. BRRIP inserts with a distant interval
+//and only uses the long one every 32nd fill, so lines that are never reused leave the cache before they push out the working set
+class RRIPReplacement : public ReplacementPolicy
+{
+private:
+	static constexpr uint8_t DISTANT = 3;
+	static constexpr uint8_t LONG = 2;
+	static constexpr uint BIMODAL_PERIOD = 32;
+
+	std::vector<uint8_t> _rrpvs;
+	bool _bimodal;
+	uint _fills{0};
+
+public:
+	RRIPReplacement(uint num_sets, uint associativity, bool bimodal) : ReplacementPolicy(associativity), _rrpvs(num_sets * associativity, DISTANT), _bimodal(bimodal) {}
+
+	void touch(uint set, uint way) override { _rrpvs[set * _associativity + way] = 0; }
+
+	void insert(uint set, uint way) override
+	{
+		bool distant = _bimodal && (++_fills % BIMODAL_PERIOD) != 0;
+		_rrpvs[set * _associativity + way] = distant ? DISTANT : LONG;
+	}
+
+	//age the whole set until some way is predicted distant
+	uint victim(uint set) override
+	{
+		uint8_t* rrpvs = &_rrpvs[set * _associativity];
+		uint8_t max_rrpv = 0;
+		for(uint i = 0; i < _associativity; ++i)
+			max_rrpv = std::max(max_rrpv, rrpvs[i]);
+
+		uint8_t age = DISTANT - max_rrpv;
+		uint victim_way = ~0u;
+		for(uint i = 0; i < _associativity; ++i)
+		{
+			rrpvs[i] += age;
+			if(victim_way == ~0u && rrpvs[i] == DISTANT) victim_way = i;
+		}
+		return victim_way;
+	}
+
+	void serialize(Checkpoint& checkpoint) override { checkpoint(_rrpvs, _fills); }
+};
+
+//Uniform random victim from a xorshift generator so runs stay reproducible
+class RandomReplacement : public ReplacementPolicy
+{
+private:
+	uint64_t _state{0x9e3779b97f4a7c15ull};
+
+public:
+	RandomReplacement(uint associativity) : ReplacementPolicy(associativity) {}
+
+	void touch(uint, uint) override {}
+	void insert(uint, uint) override {}
+
+	uint victim(uint) override
+	{
+		_state ^= _state << 13;
+		_state ^= _state >> 7;
+		_state ^= _state << 17;
+		return _state % _associativity;
+	}
+
+	void serialize(Checkpoint& checkpoint) override { checkpoint(_state); }
+};
+
+inline std::unique_ptr<ReplacementPolicy> ReplacementPolicy::create(Type type, uint num_sets, uint associativity)
+{
+	switch(type)
+	{
+	case Type::LRU: return std::make_unique<LRUReplacement>(num_sets, associativity);
+	case Type::TREE_PLRU:
+		if((associativity & (associativity - 1)) != 0) throw std::runtime_error("TREE_PLRU replacement needs a power of two associativity!");
+		return std::make_unique<TreePLRUReplacement>(num_sets, associativity);
+	case Type::SRRIP: return std::make_unique<RRIPReplacement>(num_sets, associativity, false);
+	case Type::BRRIP: return std::make_unique<RRIPReplacement>(num_sets, associativity, true);
+	case Type::RANDOM: return std::make_unique<RandomReplacement>(associativity);
+	}
+	assert(false);
+	return nullptr;
+}
+
+}
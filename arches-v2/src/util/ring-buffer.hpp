@@ -0,0 +1,83 @@
+#pragma once
+#include "../stdafx.hpp"
+
+#include <bit>
+
+#include "checkpoint.hpp"
+
+namespace Arches {
+
+inline uint ring_buffer_capacity(uint min_capacity)
+{
+	return std::bit_ceil(std::max(min_capacity, 1u));
+}
+
+//Fixed capacity FIFO. The capacity is rounded up to a power of two so wrapping is a mask and the storage is allocated once up front.
+//Nothing allocates after construction so pushing and popping never touch the heap.
+template<typename T>
+class RingBuffer
+{
+private:
+	std::vector<T> _entries;
+	uint _mask;
+	uint _head{0};
+	uint _size{0};
+
+public:
+	RingBuffer(uint min_capacity = 1) : _entries(ring_buffer_capacity(min_capacity)), _mask(_entries.size() - 1) {}
+
+	uint capacity() { return _entries.size(); }
+	uint size() { return _size; }
+	bool empty() { return _size == 0; }
+	bool full() { return _size == _entries.size(); }
+
+	void push(const T& entry)
+	{
+		assert(!full());
+		_entries[(_head + _size++) & _mask] = entry;
+	}
+
+	//Claims the next slot so the caller can fill it in place rather than building an entry and copying it in
+	T& push()
+	{
+		assert(!full());
+		return _entries[(_head + _size++) & _mask];
+	}
+
+	T& front()
+	{
+		assert(!empty());
+		return _entries[_head];
+	}
+
+	void pop()
+	{
+		assert(!empty());
+		_head = (_head + 1) & _mask;
+		_size--;
+	}
+
+	void clear()
+	{
+		_head = 0;
+		_size = 0;
+	}
+
+	//Only the live entries are saved. They are restored starting from slot 0
+	void serialize(Checkpoint& checkpoint)
+	{
+		uint64_t size = _size;
+		checkpoint(size);
+		if(checkpoint.restoring())
+		{
+			if(size > _entries.size()) throw std::runtime_error("Invalid checkpoint: it was saved from a different configuration!");
+			_head = 0;
+			_size = size;
+		}
+
+		for(uint i = 0; i < _size; ++i)
+			checkpoint(_entries[(_head + i) & _mask]);
+	}
+};
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "../stdafx.hpp"
+
+//Reusable barrier for a fixed set of threads. Waiting threads spin for a while before parking since most phases are short.
+//The last thread to arrive runs the completion function before any thread is released.
+class SpinBarrier
+{
+private:
+	alignas(64) std::atomic_uint _arrived{0};
+	alignas(64) std::atomic_uint _phase{0};
+	uint _num_threads;
+	uint _spin_count;
+
+public:
+	SpinBarrier(uint num_threads, uint spin_count = 4096) : _num_threads(num_threads), _spin_count(spin_count) {}
+
+	template<typename COMPLETION>
+	void arrive_and_wait(COMPLETION completion)
+	{
+		uint phase = _phase.load(std::memory_order_acquire);
+		if(_arrived.fetch_add(1, std::memory_order_acq_rel) == _num_threads - 1)
+		{
+			_arrived.store(0, std::memory_order_relaxed);
+			completion();
+			_phase.store(phase + 1, std::memory_order_release);
+			_phase.notify_all();
+			return;
+		}
+
+		for(uint i = 0; i < _spin_count; ++i)
+		{
+			if(_phase.load(std::memory_order_acquire) != phase) return;
+			_mm_pause();
+		}
+
+		while(_phase.load(std::memory_order_acquire) == phase)
+			_phase.wait(phase, std::memory_order_acquire);
+	}
+
+	void arrive_and_wait()
+	{
+		arrive_and_wait([]() {});
+	}
+};